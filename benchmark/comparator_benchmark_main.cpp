@@ -0,0 +1,113 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+#include "../util/utils.h"
+#include "../util/comparator.h"
+#include "../util/sequence_generator.h"
+#include "../structure/memory.h"
+#include "../structure/skip_list.h"
+
+#define TEST_NUM 500000
+#define KEY_LEN 25
+#define VALUE_LEN 100
+
+// The comparator before it compared in place: two std::string per call.
+class StringComparator
+{
+public:
+	int operator()(const char* a, const char* b) const
+	{
+		ByteArray akey(ExtractUserKey(a));
+		ByteArray bkey(ExtractUserKey(b));
+		std::string astr_key(akey.Data(), akey.Size());
+		std::string bstr_key(bkey.Data(), bkey.Size());
+		return astr_key < bstr_key ? -1 : (astr_key == bstr_key ? 0 : 1);
+	}
+
+	// No inline prefix either, every node visit goes to the entry.
+	uint64_t Prefix(const char*, uint32_t* size) const
+	{
+		*size = UINT32_MAX;
+		return 0;
+	}
+};
+
+// Cmp with the inline node prefix turned off.
+template<class Cmp>
+class NoPrefix : public Cmp
+{
+public:
+	uint64_t Prefix(const char*, uint32_t* size) const
+	{
+		*size = UINT32_MAX;
+		return 0;
+	}
+};
+
+double TimeInterval(struct timeval start, struct timeval end)
+{
+	return (double)end.tv_sec - start.tv_sec + ((double)end.tv_usec - start.tv_usec) * 1e-6;
+}
+
+template<class Cmp>
+void RunBenchmark(const char* name, std::vector<const char*>& entries)
+{
+	Cmp cmp;
+	Memory memory;
+	SkipList<const char*, Cmp> skip_list(cmp, &memory);
+	struct timeval start, end;
+
+	gettimeofday(&start, NULL);
+	for (auto entry : entries)
+	{
+		skip_list.Insert(entry);
+	}
+
+	gettimeofday(&end, NULL);
+	double insert_time = TimeInterval(start, end);
+
+	int found = 0;
+	gettimeofday(&start, NULL);
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		typename SkipList<const char*, Cmp>::Iterator it(&skip_list);
+		it.Seek(entries[(i * 7919) % entries.size()]);
+		found += it.Valid();
+	}
+
+	gettimeofday(&end, NULL);
+	double seek_time = TimeInterval(start, end);
+
+	printf("%-24s Insert: %9d ops/s, Seek: %9d ops/s (%d found)\n", name,
+		(int)(entries.size() / insert_time), (int)(entries.size() / seek_time), found);
+}
+
+int main()
+{
+	// Same key size as db_benchmark_main.
+	auto kv_pairs = RandomKvPairs(TEST_NUM, KEY_LEN, VALUE_LEN);
+	std::random_shuffle(kv_pairs.begin(), kv_pairs.end());
+
+	std::vector<std::string> buffers(kv_pairs.size());
+	std::vector<const char*> entries;
+	for (size_t i = 0; i < kv_pairs.size(); ++i)
+	{
+		AppendEntry(buffers[i], ByteArray(kv_pairs[i].first.data(), kv_pairs[i].first.size()),
+			ByteArray(kv_pairs[i].second.data(), kv_pairs[i].second.size()));
+		entries.push_back(buffers[i].data());
+	}
+
+	printf("TEST Key Size: %d, Value Size: %d, Entries: %d\n", KEY_LEN, VALUE_LEN, (int)entries.size());
+	RunBenchmark<StringComparator>("std::string", entries);
+	RunBenchmark<NoPrefix<Comparator>>("memcmp, no prefix", entries);
+	RunBenchmark<Comparator>("memcmp", entries);
+	RunBenchmark<KeyComparator<FixedLengthKey<KEY_LEN>>>("memcmp fixed length", entries);
+	return 0;
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "../db/table_builder.h"
+#include "../db/table_reader.h"
+#include "../util/crc32c.h"
+#include "../util/sequence_generator.h"
+
+#define TEST_NUM 50000
+#define KEY_LEN 25
+#define VALUE_LEN 1000
+#define TABLE_PATH "./compression_benchmark.sst"
+
+double TimeInterval(struct timeval start, struct timeval end)
+{
+	return (double)end.tv_sec - start.tv_sec + ((double)end.tv_usec - start.tv_usec) * 1e-6;
+}
+
+// JSON document of about len bytes, with field names repeating across values
+// like the ones we store.
+std::string JsonValue(int id, size_t len)
+{
+	static const char* kNames[] = { "alice", "bob", "carol", "dave", "eve", "frank" };
+	static const char* kStates[] = { "active", "suspended", "pending" };
+	std::string value = "{\"id\":" + std::to_string(id) + ",\"items\":[";
+	while (value.size() + 100 < len)
+	{
+		value += "{\"owner\":\"" + std::string(kNames[rand() % 6]) + "\",\"state\":\"" + kStates[rand() % 3] +
+			"\",\"count\":" + std::to_string(rand() % 1000) + ",\"tag\":\"" + RandomString(6) + "\"},";
+	}
+
+	value += "{}]}";
+	return value;
+}
+
+void RunBenchmark(const char* name, CompressionType compression, std::vector<std::pair<std::string, std::string>>& kv_pairs)
+{
+	TableOptions options;
+	options.compression = compression;
+	struct timeval start, end;
+
+	gettimeofday(&start, NULL);
+	TableBuilder builder(options, WritableFile::Open(TABLE_PATH));
+	for (auto& item : kv_pairs)
+	{
+		builder.Add(ByteArray(item.first.data(), item.first.size()), ByteArray(item.second.data(), item.second.size()));
+	}
+
+	builder.Finish();
+	gettimeofday(&end, NULL);
+	double build_time = TimeInterval(start, end);
+
+	std::string contents;
+	FILE* file = fopen(TABLE_PATH, "r");
+	char buf[1 << 16];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+	{
+		contents.append(buf, n);
+	}
+
+	fclose(file);
+	remove(TABLE_PATH);
+
+	TableReader* table = TableReader::Open(contents.data(), contents.size());
+	int found = 0;
+	double get_time[2];
+	std::string value_out;
+	for (int verify = 0; verify < 2; ++verify)
+	{
+		gettimeofday(&start, NULL);
+		for (size_t i = 0; i < kv_pairs.size(); ++i)
+		{
+			auto& key = kv_pairs[(i * 7919) % kv_pairs.size()].first;
+			found += table->Get(ByteArray(key.data(), key.size()), value_out, verify == 1) == 0;
+		}
+
+		gettimeofday(&end, NULL);
+		get_time[verify] = TimeInterval(start, end);
+	}
+
+	delete table;
+
+	printf("%-8s File: %9d bytes, Ratio: %5.2f, Build: %7.1f MB/s, Get: %8d ops/s, Verified Get: %8d ops/s (%d found)\n", name,
+		(int)contents.size(), (double)builder.RawDataSize() / builder.DataSize(), builder.RawDataSize() / build_time / (1 << 20),
+		(int)(kv_pairs.size() / get_time[0]), (int)(kv_pairs.size() / get_time[1]), found / 2);
+}
+
+// Checksum throughput over the blocks of a table.
+void RunChecksumBenchmark(const char* name, uint32_t (*extend)(uint32_t, const char*, size_t), const std::string& block)
+{
+	int rounds = 200000;
+	uint32_t crc = 0;
+	struct timeval start, end;
+
+	gettimeofday(&start, NULL);
+	for (int i = 0; i < rounds; ++i)
+	{
+		crc = extend(crc, block.data(), block.size());
+	}
+
+	gettimeofday(&end, NULL);
+	printf("crc32c %-8s 4KB Blocks: %7.1f MB/s (%08x)\n", name,
+		(double)block.size() * rounds / TimeInterval(start, end) / (1 << 20), crc);
+}
+
+int main()
+{
+	srand(1);
+	std::vector<std::pair<std::string, std::string>> kv_pairs;
+	for (int i = 0; i < TEST_NUM; ++i)
+	{
+		kv_pairs.push_back(std::make_pair(RandomString(KEY_LEN), JsonValue(i, VALUE_LEN)));
+	}
+
+	std::sort(kv_pairs.begin(), kv_pairs.end());
+	kv_pairs.erase(std::unique(kv_pairs.begin(), kv_pairs.end(),
+		[](const std::pair<std::string, std::string>& a, const std::pair<std::string, std::string>& b) { return a.first == b.first; }), kv_pairs.end());
+
+	printf("TEST Key Size: %d, Value Size: about %d bytes of JSON, Entries: %d\n", KEY_LEN, VALUE_LEN, (int)kv_pairs.size());
+	RunBenchmark("none", NoCompression, kv_pairs);
+	RunBenchmark("lz", LzCompression, kv_pairs);
+	RunBenchmark("lz-high", LzHighCompression, kv_pairs);
+	std::string block = RandomString(4096);
+	RunChecksumBenchmark("table", Crc32cExtendPortable, block);
+	if (Crc32cHasSse42())
+	{
+		RunChecksumBenchmark("sse4.2", Crc32cExtendSse42, block);
+	}
+
+	return 0;
+}
@@ -2,6 +2,7 @@
 // Use of this source code is governed by the BSD 3-Clause License,
 // that can be found in the LICENSE file.
 
+#include <stdlib.h>
 #include <unistd.h>
 #include <sys/time.h>
 
@@ -18,6 +19,16 @@
 #define THREAD_NUM 1
 #define LEVEL0_FILE_NUM 4
 #define BUFFER_SIZE 2 << 20
+#define LOG_SYNC_INTERVAL_MS 10
+#define MAX_IMMUTABLE_BUFFERS 4
+#define MEMTABLE_SHARD_NUM THREAD_NUM
+#define FLUSH_THREAD_NUM 2
+#define IMMUTABLE_SLOWDOWN_TRIGGER 3
+#define LEVEL0_SLOWDOWN_TRIGGER (LEVEL0_FILE_NUM * 2)
+#define LEVEL0_STOP_TRIGGER (LEVEL0_FILE_NUM * 3)
+#define BLOOM_BITS_PER_KEY 10
+#define VALUE_LOG_THRESHOLD 512
+#define TABLE_BYTES_PER_SYNC (1 << 20)
 
 struct PerfReport
 {
@@ -37,13 +48,24 @@ int main()
 	// Initial DataBase
     EventManager event_manager;
     FileLogger file_logger("./log.txt", LogLevelInfo, true, true);
-    StorageBuffer storage_buffer(BUFFER_SIZE, &file_logger, &event_manager);
+    StorageBuffer storage_buffer(BUFFER_SIZE, &file_logger, &event_manager, MAX_IMMUTABLE_BUFFERS, MEMTABLE_SHARD_NUM);
     LRUCache cache(CACHE_NUM);
-    StorageEngine storage_engine(&file_logger, LEVEL0_FILE_NUM, &event_manager, &storage_buffer);
-
-    DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache);
-
-    data_base.Start();
+    TableOptions table_options;
+    table_options.bloom_bits_per_key = BLOOM_BITS_PER_KEY;
+    table_options.value_log_threshold = VALUE_LOG_THRESHOLD;
+    table_options.bytes_per_sync = TABLE_BYTES_PER_SYNC;
+    ValueLog value_log(&file_logger);
+    StorageEngine storage_engine(&file_logger, LEVEL0_FILE_NUM, &event_manager, &storage_buffer, table_options, &value_log);
+    WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncInterval, LOG_SYNC_INTERVAL_MS);
+    WriteController write_controller(&storage_buffer, &storage_engine, &file_logger, IMMUTABLE_SLOWDOWN_TRIGGER, LEVEL0_SLOWDOWN_TRIGGER, LEVEL0_STOP_TRIGGER);
+
+    DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log, &write_controller, FLUSH_THREAD_NUM, &value_log);
+
+    if (data_base.Start() != 0)
+    {
+        file_logger.Error("Starting the Database Failed, Benchmark Not Run.");
+        exit(1);
+    }
 
 	// Initial Thread Pool
     ThreadPool thread_pool(THREAD_NUM);
@@ -150,8 +172,6 @@ int main()
 
 		printf("Finishing Random Reads Test...\n");
 
-		int count = 0;
-		int sum = result_queue.size();
 		while (!result_queue.empty())
     	{
         	auto item = result_queue.pop();
@@ -159,6 +179,15 @@ int main()
     	}
 
 		fprintf(fd, "Key Length: %d, Value Length: %d, Test Num: %d\n", key_len, value_len[i], TEST_NUM);
+		fprintf(fd, "WriteSlowdowns: %llu, SlowdownTime: %f s, WriteStalls: %llu, StallTime: %f s\n",
+			(unsigned long long)write_controller.SlowdownCount(), write_controller.SlowdownMicros() * 1e-6,
+			(unsigned long long)write_controller.StallCount(), write_controller.StallMicros() * 1e-6);
+		fprintf(fd, "MemtableBloomHits: %llu, MemtableBloomFalsePositives: %llu\n",
+			(unsigned long long)storage_buffer.BloomHitCount(), (unsigned long long)storage_buffer.BloomFalsePositiveCount());
+		fprintf(fd, "FileBloomHits: %llu, FileBloomFalsePositives: %llu\n",
+			(unsigned long long)data_base.FileFilterHitCount(), (unsigned long long)data_base.FileFilterFalsePositiveCount());
+		fprintf(fd, "TableDataBytes: %llu, CompressedBytes: %llu, CompressionRatio: %.2f\n",
+			(unsigned long long)storage_engine.RawDataBytes(), (unsigned long long)storage_engine.DataBytes(), storage_engine.CompressionRatio());
 		fprintf(fd, "SequentialWrites: %d ops/s, CostTime: %f s, CpuOccupy: %f\nRandomWrites: %d ops/s, CostTime: %f s, CpuOccupy: %f\nSequentialReads: %d ops/s, CostTime: %f s, CpuOccupy: %f\nRandomReads: %d ops/s, CostTime: %f s, CpuOccupy: %f\n", report.SequentialWrites, cost_time[0], cpu_occupy[0], report.RandomWrites, cost_time[1], cpu_occupy[1], report.SequentialReads, cost_time[2], cpu_occupy[2], report.RandomReads, cost_time[3], cpu_occupy[3]);
 	}
 
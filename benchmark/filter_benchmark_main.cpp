@@ -0,0 +1,93 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+#include "../util/sequence_generator.h"
+#include "../structure/bloom_filter.h"
+#include "../structure/blocked_bloom_filter.h"
+#include "../structure/xor_filter.h"
+
+#define KEY_NUM 1000000
+#define PROBE_NUM 4000000
+#define KEY_LEN 25
+#define BITS_PER_KEY 10
+
+double TimeInterval(struct timeval start, struct timeval end)
+{
+	return (double)end.tv_sec - start.tv_sec + ((double)end.tv_usec - start.tv_usec) * 1e-6;
+}
+
+template<class Probe>
+void RunBenchmark(const char* name, const std::string& filter, const std::vector<uint32_t>& present, const std::vector<uint32_t>& absent, Probe probe)
+{
+	ByteArray contents(filter.data(), filter.size());
+	struct timeval start, end;
+
+	int missed = 0;
+	for (auto hash : present)
+	{
+		missed += !probe(hash, contents);
+	}
+
+	int false_positives = 0;
+	gettimeofday(&start, NULL);
+	for (int i = 0; i < PROBE_NUM; ++i)
+	{
+		false_positives += probe(absent[i % absent.size()], contents);
+	}
+
+	gettimeofday(&end, NULL);
+	double ns_per_op = TimeInterval(start, end) * 1e9 / PROBE_NUM;
+
+	printf("%-24s Filter: %8d bytes, %5.2f bits/key, Probe: %6.2f ns/op, False Positive Rate: %.4f%%, Missed: %d\n", name,
+		(int)filter.size(), filter.size() * 8.0 / present.size(), ns_per_op, 100.0 * false_positives / PROBE_NUM, missed);
+}
+
+int main()
+{
+	// Keys are hashed once, only the probes are timed.
+	std::vector<uint32_t> present, absent;
+	for (auto& item : RandomKvPairs(KEY_NUM, KEY_LEN, 0, 1))
+	{
+		present.push_back(BloomFilter::KeyHash(ByteArray(item.first.data(), item.first.size())));
+	}
+
+	for (auto& item : RandomKvPairs(KEY_NUM, KEY_LEN, 0, 2))
+	{
+		absent.push_back(BloomFilter::KeyHash(ByteArray(item.first.data(), item.first.size())));
+	}
+
+	std::string bloom, blocked_bloom, xor_filter;
+	BloomFilter(BITS_PER_KEY).CreateFilter(present, bloom);
+	BlockedBloomFilter(BITS_PER_KEY).CreateFilter(present, blocked_bloom);
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	XorFilter::CreateFilter(present, xor_filter);
+	gettimeofday(&end, NULL);
+	double xor_build_time = TimeInterval(start, end);
+
+	// Bloom filter as large as it needs to be to match the xor filter.
+	std::string bloom_same_rate;
+	BloomFilter(12).CreateFilter(present, bloom_same_rate);
+
+	printf("TEST Keys: %d, Probes: %d, Bits Per Key: %d, AVX2: %s\n", KEY_NUM, PROBE_NUM, BITS_PER_KEY,
+		BlockedBloomFilter::HasAvx2() ? "yes" : "no");
+	RunBenchmark("standard bloom", bloom, present, absent, BloomFilter::KeyMayMatch);
+	RunBenchmark("blocked bloom, scalar", blocked_bloom, present, absent, BlockedBloomFilter::KeyMayMatchScalar);
+	if (BlockedBloomFilter::HasAvx2())
+	{
+		RunBenchmark("blocked bloom, avx2", blocked_bloom, present, absent, BlockedBloomFilter::KeyMayMatchAvx2);
+	}
+
+	RunBenchmark("standard bloom, 12 bits", bloom_same_rate, present, absent, BloomFilter::KeyMayMatch);
+	RunBenchmark("xor", xor_filter, present, absent, XorFilter::KeyMayMatch);
+	printf("Xor Filter Build: %f s\n", xor_build_time);
+
+	return 0;
+}
@@ -0,0 +1,252 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+
+#include <assert.h>
+
+#include "block.h"
+#include "../util/coding.h"
+#include "../util/utils.h"
+
+BlockBuilder::BlockBuilder(int restart_interval)
+	: restart_interval_(restart_interval)
+{
+	assert(restart_interval_ >= 1);
+	Reset();
+}
+
+void BlockBuilder::Reset()
+{
+	buffer_.clear();
+	restarts_.clear();
+	restarts_.push_back(0);
+	counter_ = 0;
+	last_key_.clear();
+	finished_ = false;
+}
+
+void BlockBuilder::Add(const ByteArray& key, const ByteArray& value)
+{
+	assert(!finished_);
+	assert(buffer_.empty() || Compare(key, ByteArray(last_key_.data(), last_key_.size())) > 0);
+
+	uint32_t shared = 0;
+	if (counter_ < restart_interval_)
+	{
+		uint32_t min_size = std::min<uint32_t>(last_key_.size(), key.Size());
+		while (shared < min_size && last_key_[shared] == key.Data()[shared])
+		{
+			shared++;
+		}
+	}
+	else
+	{
+		restarts_.push_back(buffer_.size());
+		counter_ = 0;
+	}
+
+	const uint32_t non_shared = key.Size() - shared;
+
+	char buf[15];
+	char* p = EncodeVarint32(buf, shared);
+	p = EncodeVarint32(p, non_shared);
+	p = EncodeVarint32(p, value.Size());
+	buffer_.append(buf, p - buf);
+	buffer_.append(key.Data() + shared, non_shared);
+	buffer_.append(value.Data(), value.Size());
+
+	last_key_.resize(shared);
+	last_key_.append(key.Data() + shared, non_shared);
+	counter_++;
+}
+
+ByteArray BlockBuilder::Finish()
+{
+	char buf[4];
+	for (auto restart : restarts_)
+	{
+		EncodeFixed32(buf, restart);
+		buffer_.append(buf, 4);
+	}
+
+	EncodeFixed32(buf, restarts_.size());
+	buffer_.append(buf, 4);
+	finished_ = true;
+	return ByteArray(buffer_.data(), buffer_.size());
+}
+
+Block::Block(const ByteArray& contents)
+	: data_(contents.Data()),
+	  size_(contents.Size()),
+	  restart_offset_(0),
+	  num_restarts_(0)
+{
+	if (size_ < 4)
+	{
+		size_ = 0;
+		return;
+	}
+
+	GetFixed32(data_ + size_ - 4, &num_restarts_);
+	if (num_restarts_ == 0 || num_restarts_ > (size_ - 4) / 4)
+	{
+		size_ = 0;
+		num_restarts_ = 0;
+		return;
+	}
+
+	restart_offset_ = size_ - (1 + num_restarts_) * 4;
+}
+
+Block::Iterator::Iterator(const Block* block)
+	: block_(block),
+	  current_(block->restart_offset_),
+	  next_(block->restart_offset_),
+	  restart_index_(0),
+	  key_(nullptr, 0),
+	  value_(nullptr, 0)
+{
+}
+
+uint32_t Block::Iterator::RestartPoint(uint32_t index) const
+{
+	uint32_t offset;
+	GetFixed32(block_->data_ + block_->restart_offset_ + index * 4, &offset);
+	return offset;
+}
+
+void Block::Iterator::SeekToRestartPoint(uint32_t index)
+{
+	key_buf_.clear();
+	key_ = ByteArray(nullptr, 0);
+	restart_index_ = index;
+	next_ = RestartPoint(index);
+}
+
+bool Block::Iterator::ParseNextKey()
+{
+	current_ = next_;
+	const char* p = block_->data_ + current_;
+	const char* limit = block_->data_ + block_->restart_offset_;
+	if (p >= limit)
+	{
+		current_ = block_->restart_offset_;
+		return false;
+	}
+
+	uint32_t shared, non_shared, value_size;
+	if ((p = GetVarint32Ptr(p, limit, &shared)) == nullptr
+		|| (p = GetVarint32Ptr(p, limit, &non_shared)) == nullptr
+		|| (p = GetVarint32Ptr(p, limit, &value_size)) == nullptr
+		|| static_cast<uint32_t>(limit - p) < non_shared
+		|| static_cast<uint32_t>(limit - p) - non_shared < value_size
+		|| shared > key_.Size())
+	{
+		// Corrupted entry, end the iteration.
+		current_ = block_->restart_offset_;
+		return false;
+	}
+
+	if (shared == 0)
+	{
+		key_ = ByteArray(p, non_shared);
+	}
+	else
+	{
+		if (key_.Data() != key_buf_.data())
+		{
+			key_buf_.assign(key_.Data(), key_.Size());
+		}
+
+		key_buf_.resize(shared);
+		key_buf_.append(p, non_shared);
+		key_ = ByteArray(key_buf_.data(), key_buf_.size());
+	}
+
+	value_ = ByteArray(p + non_shared, value_size);
+	next_ = (p + non_shared + value_size) - block_->data_;
+
+	while (restart_index_ + 1 < block_->num_restarts_ && RestartPoint(restart_index_ + 1) <= current_)
+	{
+		++restart_index_;
+	}
+
+	return true;
+}
+
+void Block::Iterator::SeekToFirst()
+{
+	if (block_->num_restarts_ == 0)
+	{
+		return;
+	}
+
+	SeekToRestartPoint(0);
+	ParseNextKey();
+}
+
+void Block::Iterator::SeekToLast()
+{
+	if (block_->num_restarts_ == 0)
+	{
+		return;
+	}
+
+	SeekToRestartPoint(block_->num_restarts_ - 1);
+	while (ParseNextKey() && next_ < block_->restart_offset_)
+	{
+	}
+}
+
+void Block::Iterator::Next()
+{
+	assert(Valid());
+	ParseNextKey();
+}
+
+void Block::Iterator::Seek(const ByteArray& target)
+{
+	if (block_->num_restarts_ == 0)
+	{
+		return;
+	}
+
+	// Last restart point with a key smaller than target.
+	uint32_t left = 0;
+	uint32_t right = block_->num_restarts_ - 1;
+	while (left < right)
+	{
+		uint32_t mid = (left + right + 1) / 2;
+		const char* p = block_->data_ + RestartPoint(mid);
+		const char* limit = block_->data_ + block_->restart_offset_;
+		uint32_t shared, non_shared, value_size;
+		if ((p = GetVarint32Ptr(p, limit, &shared)) == nullptr
+			|| (p = GetVarint32Ptr(p, limit, &non_shared)) == nullptr
+			|| (p = GetVarint32Ptr(p, limit, &value_size)) == nullptr
+			|| shared != 0 || static_cast<uint32_t>(limit - p) < non_shared)
+		{
+			current_ = block_->restart_offset_;
+			return;
+		}
+
+		if (Compare(ByteArray(p, non_shared), target) < 0)
+		{
+			left = mid;
+		}
+		else
+		{
+			right = mid - 1;
+		}
+	}
+
+	SeekToRestartPoint(left);
+	while (ParseNextKey())
+	{
+		if (Compare(key_, target) >= 0)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,130 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef BLOCK_H_
+#define BLOCK_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "../type/byte_array.h"
+
+// Block layout
+// ------------
+//
+// Entry: varint32 shared | varint32 non_shared | varint32 value_size |
+//        key[shared..] | value
+//
+// shared is the number of bytes the key has in common with the key of the
+// previous entry. Every restart_interval entries a restart point stores its
+// key in full (shared == 0), the block ends with the offsets of the restart
+// points so a lookup binary searches them and then scans forward:
+//
+//   entries | fixed32 restarts[num_restarts] | fixed32 num_restarts
+
+class BlockBuilder
+{
+private:
+	int restart_interval_;
+	std::string buffer_;
+	std::vector<uint32_t> restarts_;
+	// Entries since the last restart point.
+	int counter_;
+	std::string last_key_;
+	bool finished_;
+
+public:
+	explicit BlockBuilder(int restart_interval = 1);
+
+	void Reset();
+
+	// REQUIRES: key is larger than the keys added since Reset().
+	void Add(const ByteArray& key, const ByteArray& value);
+
+	// Append the restart points, the result is valid until Reset().
+	ByteArray Finish();
+
+	// Size of the block if it were finished now.
+	uint32_t CurrentSizeEstimate() const
+	{
+		return buffer_.size() + restarts_.size() * 4 + 4;
+	}
+
+	bool Empty() const
+	{
+		return buffer_.empty();
+	}
+
+	const std::string& LastKey() const
+	{
+		return last_key_;
+	}
+};
+
+// Read-only view of a block, usually in a mmap'd table file.
+class Block
+{
+private:
+	const char* data_;
+	uint32_t size_;
+	uint32_t restart_offset_;
+	uint32_t num_restarts_;
+
+public:
+	// Malformed contents leave an empty block.
+	explicit Block(const ByteArray& contents);
+
+	class Iterator
+	{
+	private:
+		const Block* block_;
+		// Offset of the current entry, restart_offset_ when not Valid().
+		uint32_t current_;
+		uint32_t next_;
+		uint32_t restart_index_;
+		// Keys sharing a prefix are assembled here, full keys point into
+		// the block.
+		std::string key_buf_;
+		ByteArray key_;
+		ByteArray value_;
+
+		uint32_t RestartPoint(uint32_t index) const;
+
+		void SeekToRestartPoint(uint32_t index);
+
+		// Decode the entry at next_. Return false at the end of the block.
+		bool ParseNextKey();
+
+	public:
+		explicit Iterator(const Block* block);
+
+		bool Valid() const
+		{
+			return current_ < block_->restart_offset_;
+		}
+
+		ByteArray key() const
+		{
+			return key_;
+		}
+
+		ByteArray value() const
+		{
+			return value_;
+		}
+
+		void SeekToFirst();
+
+		void SeekToLast();
+
+		void Next();
+
+		// Position at the first key that is not smaller than target.
+		void Seek(const ByteArray& target);
+	};
+};
+
+#endif  // BLOCK_H_
@@ -2,25 +2,303 @@
 // Use of this source code is governed by the BSD 3-Clause License,
 // that can be found in the LICENSE file.
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <queue>
+
 #include <unistd.h>
 
 #include "data_base.h"
 #include "../type/constant.h"
+#include "../util/utils.h"
 
-void DataBase::Start()
+int DataBase::Start()
 {
-	thread_flush_ = std::thread(&DataBase::ProcessingLoopFlushBuffer, this);
+	if (storage_engine_->HasError())
+	{
+		log_->Error("Storage Engine Failed to Open, Database Not Started.");
+		printf("Storage Engine Failed to Open, Database Not Started.\n");
+		return -1;
+	}
+
+	if (value_log_ != nullptr && value_log_->Open() != 0)
+	{
+		log_->Error("Opening the Value Log Failed, Database Not Started.");
+		printf("Opening the Value Log Failed, Database Not Started.\n");
+		return -1;
+	}
+
+	if (write_ahead_log_ != nullptr)
+	{
+		if (Recover() != 0)
+		{
+			log_->Error("Recovering from the Log Failed, Database Not Started.");
+			printf("Recovering from the Log Failed, Database Not Started.\n");
+			return -1;
+		}
+
+		write_ahead_log_->Open();
+		storage_buffer_->SetWriteAheadLog(write_ahead_log_);
+	}
+
+	for (int i = 0; i < flush_threads_num_; ++i)
+	{
+		threads_flush_.push_back(std::thread(&DataBase::ProcessingLoopFlushBuffer, this));
+	}
+
 	thread_compact_ = std::thread(&DataBase::ProcessingLoopCompact, this);
 	log_->Info("Database Starts Successfully.");
 	printf("Database Starts Successfully.\n");
+	return 0;
+}
+
+int DataBase::Recover()
+{
+	std::vector<uint64_t> segments = write_ahead_log_->Segments();
+	if (segments.empty())
+	{
+		return 0;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	// Every segment gets its own arena and table, so the replay threads never
+	// share anything but the read-only segment list.
+	int segments_num = segments.size();
+	Comparator cmp;
+	std::vector<Memory*> memories(segments_num);
+	std::vector<SkipList<const char*, Comparator>*> tables(segments_num);
+	for (int i = 0; i < segments_num; ++i)
+	{
+		memories[i] = new Memory();
+		tables[i] = new SkipList<const char*, Comparator>(cmp, memories[i]);
+	}
+
+	std::vector<std::vector<RangeTombstone>> range_tombstones(segments_num);
+	std::vector<int> statuses(segments_num, 0);
+
+	int threads_num = std::min<int>(segments_num, std::max(1u, std::thread::hardware_concurrency()));
+	std::vector<std::thread> threads;
+	for (int i = 0; i < threads_num; ++i)
+	{
+		threads.push_back(std::thread(&DataBase::ReplayLogSegments, this, std::ref(segments), std::ref(tables), std::ref(memories), std::ref(range_tombstones), std::ref(statuses), i, threads_num));
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	// The entries of a segment that cannot be read exist nowhere else, the
+	// whole log stays for another try.
+	if (std::count(statuses.begin(), statuses.end(), -1) > 0)
+	{
+		log_->Error("Reading the Log Failed, Keeping All %d Log Segments.", segments_num);
+		for (int i = 0; i < segments_num; ++i)
+		{
+			delete tables[i];
+			delete memories[i];
+		}
+
+		return -1;
+	}
+
+	// The log is replayed up to its first torn or corrupted record, the
+	// records after it may depend on the ones lost.
+	int replay_num = std::find(statuses.begin(), statuses.end(), 1) - statuses.begin();
+	if (replay_num < segments_num - 1)
+	{
+		log_->Error("Log Segment %llu Has a Bad Record, Dropping the %d Segments after It.", (unsigned long long)segments[replay_num], segments_num - replay_num - 1);
+	}
+
+	replay_num = std::min(replay_num + 1, segments_num);
+
+	// The entries a tombstone deletes in its own segment are dropped by the
+	// replay, it still deletes the keys of the older segments.
+	auto range_deleted = [&range_tombstones, replay_num](int segment, const ByteArray& key)
+	{
+		for (int i = segment + 1; i < replay_num; ++i)
+		{
+			for (auto& tombstone : range_tombstones[i])
+			{
+				if (tombstone.Covers(key))
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	};
+
+	// Merge the tables, the entry of the latest segment wins for equal keys.
+	std::vector<SkipList<const char*, Comparator>::Iterator> its;
+	for (int i = 0; i < replay_num; ++i)
+	{
+		its.push_back(SkipList<const char*, Comparator>::Iterator(tables[i]));
+		its.back().SeekToFirst();
+	}
+
+	auto greater = [&its, &cmp](int a, int b)
+	{
+		int r = cmp(its[a].key(), its[b].key());
+		return r > 0 || (r == 0 && a < b);
+	};
+
+	std::priority_queue<int, std::vector<int>, decltype(greater)> pq(greater);
+	for (int i = 0; i < replay_num; ++i)
+	{
+		if (its[i].Valid())
+		{
+			pq.push(i);
+		}
+	}
+
+	std::vector<ByteArray> content;
+	const char* prev = nullptr;
+	while (!pq.empty())
+	{
+		int i = pq.top();
+		pq.pop();
+
+		const char* entry = its[i].key();
+		if (prev == nullptr || cmp(prev, entry) != 0)
+		{
+			if (!range_deleted(i, ExtractUserKey(entry)))
+			{
+				content.push_back(ByteArray(entry, EntrySize(entry)));
+			}
+
+			prev = entry;
+		}
+
+		its[i].Next();
+		if (its[i].Valid())
+		{
+			pq.push(i);
+		}
+	}
+
+	// The entries left are newer than the tombstones covering them, which
+	// still delete the keys of the older files.
+	range_tombstones.resize(replay_num);
+	int range_tombstones_num = 0;
+	for (auto& segment_tombstones : range_tombstones)
+	{
+		range_tombstones_num += segment_tombstones.size();
+	}
+
+	int status = 0;
+	if (!content.empty() || range_tombstones_num > 0)
+	{
+		int file_id;
+		std::string file_name;
+		TableBuilder* builder = storage_engine_->NewTableBuilder(storage_engine_->NewWritableFile(file_id, file_name));
+		for (auto& entry : content)
+		{
+			builder->Add(ExtractUserKey(entry), ExtractUserValue(entry), ExtractValueType(entry));
+		}
+
+		for (auto& segment_tombstones : range_tombstones)
+		{
+			for (auto& tombstone : segment_tombstones)
+			{
+				builder->AddRangeDeletion(tombstone);
+			}
+		}
+
+		status = builder->Finish();
+		if (status == 0)
+		{
+			storage_engine_->AddTableStats(builder);
+		}
+
+		delete builder;
+		if (status == 0)
+		{
+			status = storage_engine_->AddFile(file_name);
+		}
+		else
+		{
+			// The log is all there is of the entries, leave it for the next start.
+			log_->Error("Writing Recovered File \"%s\" Failed.", file_name.c_str());
+			remove((Constant::DataFolder + "/" + file_name).c_str());
+		}
+	}
+
+	if (status == 0)
+	{
+		write_ahead_log_->RemoveSegmentsBefore(segments.back() + 1);
+	}
+
+	for (int i = 0; i < segments_num; ++i)
+	{
+		delete tables[i];
+		delete memories[i];
+	}
+
+	if (status != 0)
+	{
+		return status;
+	}
+
+	double cost_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	log_->Info("Recovered %d Entries and %d Range Tombstones from %d Log Segments with %d Threads in %.3f ms.", (int)content.size(), range_tombstones_num, replay_num, threads_num, cost_ms);
+	return 0;
+}
+
+void DataBase::ReplayLogSegments(std::vector<uint64_t>& segments, std::vector<SkipList<const char*, Comparator>*>& tables, std::vector<Memory*>& memories, std::vector<std::vector<RangeTombstone>>& range_tombstones, std::vector<int>& statuses, int begin, int step)
+{
+	for (size_t i = begin; i < segments.size(); i += step)
+	{
+		std::vector<const char*> entries;
+		statuses[i] = write_ahead_log_->ReadSegment(segments[i], memories[i], entries);
+		if (statuses[i] < 0)
+		{
+			continue;
+		}
+
+		// Walking the log backwards, an entry is deleted by the tombstones
+		// seen so far, which were logged after it.
+		std::vector<const char*> live_entries;
+		for (auto it = entries.rbegin(); it != entries.rend(); ++it)
+		{
+			const char* entry = *it;
+			if (ExtractValueType(entry) == TypeRangeDeletion)
+			{
+				range_tombstones[i].emplace_back(ExtractUserKey(entry), ExtractUserValue(entry));
+				continue;
+			}
+
+			bool deleted = false;
+			for (auto& tombstone : range_tombstones[i])
+			{
+				if (tombstone.Covers(ExtractUserKey(entry)))
+				{
+					deleted = true;
+					break;
+				}
+			}
+
+			if (!deleted)
+			{
+				live_entries.push_back(entry);
+			}
+		}
+
+		// Inserting in log order keeps the latest entry of a key.
+		for (auto it = live_entries.rbegin(); it != live_entries.rend(); ++it)
+		{
+			tables[i]->Insert(*it);
+		}
+	}
 }
 
 void DataBase::ProcessingLoopFlushBuffer()
 {
 	while (!is_stop_)
 	{
-		storage_buffer_->SetFlushThreadIdle();
-
 		while (!storage_buffer_->FlushBufferReady() && !is_stop_)
 		{
 			event_manager_->event_flush_buffer_.Wait();
@@ -28,23 +306,114 @@ void DataBase::ProcessingLoopFlushBuffer()
 
 		if (is_stop_)
 		{
+			// Pass the wake up on to the other workers.
+			event_manager_->event_flush_buffer_.Notify();
 			break;
 		}
 
+		std::unique_lock<std::mutex> lock(flush_mutex_);
+		MemTable* flush_buffer = storage_buffer_->PickFlushBuffer();
+		if (flush_buffer == nullptr)
+		{
+			// Another worker took it.
+			continue;
+		}
+
 		int file_id;
 		std::string file_name;
-		auto stream = storage_engine_->NewWritableFile(file_id, file_name);
+		WritableFile* file = storage_engine_->NewWritableFile(file_id, file_name);
+		uint64_t sequence = flush_sequence_++;
+		lock.unlock();
+
+		if (storage_buffer_->FlushBufferReady())
+		{
+			event_manager_->event_flush_buffer_.Notify();
+		}
+
+		// A failed flush is retried under the same file id, so the file keeps
+		// its place among the level 0 files. Meanwhile the buffer stays in the
+		// queue and writers are held back once it is full.
+		int status = FlushBufferToFile(flush_buffer, file, file_name);
+		while (status != 0 && !is_stop_ && !storage_engine_->HasError())
+		{
+			log_->Error("Flushing File \"%s\" Failed, Retrying.", file_name.c_str());
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			status = FlushBufferToFile(flush_buffer, storage_engine_->OpenWritableFile(file_name), file_name);
+		}
 
-		std::unordered_map<std::string, uint32_t> key_offset;
+		lock.lock();
+		while (install_sequence_ != sequence)
+		{
+			flush_cv_.wait(lock);
+		}
+
+		// Add the file before dropping the buffer, so a Get always finds the entries in one of them.
+		if (status == 0 && storage_engine_->AddFile(file_name) == 0)
+		{
+			uint64_t flush_log_number = flush_buffer->LogNumber();
+			storage_buffer_->ClearFlushBuffer(flush_buffer);
+
+			// The segments of a buffer never flushed are older than the
+			// ones of the buffers after it.
+			if (write_ahead_log_ != nullptr && !keep_log_segments_)
+			{
+				write_ahead_log_->RemoveSegmentsBefore(flush_log_number);
+			}
+		}
+		else
+		{
+			log_->Error("Giving up Flushing File \"%s\", Its Entries Stay in the Log.", file_name.c_str());
+			keep_log_segments_ = true;
+		}
 
-		storage_buffer_->FlushBuffer(stream, key_offset);
+		++install_sequence_;
+		flush_cv_.notify_all();
+		lock.unlock();
+
+		SignalWriters();
+	}
+}
+
+void DataBase::SignalWriters()
+{
+	// No flush or compaction drains the backlog any more, the writers are
+	// let go to fail.
+	if (storage_engine_->HasError())
+	{
+		storage_buffer_->Stop();
+	}
+
+	if (write_controller_ == nullptr)
+	{
+		return;
+	}
 
-		storage_buffer_->ClearFlushBuffer();
+	if (storage_engine_->HasError())
+	{
+		write_controller_->Stop();
+	}
+	else
+	{
+		write_controller_->Signal();
+	}
+}
 
-		cache_->Set(file_id, key_offset);	
+int DataBase::FlushBufferToFile(MemTable* flush_buffer, WritableFile* file, const std::string& file_name)
+{
+	TableBuilder* builder = storage_engine_->NewTableBuilder(file);
+	int status = storage_buffer_->FlushBuffer(flush_buffer, builder);
+	if (status == 0)
+	{
+		storage_engine_->AddTableStats(builder);
+	}
 
-		storage_engine_->AddFile(file_name);
+	delete builder;
+	if (status != 0)
+	{
+		remove((Constant::DataFolder + "/" + file_name).c_str());
 	}
+
+	return status;
 }
 
 void DataBase::ProcessingLoopCompact()
@@ -58,29 +427,185 @@ void DataBase::ProcessingLoopCompact()
 			break;
 		}
 
-		storage_engine_->Compact(0);
+		storage_engine_->CompactLevels();
+
+		// Compaction reports the garbage of the value log.
+		if (value_log_ != nullptr)
+		{
+			while (CollectValueLogGarbage() != 0)
+			{
+			}
+		}
+
+		SignalWriters();
 	}
 }
 
 void DataBase::ShutDown()
 {
+	if (write_controller_ != nullptr)
+	{
+		write_controller_->Stop();
+		log_->Info("Write Controller: %llu Writes Delayed for %llu us, %llu Writes Stalled for %llu us.",
+			(unsigned long long)write_controller_->SlowdownCount(), (unsigned long long)write_controller_->SlowdownMicros(),
+			(unsigned long long)write_controller_->StallCount(), (unsigned long long)write_controller_->StallMicros());
+	}
+
+	log_->Info("Memtable Bloom Filters: %llu Lookups Skipped, %llu False Positives.",
+		(unsigned long long)storage_buffer_->BloomHitCount(), (unsigned long long)storage_buffer_->BloomFalsePositiveCount());
+	log_->Info("File Bloom Filters: %llu Lookups Skipped, %llu False Positives.",
+		(unsigned long long)FileFilterHitCount(), (unsigned long long)FileFilterFalsePositiveCount());
+	log_->Info("Table Data: %llu Bytes Compressed to %llu, Ratio %.2f.",
+		(unsigned long long)storage_engine_->RawDataBytes(), (unsigned long long)storage_engine_->DataBytes(), storage_engine_->CompressionRatio());
+	if (value_log_ != nullptr)
+	{
+		log_->Info("Value Log: %d Files, %llu Bytes.", value_log_->FilesNumber(), (unsigned long long)value_log_->TotalSize());
+	}
+
 	is_stop_ = true;
+	storage_buffer_->Stop();
 	event_manager_->event_flush_buffer_.Notify();
 	event_manager_->event_compact_.Notify();
-	thread_flush_.join();
-	thread_compact_.join();
+	for (auto& thread : threads_flush_)
+	{
+		thread.join();
+	}
+
+	threads_flush_.clear();
+	if (thread_compact_.joinable())
+	{
+		thread_compact_.join();
+	}
+
+	if (write_ahead_log_ != nullptr)
+	{
+		write_ahead_log_->Close();
+	}
 }
 
-void DataBase::Add(OrderType order_type, std::string& key, std::string& value)
+int DataBase::Add(OrderType order_type, std::string& key, std::string& value)
 {
 	log_->Info("%s Key: %s, Value: %s", OrderTypeString[order_type], key.c_str(), value.c_str());
+	ValueType type = TypeValue;
 	if (order_type == Delete)
 	{
-		order_type = Put;
-		value = Constant::TombValue;
+		type = TypeDeletion;
+		value.clear();
+	}
+
+	if (write_controller_ != nullptr)
+	{
+		write_controller_->Throttle();
+	}
+
+	if (storage_engine_->HasError())
+	{
+		log_->Error("Rejecting %s Key: %s after a Manifest Failure", OrderTypeString[order_type], key.c_str());
+		return -1;
+	}
+
+	std::function<void()> apply = [&]()
+	{
+		storage_buffer_->Add(order_type, ByteArray(key.c_str(), key.size()), ByteArray(value.c_str(), value.size()));
+	};
+
+	// The leader of the log group applies the records in log order.
+	if (write_ahead_log_ != nullptr)
+	{
+		std::string record;
+		AppendEntry(record, ByteArray(key.c_str(), key.size()), ByteArray(value.c_str(), value.size()), type);
+		if (write_ahead_log_->AddRecord(ByteArray(record.data(), record.size()), apply) != 0)
+		{
+			log_->Error("Logging %s Key: %s Failed", OrderTypeString[order_type], key.c_str());
+			return -1;
+		}
+
+		return 0;
+	}
+
+	apply();
+	return 0;
+}
+
+int DataBase::DeleteRange(std::string& begin, std::string& end)
+{
+	log_->Info("DeleteRange Begin: %s, End: %s", begin.c_str(), end.c_str());
+	if (begin >= end)
+	{
+		return 0;
+	}
+
+	if (write_controller_ != nullptr)
+	{
+		write_controller_->Throttle();
+	}
+
+	if (storage_engine_->HasError())
+	{
+		log_->Error("Rejecting DeleteRange Begin: %s after a Manifest Failure", begin.c_str());
+		return -1;
+	}
+
+	std::function<void()> apply = [&]()
+	{
+		storage_buffer_->AddRangeDeletion(ByteArray(begin.c_str(), begin.size()), ByteArray(end.c_str(), end.size()));
+	};
+
+	if (write_ahead_log_ != nullptr)
+	{
+		std::string record;
+		AppendEntry(record, ByteArray(begin.c_str(), begin.size()), ByteArray(end.c_str(), end.size()), TypeRangeDeletion);
+		if (write_ahead_log_->AddRecord(ByteArray(record.data(), record.size()), apply) != 0)
+		{
+			log_->Error("Logging DeleteRange Begin: %s Failed", begin.c_str());
+			return -1;
+		}
+
+		return 0;
+	}
+
+	apply();
+	return 0;
+}
+
+int DataBase::Write(const WriteBatch& batch)
+{
+	if (batch.Count() == 0)
+	{
+		return 0;
+	}
+
+	log_->Info("Write Batch of %d Entries", batch.Count());
+
+	if (write_controller_ != nullptr)
+	{
+		write_controller_->Throttle();
+	}
+
+	if (storage_engine_->HasError())
+	{
+		log_->Error("Rejecting Batch of %d Entries after a Manifest Failure", batch.Count());
+		return -1;
+	}
+
+	std::function<void()> apply = [&]()
+	{
+		storage_buffer_->AddBatch(batch);
+	};
+
+	if (write_ahead_log_ != nullptr)
+	{
+		if (write_ahead_log_->AddRecord(batch.Data(), apply) != 0)
+		{
+			log_->Error("Logging Batch of %d Entries Failed", batch.Count());
+			return -1;
+		}
+
+		return 0;
 	}
-	
-	storage_buffer_->Add(order_type, ByteArray(key.c_str(), key.size()), ByteArray(value.c_str(), value.size()));
+
+	apply();
+	return 0;
 }
 
 int DataBase::Get(std::string& key, std::string& value_out)
@@ -91,25 +616,104 @@ int DataBase::Get(std::string& key, std::string& value_out)
 		return status;
 	}
 
-	if ((status = storage_buffer_->Get(key, value_out)) == 0)
+	// A deletion hides the older entries of the key.
+	ValueType type = TypeValue;
+	if ((status = storage_buffer_->Get(key, value_out, &type)) == 0)
 	{
-		return status;
+		return type == TypeDeletion ? -1 : 0;
+	}
+
+	// Neither the files of the version nor the value log file of a pointer
+	// are deleted before the read-side section is over.
+	int epoch;
+	Version* version = storage_engine_->BeginRead(epoch);
+	status = GetFromFiles(version, key, value_out, type);
+	if (status == 0 && type == TypeDeletion)
+	{
+		status = -1;
+	}
+	else if (status == 0 && type == TypeValuePointer)
+	{
+		ValuePointer pointer;
+		if (value_log_ == nullptr || !pointer.DecodeFrom(ByteArray(value_out.data(), value_out.size())))
+		{
+			log_->Error("Reading Separated Value of Key %s without Value Log.", key.c_str());
+			status = -1;
+		}
+		else
+		{
+			status = value_log_->Get(pointer, value_out);
+		}
 	}
 
+	storage_engine_->EndRead(epoch);
+	return status;
+}
+
+int DataBase::GetFromFiles(Version* version, std::string& key, std::string& value_out, ValueType& type)
+{
+	int status = -1;
 	std::vector<std::vector<File*>> contains_files;
-	storage_engine_->ReadLock();
-	storage_engine_->GetContainsFiles(key, contains_files);
-	uint32_t offset = 0;
+	version->GetContainsFiles(key, contains_files);
+	uint64_t offset = 0;
 	for (auto& vec : contains_files)
 	{
 		for (auto& file : vec)
 		{
+			if (file->Corrupted())
+			{
+				log_->Error("Corrupted File \"%s\".", file->FileName().c_str());
+				return -1;
+			}
+
+			if (file->Reader() != nullptr)
+			{
+				// Table files are searched in place, nothing to cache.
+				ByteArray user_key(key.data(), key.size());
+				if (!file->Reader()->KeyMayMatch(user_key))
+				{
+					file_filter_hit_count_.fetch_add(1, std::memory_order_relaxed);
+				}
+				else
+				{
+					status = file->Reader()->Get(user_key, value_out, storage_engine_->VerifyChecksums(), &type);
+					if (status == 0)
+					{
+						return 0;
+					}
+
+					if (status == -2)
+					{
+						// Older files may hold a stale value, do not fall through to them.
+						log_->Error("Corrupted Block in File \"%s\".", file->FileName().c_str());
+						return -1;
+					}
+
+					file_filter_false_positive_count_.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				// The entries of the file are newer than its tombstones,
+				// which only delete the key from the older files.
+				if (file->Reader()->RangeDeleted(user_key))
+				{
+					type = TypeDeletion;
+					return 0;
+				}
+
+				continue;
+			}
+
 			bool if_exists = false;
 			offset = cache_->Get(file->FileId(), key, if_exists);
 			if (!if_exists)
 			{
-				std::unordered_map<std::string, uint32_t> key_offset;
-				storage_engine_->LoadKeyOffset(file->FileId(), key_offset);
+				std::unordered_map<std::string, uint64_t> key_offset;
+				if (storage_engine_->LoadKeyOffset(file, key_offset) != 0)
+				{
+					log_->Error("Corrupted Index in File \"%s\".", file->FileName().c_str());
+					return -1;
+				}
+
 				if (key_offset.find(key) != key_offset.end())
 				{
 					offset = key_offset[key];
@@ -120,18 +724,116 @@ int DataBase::Get(std::string& key, std::string& value_out)
 
 			if (offset != 0)
 			{
-				storage_engine_->GetValueByOffset(file->FileId(), offset, value_out);
-				status = 0;
-				storage_engine_->ReadUnlock();
-				return status;
+				if (storage_engine_->GetValueByOffset(file, offset, value_out) != 0)
+				{
+					log_->Error("Corrupted Entry in File \"%s\".", file->FileName().c_str());
+					return -1;
+				}
+
+				type = LegacyValueType(ByteArray(value_out.data(), value_out.size()));
+				return 0;
 			}
 		}
 	}
 
-	storage_engine_->ReadUnlock();
 	return status;
 }
 
+uint64_t DataBase::CollectValueLogGarbage()
+{
+	if (storage_engine_->HasError())
+	{
+		return 0;
+	}
+
+	uint64_t number = value_log_->PickGarbageFile();
+	if (number == 0)
+	{
+		return 0;
+	}
+
+	// Take the file id before checking any entry. A key written after its
+	// check is flushed to a file with a larger id, which overrides the
+	// pointer written here.
+	int file_id;
+	std::string file_name;
+	WritableFile* file = storage_engine_->NewWritableFile(file_id, file_name);
+	std::string file_path = Constant::DataFolder + "/" + file_name;
+
+	std::string buf;
+	std::vector<ValueLog::Record> records;
+	if (value_log_->ReadFile(number, buf, records) != 0)
+	{
+		delete file;
+		remove(file_path.c_str());
+		return 0;
+	}
+
+	// A record is live if the newest entry of its key still points to it.
+	std::vector<ValueLog::Record> live_records;
+	for (auto& record : records)
+	{
+		std::string key(record.key_.Data(), record.key_.Size());
+		std::string value_out;
+		if (storage_buffer_->Get(key, value_out) == 0)
+		{
+			continue;
+		}
+
+		ValueType type = TypeValue;
+		ValuePointer pointer;
+		int epoch;
+		int status = GetFromFiles(storage_engine_->BeginRead(epoch), key, value_out, type);
+		storage_engine_->EndRead(epoch);
+		if (status == 0 && type == TypeValuePointer && pointer.DecodeFrom(ByteArray(value_out.data(), value_out.size()))
+			&& pointer == record.pointer_)
+		{
+			live_records.push_back(record);
+		}
+	}
+
+	std::sort(live_records.begin(), live_records.end(),
+		[](const ValueLog::Record& a, const ValueLog::Record& b) { return Compare(a.key_, b.key_) < 0; });
+
+	if (live_records.empty())
+	{
+		delete file;
+		remove(file_path.c_str());
+	}
+	else
+	{
+		TableBuilder* builder = storage_engine_->NewTableBuilder(file);
+		for (auto& record : live_records)
+		{
+			builder->Add(record.key_, record.value_);
+		}
+
+		int status = builder->Finish();
+		storage_engine_->AddTableStats(builder);
+		delete builder;
+		if (status != 0)
+		{
+			log_->Error("Writing Value Log Garbage Collection File \"%s\" Failed.", file_name.c_str());
+			remove(file_path.c_str());
+			return 0;
+		}
+
+		// The value log file holds the only live copy until the file is added.
+		if (storage_engine_->AddFile(file_name) != 0)
+		{
+			return 0;
+		}
+	}
+
+	// Lookups stay in their read-side section until they have read the value
+	// they point to.
+	storage_engine_->WaitForReaders();
+	value_log_->RemoveFile(number);
+
+	log_->Info("Value Log File %llu Collected, %d of %d Records Live.", (unsigned long long)number, (int)live_records.size(), (int)records.size());
+	return number;
+}
+
 void DataBase::ClearCache()
 {
 	cache_->Clear();
@@ -5,44 +5,118 @@
 #ifndef DATA_BASE_H_
 #define DATA_BASE_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include "event_manager.h"
 #include "storage_buffer.h"
 #include "storage_engine.h"
+#include "value_log.h"
+#include "write_ahead_log.h"
+#include "write_controller.h"
 #include "../util/logger.h"
 #include "../structure/cache.h"
 
 class DataBase
 {
 private:
-	bool is_stop_ = false;
-	std::thread thread_flush_;
+	std::atomic<bool> is_stop_{false};
+	std::vector<std::thread> threads_flush_;
 	std::thread thread_compact_;
 
 	EventManager* event_manager_;
 	StorageBuffer* storage_buffer_;
-	StorageEngine* storage_engine_;
 	Logger* log_;
+	StorageEngine* storage_engine_;
 	LRUCache* cache_;
+	// Optional, records are only kept in memory until flushed without it.
+	WriteAheadLog* write_ahead_log_;
+	// Optional, writers are never held back without it.
+	WriteController* write_controller_;
+	// Optional, values are only separated from the tables with it.
+	ValueLog* value_log_;
+
+	int flush_threads_num_;
+	// Flush workers pick a buffer and its file id together under flush_mutex_,
+	// then install their files one after another in the same order, so a
+	// newer buffer always ends up in a newer level 0 file.
+	std::mutex flush_mutex_;
+	std::condition_variable flush_cv_;
+	uint64_t flush_sequence_ = 0;
+	uint64_t install_sequence_ = 0;
+	// A buffer was given up on shutdown, no log segment is removed any more.
+	// REQUIRES: flush_mutex_ held.
+	bool keep_log_segments_ = false;
+
+	// Table files ruled out by their filter block, and files that passed the
+	// filter without holding the key.
+	std::atomic<uint64_t> file_filter_hit_count_{0};
+	std::atomic<uint64_t> file_filter_false_positive_count_{0};
+
+	// Write flush_buffer to file, a new data file named file_name, and remove
+	// the file if that fails. Return 0 on success.
+	int FlushBufferToFile(MemTable* flush_buffer, WritableFile* file, const std::string& file_name);
+
+	// Wake the writers stalled by the write controller, and release them and
+	// the ones waiting for the buffer queue for good once the storage engine
+	// is in the error state.
+	void SignalWriters();
+
+	// Rebuild the records left in the log, up to its first bad record, into a
+	// level-0 file. The log is only removed once the file is added. Return 0
+	// on success.
+	int Recover();
+	// Replay segments[begin], segments[begin + step], ... into their own
+	// tables, and their range tombstones into range_tombstones. The status of
+	// reading each segment goes to statuses.
+	void ReplayLogSegments(std::vector<uint64_t>& segments, std::vector<SkipList<const char*, Comparator>*>& tables, std::vector<Memory*>& memories, std::vector<std::vector<RangeTombstone>>& range_tombstones, std::vector<int>& statuses, int begin, int step);
+	// Return 0 and the newest entry of key in the files of version, its value
+	// is a ValuePointer if type is TypeValuePointer.
+	// REQUIRES: version pinned, by a read-side section or a reference.
+	int GetFromFiles(Version* version, std::string& key, std::string& value_out, ValueType& type);
 
 public:
-	DataBase(EventManager* event_manager, StorageBuffer* storage_buffer, StorageEngine* storage_engine, Logger* logger, LRUCache* cache) : event_manager_(event_manager), storage_buffer_(storage_buffer), log_(logger), storage_engine_(storage_engine), cache_(cache) { }
+	DataBase(EventManager* event_manager, StorageBuffer* storage_buffer, StorageEngine* storage_engine, Logger* logger, LRUCache* cache, WriteAheadLog* write_ahead_log = nullptr, WriteController* write_controller = nullptr, int flush_threads_num = 1, ValueLog* value_log = nullptr) : event_manager_(event_manager), storage_buffer_(storage_buffer), log_(logger), storage_engine_(storage_engine), cache_(cache), write_ahead_log_(write_ahead_log), write_controller_(write_controller), value_log_(value_log), flush_threads_num_(flush_threads_num) { }
 	~DataBase() { }
-	// Backend thread doing flushing work
+	// Backend threads doing flushing work
 	void ProcessingLoopFlushBuffer();
 	// Backend thread doing compaction work
 	void ProcessingLoopCompact();
-	// Put/Delete Opeartion
-	void Add(OrderType order_type, std::string& key, std::string& value);
+	// Put/Delete Opeartion. Return 0 on success, -1 if the write is not logged.
+	int Add(OrderType order_type, std::string& key, std::string& value);
+	// Delete every key from begin up to end, excluded. Nothing is deleted if
+	// end is not larger than begin. Return 0 on success.
+	int DeleteRange(std::string& begin, std::string& end);
+	// Apply all the operations of batch, logged as one record. Return 0 on success.
+	int Write(const WriteBatch& batch);
 	// Get Operation
 	int Get(std::string& key, std::string& value_out);
-	// DataBase Start
-	void Start();
+	// DataBase Start, return 0 on success and -1 if the storage engine failed
+	// to open or the log cannot be recovered
+	int Start();
 	// DataBase ShutDown
 	void ShutDown();
 	// Clear LRU Cache, containing Key-Offset tables
 	void ClearCache();
+	// Collect the value log file with the most garbage, if it has enough:
+	// append its live values again, write their new pointers to a level 0
+	// file and delete it. Return its number, 0 if none was collected.
+	// Runs on the compaction thread, so no compaction moves the pointers
+	// being checked.
+	uint64_t CollectValueLogGarbage();
+
+	uint64_t FileFilterHitCount()
+	{
+		return file_filter_hit_count_.load(std::memory_order_relaxed);
+	}
+
+	uint64_t FileFilterFalsePositiveCount()
+	{
+		return file_filter_false_positive_count_.load(std::memory_order_relaxed);
+	}
 };
 
 #endif  // DATA_BASE_H_
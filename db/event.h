@@ -9,6 +9,7 @@
 #include <mutex>
 #include <condition_variable>
 
+// Auto-reset event, a Notify with nobody waiting is kept for the next Wait.
 class Event
 {
 public:
@@ -17,17 +18,21 @@ public:
 	void Wait()
 	{
 		std::unique_lock<std::mutex> lock(mutex_);
-		cv_.wait(lock);
+		cv_.wait(lock, [this]() { return signaled_; });
+		signaled_ = false;
 	}
 
 	void Notify()
 	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		signaled_ = true;
 		cv_.notify_one();
 	}
 
 private:
 	std::mutex mutex_;
 	std::condition_variable cv_;
+	bool signaled_ = false;
 };
 
 #endif  // EVENT_H_
@@ -5,6 +5,8 @@
 #ifndef FILE_H_
 #define FILE_H_
 
+#include <atomic>
+#include <mutex>
 #include <string>
 
 #include <stdint.h>
@@ -13,25 +15,47 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 
+#include "manifest.h"
+#include "table_reader.h"
 #include "../type/constant.h"
 #include "../util/coding.h"
 
+// A table file of the storage engine. Files listed by the manifest are only
+// mapped once something reads them, their bounds and counts come from the
+// manifest.
 class File
 {
 private:
 	int level_id_;
 	int file_id_;
-	uint32_t file_size_;
+	uint64_t file_size_;
 	std::string file_name_;
 
 	std::string lower_bound_;
 	std::string upper_bound_;
 
-	const char* mmap_;
+	uint64_t num_entries_ = 0;
+	uint64_t num_deletions_ = 0;
 
-	uint32_t GetFileSize(const char* file_path)
+	const char* mmap_ = nullptr;
+
+	// Reader of files in the table format, nullptr for legacy files.
+	TableReader* table_ = nullptr;
+
+	// The file cannot be mapped, or is in neither the table nor the legacy
+	// format. It is never read.
+	bool corrupted_ = false;
+
+	std::once_flag opened_;
+
+	// Held by the versions listing the file.
+	std::atomic<int> refs_{0};
+	// Replaced by a compaction, removed from disk with the last reference.
+	std::atomic<bool> obsolete_{false};
+
+	uint64_t GetFileSize(const char* file_path)
 	{
-		uint32_t file_size = -1;
+		uint64_t file_size = -1;
 		struct stat statbuff;
 		if (!(stat(file_path, &statbuff) < 0))
 		{
@@ -41,6 +65,40 @@ private:
 		return file_size;
 	}
 
+	void Open()
+	{
+		std::call_once(opened_, [this]
+		{
+			auto fd = open(FilePath().c_str(), O_RDONLY);
+			void* addr = fd < 0 ? MAP_FAILED : mmap(0, file_size_, PROT_READ, MAP_SHARED, fd, 0);
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+
+			if (addr == MAP_FAILED)
+			{
+				printf("Mapping file \"%s\" failed\n", file_name_.c_str());
+				corrupted_ = true;
+				return;
+			}
+
+			mmap_ = static_cast<const char*>(addr);
+			table_ = TableReader::Open(mmap_, file_size_);
+
+			// A table whose footer does not decode is not taken for a legacy
+			// file unless it is laid out like one.
+			if (table_ == nullptr && !IsLegacyTable(mmap_, file_size_))
+			{
+				printf("File \"%s\" is corrupted\n", file_name_.c_str());
+				corrupted_ = true;
+			}
+		});
+	}
+
+	File(const File&) = delete;
+	void operator=(const File&) = delete;
+
 public:
 	std::string FilePath()
 	{
@@ -70,17 +128,47 @@ public:
 
 		level_id_ = stoi(file_name.substr(0, pos));
 		file_id_ = stoi(file_name.substr(pos + 1));
+		file_name_ = file_name;
 		
-		std::string file_path = FilePath(file_name);
-		file_size_ = GetFileSize(file_path.c_str());
+		file_size_ = GetFileSize(FilePath().c_str());
 		if (file_size_ < 0)
 		{
 			printf("Acquire file size failed");
 		}
 
-		auto fd = open(file_path.c_str(), O_RDONLY);
-		mmap_ = static_cast<const char*>(mmap(0, file_size_, PROT_READ, MAP_SHARED, fd, 0));
-		close(fd);
+		Open();
+		if (table_ != nullptr)
+		{
+			lower_bound_ = table_->FirstKey();
+			upper_bound_ = table_->LastKey();
+			num_entries_ = table_->Properties().num_entries_;
+			num_deletions_ = table_->Properties().num_deletions_ + table_->RangeDeletions().size();
+
+			// Lookups and compactions of the keys a tombstone deletes must
+			// find the file, even if it holds nothing but tombstones.
+			bool empty = table_->Empty();
+			for (auto& tombstone : table_->RangeDeletions())
+			{
+				if (empty || tombstone.begin_ < lower_bound_)
+				{
+					lower_bound_ = tombstone.begin_;
+				}
+
+				if (empty || tombstone.end_ > upper_bound_)
+				{
+					upper_bound_ = tombstone.end_;
+				}
+
+				empty = false;
+			}
+
+			return;
+		}
+
+		if (corrupted_)
+		{
+			return;
+		}
 
 		char* p = const_cast<char*>(mmap_);
 		uint32_t key_size;
@@ -93,13 +181,27 @@ public:
 		len = GetVarint32(p, 5, &key_size);
 		p += len;
 		upper_bound_ = std::string(p, key_size);
+	}
 
-		file_name_ = file_name;
+	explicit File(const FileMeta& meta)
+		: level_id_(meta.level_id_),
+		  file_id_(meta.file_id_),
+		  file_size_(meta.file_size_),
+		  file_name_(meta.file_name_),
+		  lower_bound_(meta.lower_bound_),
+		  upper_bound_(meta.upper_bound_),
+		  num_entries_(meta.num_entries_),
+		  num_deletions_(meta.num_deletions_)
+	{
 	}
 
 	~File()
 	{
-		munmap((void*)mmap_, file_size_);
+		delete table_;
+		if (mmap_ != nullptr)
+		{
+			munmap((void*)mmap_, file_size_);
+		}
 	}
 
 	int Delete()
@@ -107,6 +209,31 @@ public:
 		return remove(FilePath(file_name_).c_str());		
 	}
 
+	void Ref()
+	{
+		refs_.fetch_add(1);
+	}
+
+	// Delete the file with the last reference, and remove it from disk if it
+	// is obsolete.
+	void Unref()
+	{
+		if (refs_.fetch_sub(1) == 1)
+		{
+			if (obsolete_.load())
+			{
+				Delete();
+			}
+
+			delete this;
+		}
+	}
+
+	void MarkObsolete()
+	{
+		obsolete_.store(true);
+	}
+
 	int LevelId() const
 	{
 		return level_id_;
@@ -129,13 +256,76 @@ public:
 
 	const char* MMap()
 	{
+		Open();
 		return mmap_;
 	}
 
-	uint32_t FileSize()
+	uint64_t FileSize()
 	{
 		return file_size_;
 	}
+
+	// What the manifest keeps of the file, at level_id.
+	FileMeta Meta(int level_id) const
+	{
+		FileMeta meta;
+		meta.file_name_ = file_name_;
+		meta.level_id_ = level_id;
+		meta.file_id_ = file_id_;
+		meta.file_size_ = file_size_;
+		meta.lower_bound_ = lower_bound_;
+		meta.upper_bound_ = upper_bound_;
+		meta.num_entries_ = num_entries_;
+		meta.num_deletions_ = num_deletions_;
+		return meta;
+	}
+
+	FileMeta Meta() const
+	{
+		return Meta(level_id_);
+	}
+
+	// Point and range deletions per entry of the file, which compaction
+	// would reclaim. 0 if the file does not count its entries.
+	double DeletionRatio() const
+	{
+		if (num_deletions_ == 0)
+		{
+			return 0;
+		}
+
+		return num_entries_ == 0 ? 1.0 : (double)num_deletions_ / num_entries_;
+	}
+
+	// nullptr if the file is in the legacy format or corrupted.
+	TableReader* Reader()
+	{
+		Open();
+		return table_;
+	}
+
+	bool Corrupted()
+	{
+		Open();
+		return corrupted_;
+	}
+
+	// Iterate the entries in key order, whatever the format of the file.
+	TableIterator* NewIterator()
+	{
+		Open();
+		if (table_ != nullptr)
+		{
+			return table_->NewIterator();
+		}
+
+		if (corrupted_)
+		{
+			return new CorruptedTableIterator();
+		}
+
+		return new LegacyTableIterator(mmap_, file_size_);
+	}
 };
 
 #endif  // FILE_H_
@@ -0,0 +1,198 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include "format.h"
+#include "../util/coding.h"
+#include "../util/utils.h"
+
+void BlockHandle::EncodeTo(std::string& dst, uint32_t version) const
+{
+	char buf[kMaxEncodedLength];
+	char* p = buf;
+	if (version == 1)
+	{
+		EncodeFixed32(p, offset_);
+		EncodeFixed32(p + 4, size_);
+		p += 8;
+	}
+	else
+	{
+		p = EncodeVarint64(p, offset_);
+		p = EncodeVarint64(p, size_);
+	}
+
+	dst.append(buf, p - buf);
+}
+
+const char* BlockHandle::DecodeFrom(const char* p, const char* limit, uint32_t version)
+{
+	if (version != 1)
+	{
+		if ((p = GetVarint64Ptr(p, limit, &offset_)) == nullptr)
+		{
+			return nullptr;
+		}
+
+		return GetVarint64Ptr(p, limit, &size_);
+	}
+
+	if (limit - p < 8)
+	{
+		return nullptr;
+	}
+
+	uint32_t offset, size;
+	GetFixed32(p, &offset);
+	GetFixed32(p + 4, &size);
+	offset_ = offset;
+	size_ = size;
+	return p + 8;
+}
+
+namespace
+{
+
+// Handles in the footer take a fixed size, so it can be found from the end.
+void EncodeFooterHandle(const BlockHandle& handle, uint32_t version, std::string& dst)
+{
+	char buf[16];
+	if (version == 1)
+	{
+		EncodeFixed32(buf, handle.offset_);
+		EncodeFixed32(buf + 4, handle.size_);
+		dst.append(buf, 8);
+	}
+	else
+	{
+		EncodeFixed64(buf, handle.offset_);
+		EncodeFixed64(buf + 8, handle.size_);
+		dst.append(buf, 16);
+	}
+}
+
+const char* DecodeFooterHandle(const char* p, uint32_t version, BlockHandle& handle)
+{
+	if (version == 1)
+	{
+		return handle.DecodeFrom(p, p + 8, version);
+	}
+
+	GetFixed64(p, &handle.offset_);
+	GetFixed64(p + 8, &handle.size_);
+	return p + 16;
+}
+
+}  // namespace
+
+void Footer::EncodeTo(std::string& dst) const
+{
+	EncodeFooterHandle(metaindex_handle_, version_, dst);
+	EncodeFooterHandle(index_handle_, version_, dst);
+
+	char buf[12];
+	EncodeFixed32(buf, version_);
+	EncodeFixed64(buf + 4, kTableMagicNumber);
+	dst.append(buf, sizeof(buf));
+}
+
+int Footer::DecodeFrom(const char* data, uint64_t size)
+{
+	if (size < 12)
+	{
+		return -1;
+	}
+
+	const char* limit = data + size;
+	uint64_t magic;
+	GetFixed64(limit - 8, &magic);
+	if (magic != kTableMagicNumber)
+	{
+		return -1;
+	}
+
+	GetFixed32(limit - 12, &version_);
+	if ((version_ != 1 && version_ != kTableFormatVersion) || size < EncodedLength(version_))
+	{
+		return -1;
+	}
+
+	const char* p = limit - EncodedLength(version_);
+	p = DecodeFooterHandle(p, version_, metaindex_handle_);
+	p = DecodeFooterHandle(p, version_, index_handle_);
+
+	// Every block must lie before the footer.
+	uint64_t blocks_end = size - EncodedLength(version_);
+	if (metaindex_handle_.offset_ > blocks_end || metaindex_handle_.size_ > blocks_end - metaindex_handle_.offset_
+		|| index_handle_.offset_ > blocks_end || index_handle_.size_ > blocks_end - index_handle_.offset_)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+void TableProperties::EncodeTo(std::string& dst) const
+{
+	char buf[20];
+	char* p = EncodeVarint64(buf, num_entries_);
+	p = EncodeVarint64(p, num_deletions_);
+	dst.append(buf, p - buf);
+}
+
+bool TableProperties::DecodeFrom(const ByteArray& contents)
+{
+	const char* p = contents.Data();
+	const char* limit = p + contents.Size();
+	if ((p = GetVarint64Ptr(p, limit, &num_entries_)) == nullptr || GetVarint64Ptr(p, limit, &num_deletions_) == nullptr)
+	{
+		num_entries_ = num_deletions_ = 0;
+		return false;
+	}
+
+	return true;
+}
+
+bool RangeTombstone::Covers(const ByteArray& key) const
+{
+	return Compare(ByteArray(begin_.data(), begin_.size()), key) <= 0 && Compare(key, ByteArray(end_.data(), end_.size())) < 0;
+}
+
+void EncodeRangeTombstones(const std::vector<RangeTombstone>& tombstones, std::string& dst)
+{
+	char buf[5];
+	for (auto& tombstone : tombstones)
+	{
+		dst.append(buf, EncodeVarint32(buf, tombstone.begin_.size()) - buf);
+		dst.append(tombstone.begin_);
+		dst.append(buf, EncodeVarint32(buf, tombstone.end_.size()) - buf);
+		dst.append(tombstone.end_);
+	}
+}
+
+bool DecodeRangeTombstones(const ByteArray& contents, std::vector<RangeTombstone>& tombstones)
+{
+	const char* p = contents.Data();
+	const char* limit = p + contents.Size();
+	while (p < limit)
+	{
+		uint32_t begin_size, end_size;
+		const char* begin;
+		if ((p = GetVarint32Ptr(p, limit, &begin_size)) == nullptr || static_cast<uint32_t>(limit - p) < begin_size)
+		{
+			return false;
+		}
+
+		begin = p;
+		p += begin_size;
+		if ((p = GetVarint32Ptr(p, limit, &end_size)) == nullptr || static_cast<uint32_t>(limit - p) < end_size)
+		{
+			return false;
+		}
+
+		tombstones.emplace_back(ByteArray(begin, begin_size), ByteArray(p, end_size));
+		p += end_size;
+	}
+
+	return true;
+}
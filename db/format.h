@@ -0,0 +1,222 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef FORMAT_H_
+#define FORMAT_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../type/byte_array.h"
+#include "../type/constant.h"
+#include "../type/value_type.h"
+#include "../util/compression.h"
+
+// Table file format
+// -----------------
+//
+//   [data block 1]
+//   ...
+//   [data block N]
+//   [metaindex block]
+//   [index block]
+//   [footer]
+//
+// Data blocks hold the entries in key order and are cut once they reach
+// TableOptions::block_size. Keys are stored as deltas to the previous key
+// with a full key every TableOptions::block_restart_interval entries. The
+// index block maps a separator of every data block, a short key between its
+// last key and the first key of the next block, to its handle, and the
+// metaindex block maps the names of optional meta blocks to their handles.
+// See block.h for the block layout. The value of every data block entry
+// starts with its ValueType, a deleted key has nothing after it.
+//
+// Every block is followed by a trailer: the CompressionType of its contents,
+// see util/compression.h, and the masked CRC-32C of the contents and the
+// type, see util/crc32c.h. The handle covers the contents only. Only data
+// blocks are compressed, and only when that saves 1/8 at least.
+//
+//   block trailer: uint8 type | fixed32 masked crc
+//
+// Meta blocks, raw bytes rather than blocks, followed by the fixed32 masked
+// CRC-32C of the bytes:
+//   "filter.bloom":         bloom filter of all the keys in the file, see
+//                           structure/bloom_filter.h.
+//   "filter.blocked_bloom": cache line blocked bloom filter of all the keys,
+//                           see structure/blocked_bloom_filter.h. Starts at
+//                           a multiple of 64 bytes in the file.
+//   "filter.xor":           xor filter of all the keys, see
+//                           structure/xor_filter.h.
+//   "properties":           entry counts, see TableProperties.
+//   "range_del":            range tombstones, see RangeTombstone.
+//
+// Block handles are varint64 offset | varint64 size, except in the footer:
+//
+//   footer: fixed64 metaindex offset | fixed64 metaindex size |
+//           fixed64 index offset | fixed64 index size |
+//           fixed32 version | fixed64 magic
+//
+// Version 1 stores every handle as fixed32 offset | fixed32 size, so the
+// footer is 16 bytes shorter. Its blocks have no trailer, its values no type,
+// and deletions are values equal to Constant::TombValue. The version and the
+// magic are always the last 12 bytes, and tell how to decode the rest.
+//
+// Files written before this format, "header | entries | hash ordered index"
+// as written by StorageBuffer::Flush, do not end with the magic and are
+// still read through the legacy path.
+//
+// Range tombstones delete the keys of the older files, never the entries of
+// their own file: whatever was deleted along with a range before the file was
+// written is dropped instead, the entries that are left were written after
+// it. Readers without the block see no tombstones, so it takes no version.
+
+// Current version of the table format. Files of version 1 are still read,
+// the versions in between were never released and are not.
+enum { kTableFormatVersion = 6 };
+
+enum { kBlockTrailerSize = 5 };
+
+const uint64_t kTableMagicNumber = 0x5ca1ab1e7ab1e001ull;
+
+const char* const kBloomFilterBlockName = "filter.bloom";
+const char* const kBlockedBloomFilterBlockName = "filter.blocked_bloom";
+const char* const kXorFilterBlockName = "filter.xor";
+const char* const kPropertiesBlockName = "properties";
+const char* const kRangeDeletionBlockName = "range_del";
+
+// Type of a value of a legacy or version 1 file, which stored deletions as
+// values equal to Constant::TombValue.
+inline ValueType LegacyValueType(const ByteArray& value)
+{
+	const std::string& tomb = Constant::TombValue;
+	return value.Size() == tomb.size() && memcmp(value.Data(), tomb.data(), tomb.size()) == 0 ? TypeDeletion : TypeValue;
+}
+
+// Counts of the entries of a file, zero for files written without them.
+//
+// Properties block: varint64 num_entries | varint64 num_deletions
+struct TableProperties
+{
+	uint64_t num_entries_ = 0;
+	// Entries of type TypeDeletion, included in num_entries_.
+	uint64_t num_deletions_ = 0;
+
+	void EncodeTo(std::string& dst) const;
+
+	// Return false if contents is malformed.
+	bool DecodeFrom(const ByteArray& contents);
+};
+
+// Deletion of the keys from begin_ up to end_, excluded.
+//
+// Range deletion block: (varint32 size | begin | varint32 size | end)*
+struct RangeTombstone
+{
+	std::string begin_;
+	std::string end_;
+
+	RangeTombstone() { }
+
+	RangeTombstone(const ByteArray& begin, const ByteArray& end)
+		: begin_(begin.Data(), begin.Size()), end_(end.Data(), end.Size()) { }
+
+	bool Covers(const ByteArray& key) const;
+
+	// Return true if every key from first to last, both included, is covered.
+	bool Covers(const std::string& first, const std::string& last) const
+	{
+		return begin_ <= first && last < end_;
+	}
+};
+
+void EncodeRangeTombstones(const std::vector<RangeTombstone>& tombstones, std::string& dst);
+
+// Return false if contents is malformed.
+bool DecodeRangeTombstones(const ByteArray& contents, std::vector<RangeTombstone>& tombstones);
+
+// Filter written in the filter block of a table.
+enum FilterType
+{
+	FilterNone = 0,
+	FilterBloom = 1,		// Probes spread over the whole filter.
+	FilterBlockedBloom = 2,	// Probes of a key within one cache line.
+	FilterXor = 3,			// Static, smaller than a bloom filter.
+};
+
+// Options of the table files written by flush and compaction.
+struct TableOptions
+{
+	// Data blocks are cut at the first entry reaching this size.
+	uint32_t block_size = 4096;
+	// Keys stored in full every this many entries of a data block, the ones
+	// in between only store what differs from the previous key. A lookup
+	// binary searches the full keys and then scans at most this many.
+	int block_restart_interval = 16;
+	FilterType filter_type = FilterBlockedBloom;
+	// Filter of the files compacted into the deepest level, which hold most
+	// of the keys and are rewritten least often.
+	FilterType last_level_filter_type = FilterXor;
+	// Bits of the bloom filters per key, no filter block is written if 0.
+	// Xor filters always take about 9.84 bits per key.
+	int bloom_bits_per_key = 10;
+	// Codec of the data blocks of the file being written.
+	CompressionType compression = NoCompression;
+	// Codec of the files of every level, the last entry applies to the levels
+	// past the end. Files of the first levels are rewritten soon, compressing
+	// them would mostly cost CPU.
+	std::vector<CompressionType> compression_per_level = { NoCompression, NoCompression, LzCompression };
+	// Stronger codec of the deepest level, unless it is not compressed at all.
+	CompressionType last_level_compression = LzHighCompression;
+	// Verify the checksum of every block read by a lookup. Compaction always
+	// verifies what it reads, so a corrupted block is never rewritten with a
+	// valid checksum. Turning this off only takes the cost off the Get path.
+	bool verify_checksums = true;
+	// Values of at least this many bytes go to the value log and the table
+	// keeps a pointer to them, so compaction does not rewrite them. 0 keeps
+	// every value in the tables, as does a builder without a value log.
+	uint32_t value_log_threshold = 0;
+	// Start the writeback of a table file every this many bytes while it is
+	// being written, 0 leaves it all to the page cache until the file is done.
+	uint64_t bytes_per_sync = 0;
+};
+
+// Location of a block in a table file.
+struct BlockHandle
+{
+	uint64_t offset_ = 0;
+	uint64_t size_ = 0;
+
+	enum { kMaxEncodedLength = 10 + 10 };
+
+	// Encode the handle the way files of the given version store them in
+	// index blocks.
+	void EncodeTo(std::string& dst, uint32_t version = kTableFormatVersion) const;
+
+	// Return the byte after the handle, or nullptr if it does not fit.
+	const char* DecodeFrom(const char* p, const char* limit, uint32_t version = kTableFormatVersion);
+};
+
+struct Footer
+{
+	BlockHandle metaindex_handle_;
+	BlockHandle index_handle_;
+	uint32_t version_ = kTableFormatVersion;
+
+	// Size of the footer of files of the given version.
+	static uint32_t EncodedLength(uint32_t version)
+	{
+		return (version == 1 ? 4 * 4 : 4 * 8) + 4 + 8;
+	}
+
+	void EncodeTo(std::string& dst) const;
+
+	// Decode the footer at the end of a file of size bytes. Return -1 if the
+	// file is not in the table format.
+	int DecodeFrom(const char* data, uint64_t size);
+};
+
+#endif  // FORMAT_H_
@@ -0,0 +1,470 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "manifest.h"
+#include "../util/coding.h"
+#include "../util/crc32c.h"
+#include "../util/utils.h"
+
+namespace {
+
+const char* kManifestPrefix = "MANIFEST-";
+
+void PutLengthPrefixed(std::string& dst, const std::string& value)
+{
+	char buf[5];
+	dst.append(buf, EncodeVarint32(buf, value.size()) - buf);
+	dst.append(value);
+}
+
+const char* GetLengthPrefixed(const char* p, const char* limit, std::string& value)
+{
+	uint32_t size;
+	if ((p = GetVarint32Ptr(p, limit, &size)) == nullptr || static_cast<uint32_t>(limit - p) < size)
+	{
+		return nullptr;
+	}
+
+	value.assign(p, size);
+	return p + size;
+}
+
+int ReadWholeFile(const std::string& path, std::string& contents)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	contents.clear();
+	char buf[1 << 16];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) != 0)
+	{
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			close(fd);
+			return -1;
+		}
+
+		contents.append(buf, n);
+	}
+
+	close(fd);
+	return 0;
+}
+
+}  // namespace
+
+void FileMeta::EncodeTo(std::string& dst) const
+{
+	char buf[5 + 5 + 10];
+	PutLengthPrefixed(dst, file_name_);
+	char* p = EncodeVarint32(buf, level_id_);
+	p = EncodeVarint32(p, file_id_);
+	p = EncodeVarint64(p, file_size_);
+	dst.append(buf, p - buf);
+	PutLengthPrefixed(dst, lower_bound_);
+	PutLengthPrefixed(dst, upper_bound_);
+	p = EncodeVarint64(buf, num_entries_);
+	p = EncodeVarint64(p, num_deletions_);
+	dst.append(buf, p - buf);
+}
+
+const char* FileMeta::DecodeFrom(const char* p, const char* limit)
+{
+	uint32_t level_id, file_id;
+	if ((p = GetLengthPrefixed(p, limit, file_name_)) == nullptr
+		|| (p = GetVarint32Ptr(p, limit, &level_id)) == nullptr
+		|| (p = GetVarint32Ptr(p, limit, &file_id)) == nullptr
+		|| (p = GetVarint64Ptr(p, limit, &file_size_)) == nullptr
+		|| (p = GetLengthPrefixed(p, limit, lower_bound_)) == nullptr
+		|| (p = GetLengthPrefixed(p, limit, upper_bound_)) == nullptr
+		|| (p = GetVarint64Ptr(p, limit, &num_entries_)) == nullptr)
+	{
+		return nullptr;
+	}
+
+	level_id_ = level_id;
+	file_id_ = file_id;
+	return GetVarint64Ptr(p, limit, &num_deletions_);
+}
+
+void VersionEdit::EncodeTo(std::string& dst) const
+{
+	char buf[5];
+	dst.append(buf, EncodeVarint32(buf, last_file_id_ + 1) - buf);
+	dst.append(buf, EncodeVarint32(buf, deleted_files_.size()) - buf);
+	for (auto file_id : deleted_files_)
+	{
+		dst.append(buf, EncodeVarint32(buf, file_id) - buf);
+	}
+
+	dst.append(buf, EncodeVarint32(buf, added_files_.size()) - buf);
+	for (auto& file : added_files_)
+	{
+		file.EncodeTo(dst);
+	}
+}
+
+bool VersionEdit::DecodeFrom(const ByteArray& input)
+{
+	const char* p = input.Data();
+	const char* limit = p + input.Size();
+	uint32_t value, num;
+	if ((p = GetVarint32Ptr(p, limit, &value)) == nullptr)
+	{
+		return false;
+	}
+
+	last_file_id_ = static_cast<int>(value) - 1;
+	if ((p = GetVarint32Ptr(p, limit, &num)) == nullptr)
+	{
+		return false;
+	}
+
+	deleted_files_.clear();
+	for (uint32_t i = 0; i < num; ++i)
+	{
+		if ((p = GetVarint32Ptr(p, limit, &value)) == nullptr)
+		{
+			return false;
+		}
+
+		deleted_files_.push_back(value);
+	}
+
+	if ((p = GetVarint32Ptr(p, limit, &num)) == nullptr)
+	{
+		return false;
+	}
+
+	added_files_.clear();
+	for (uint32_t i = 0; i < num; ++i)
+	{
+		FileMeta file;
+		if ((p = file.DecodeFrom(p, limit)) == nullptr)
+		{
+			return false;
+		}
+
+		added_files_.push_back(file);
+	}
+
+	return p == limit;
+}
+
+Manifest::Manifest(const std::string& folder, Logger* log, int snapshot_interval)
+	: folder_(folder),
+	  log_(log),
+	  snapshot_interval_(snapshot_interval)
+{
+}
+
+Manifest::~Manifest()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	delete file_;
+}
+
+std::string Manifest::ManifestPath(uint64_t number)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%s%06llu", kManifestPrefix, (unsigned long long)number);
+	return folder_ + "/" + name;
+}
+
+int Manifest::Recover()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	std::string current;
+	if (ReadWholeFile(folder_ + "/CURRENT", current) != 0)
+	{
+		return -1;
+	}
+
+	if (!current.empty() && current.back() == '\n')
+	{
+		current.pop_back();
+	}
+
+	char* end = nullptr;
+	size_t prefix_size = strlen(kManifestPrefix);
+	uint64_t number = 0;
+	if (current.compare(0, prefix_size, kManifestPrefix) == 0)
+	{
+		number = strtoull(current.c_str() + prefix_size, &end, 10);
+	}
+
+	std::string contents;
+	if (end == nullptr || *end != '\0' || ReadWholeFile(ManifestPath(number), contents) != 0)
+	{
+		log_->Error("Reading Manifest \"%s\" Named by CURRENT Failed.", current.c_str());
+		return -2;
+	}
+
+	files_.clear();
+	last_file_id_ = -1;
+	int records_num = 0;
+	const char* p = contents.data();
+	const char* limit = p + contents.size();
+	while (p < limit)
+	{
+		uint32_t masked_crc, size;
+		VersionEdit edit;
+		if (limit - p < 8)
+		{
+			log_->Warn("Dropping Torn Record at Offset %llu of Manifest %llu.", (unsigned long long)(p - contents.data()), (unsigned long long)number);
+			break;
+		}
+
+		GetFixed32(p, &masked_crc);
+		GetFixed32(p + 4, &size);
+		if (static_cast<uint64_t>(limit - p - 8) < size)
+		{
+			log_->Warn("Dropping Torn Record at Offset %llu of Manifest %llu.", (unsigned long long)(p - contents.data()), (unsigned long long)number);
+			break;
+		}
+
+		// Only the last record can be left half written by a crash. A bad one
+		// before others means the files they add and remove are unknown.
+		if (Crc32cUnmask(masked_crc) != Crc32cValue(p + 8, size) || !edit.DecodeFrom(ByteArray(p + 8, size)))
+		{
+			if (p + 8 + size < limit)
+			{
+				log_->Error("Corrupted Record at Offset %llu of Manifest %llu.", (unsigned long long)(p - contents.data()), (unsigned long long)number);
+				files_.clear();
+				last_file_id_ = -1;
+				return -2;
+			}
+
+			log_->Warn("Dropping Torn Record at Offset %llu of Manifest %llu.", (unsigned long long)(p - contents.data()), (unsigned long long)number);
+			break;
+		}
+
+		Apply(edit);
+		++records_num;
+		p += 8 + size;
+	}
+
+	manifest_number_ = number;
+	log_->Info("Recovered %d Files from %d Records of Manifest %llu.", (int)files_.size(), records_num, (unsigned long long)number);
+	return 0;
+}
+
+int Manifest::Open(const VersionEdit& edit)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	Apply(edit);
+	if (WriteSnapshot() != 0)
+	{
+		return -1;
+	}
+
+	RemoveObsoleteManifests();
+	return 0;
+}
+
+int Manifest::LogAndApply(const VersionEdit& edit)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (file_ == nullptr)
+	{
+		return -1;
+	}
+
+	if (AppendRecord(file_, edit) != 0 || file_->Sync() != 0)
+	{
+		// The snapshot holds the edit too, and replaces the broken manifest.
+		log_->Error("Writing Manifest %llu Failed, Starting a New One.", (unsigned long long)manifest_number_);
+		std::map<int, FileMeta> files = files_;
+		int last_file_id = last_file_id_;
+		Apply(edit);
+		if (WriteSnapshot() != 0)
+		{
+			files_.swap(files);
+			last_file_id_ = last_file_id;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	Apply(edit);
+
+	// The edit is logged already, a failed snapshot is tried again with the next edit.
+	if (++edits_since_snapshot_ >= snapshot_interval_ && WriteSnapshot() != 0)
+	{
+		log_->Error("Writing the Snapshot of Manifest %llu Failed.", (unsigned long long)manifest_number_);
+	}
+
+	return 0;
+}
+
+std::vector<FileMeta> Manifest::Files()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	std::vector<FileMeta> files;
+	for (auto& item : files_)
+	{
+		files.push_back(item.second);
+	}
+
+	return files;
+}
+
+int Manifest::LastFileId()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	return last_file_id_;
+}
+
+uint64_t Manifest::ManifestNumber()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	return manifest_number_;
+}
+
+void Manifest::Apply(const VersionEdit& edit)
+{
+	for (auto file_id : edit.deleted_files_)
+	{
+		files_.erase(file_id);
+	}
+
+	for (auto& file : edit.added_files_)
+	{
+		files_[file.file_id_] = file;
+		last_file_id_ = std::max(last_file_id_, file.file_id_);
+	}
+
+	last_file_id_ = std::max(last_file_id_, edit.last_file_id_);
+}
+
+int Manifest::AppendRecord(WritableFile* file, const VersionEdit& edit)
+{
+	std::string record(8, '\0');
+	edit.EncodeTo(record);
+	EncodeFixed32(&record[0], Crc32cMask(Crc32cValue(record.data() + 8, record.size() - 8)));
+	EncodeFixed32(&record[4], record.size() - 8);
+	return file->Append(record.data(), record.size());
+}
+
+int Manifest::WriteSnapshot()
+{
+	uint64_t number = manifest_number_ + 1;
+	std::string path = ManifestPath(number);
+	WritableFile* file = WritableFile::Open(path);
+	if (file == nullptr)
+	{
+		log_->Error("Creating Manifest %llu Failed: %s", (unsigned long long)number, strerror(errno));
+		return -1;
+	}
+
+	VersionEdit snapshot;
+	snapshot.last_file_id_ = last_file_id_;
+	for (auto& item : files_)
+	{
+		snapshot.added_files_.push_back(item.second);
+	}
+
+	if (AppendRecord(file, snapshot) != 0 || file->Sync() != 0)
+	{
+		log_->Error("Writing Manifest %llu Failed.", (unsigned long long)number);
+		delete file;
+		remove(path.c_str());
+		return -1;
+	}
+
+	// CURRENT names either manifest whenever a crash comes.
+	char contents[32];
+	int size = snprintf(contents, sizeof(contents), "%s%06llu\n", kManifestPrefix, (unsigned long long)number);
+	std::string temp_path = folder_ + "/CURRENT.tmp";
+	WritableFile* current = WritableFile::Open(temp_path);
+	if (current == nullptr || current->Append(contents, size) != 0 || current->Sync() != 0 || current->Close() != 0
+		|| rename(temp_path.c_str(), (folder_ + "/CURRENT").c_str()) != 0)
+	{
+		log_->Error("Switching CURRENT to Manifest %llu Failed.", (unsigned long long)number);
+		delete current;
+		remove(temp_path.c_str());
+		delete file;
+		remove(path.c_str());
+		return -1;
+	}
+
+	delete current;
+
+	// CURRENT names the new manifest now, so it is used either way. Until the
+	// rename is synced a crash may bring back the old CURRENT, which keeps the
+	// old manifest on disk.
+	int status = SyncFolder(folder_);
+	if (status != 0)
+	{
+		log_->Error("Syncing the Folder for Manifest %llu Failed.", (unsigned long long)number);
+	}
+
+	if (file_ != nullptr)
+	{
+		delete file_;
+		if (status == 0)
+		{
+			remove(ManifestPath(manifest_number_).c_str());
+		}
+	}
+
+	file_ = file;
+	manifest_number_ = number;
+	edits_since_snapshot_ = 0;
+	if (status != 0)
+	{
+		return -1;
+	}
+
+	log_->Info("Manifest %llu Started with %d Files.", (unsigned long long)number, (int)files_.size());
+	return 0;
+}
+
+void Manifest::RemoveObsoleteManifests()
+{
+	DIR* dir;
+	struct dirent* ptr;
+	if ((dir = opendir(folder_.c_str())) == NULL)
+	{
+		return;
+	}
+
+	size_t prefix_size = strlen(kManifestPrefix);
+	while ((ptr = readdir(dir)) != NULL)
+	{
+		char* end = nullptr;
+		if (strncmp(ptr->d_name, kManifestPrefix, prefix_size) != 0
+			|| strtoull(ptr->d_name + prefix_size, &end, 10) == manifest_number_)
+		{
+			continue;
+		}
+
+		if (remove((folder_ + "/" + ptr->d_name).c_str()) == 0)
+		{
+			log_->Info("Obsolete Manifest \"%s\" Removed.", ptr->d_name);
+		}
+	}
+
+	closedir(dir);
+}
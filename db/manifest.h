@@ -0,0 +1,127 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef MANIFEST_H_
+#define MANIFEST_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "writable_file.h"
+#include "../type/byte_array.h"
+#include "../util/logger.h"
+
+// What the storage engine needs to know of a table file without opening it.
+struct FileMeta
+{
+	std::string file_name_;
+	int level_id_ = 0;
+	int file_id_ = 0;
+	uint64_t file_size_ = 0;
+	std::string lower_bound_;
+	std::string upper_bound_;
+	uint64_t num_entries_ = 0;
+	// Point deletions and range tombstones.
+	uint64_t num_deletions_ = 0;
+
+	// varint32 size | file_name | varint32 level_id | varint32 file_id |
+	// varint64 file_size | varint32 size | lower_bound | varint32 size |
+	// upper_bound | varint64 num_entries | varint64 num_deletions
+	void EncodeTo(std::string& dst) const;
+
+	// Decode one file from p, return the position past it or nullptr if
+	// limit comes first.
+	const char* DecodeFrom(const char* p, const char* limit);
+};
+
+// Change from one set of files to the next one.
+struct VersionEdit
+{
+	std::vector<FileMeta> added_files_;
+	// File ids.
+	std::vector<int> deleted_files_;
+	// Largest file id handed out so far, -1 if unknown.
+	int last_file_id_ = -1;
+
+	// varint32 last_file_id + 1 | varint32 num_deleted | varint32 file_id ... |
+	// varint32 num_added | FileMeta ...
+	void EncodeTo(std::string& dst) const;
+
+	// Return false if input is not exactly one edit.
+	bool DecodeFrom(const ByteArray& input);
+};
+
+// Log of the files of every level, so the storage engine starts by reading
+// one file instead of opening every table, and moving a file to another level
+// only takes a record.
+//
+// Every change is appended to the current MANIFEST-%06llu file as an edit and
+// synced before it is applied. A manifest starts with a snapshot edit holding
+// all the files, so only the current one is needed, and a new one is started
+// on Open() and after snapshot_interval edits. The file named by CURRENT is
+// the current manifest, CURRENT is replaced by a rename once the new manifest
+// is synced.
+//
+// Record format: fixed32 masked crc | fixed32 size | edit
+// The crc covers the edit. Replaying stops at the first record that is torn
+// or does not match its crc, which is where a crash left the log.
+class Manifest
+{
+private:
+	std::string folder_;
+	Logger* log_;
+	int snapshot_interval_;
+
+	std::mutex mutex_;
+	WritableFile* file_ = nullptr;
+	uint64_t manifest_number_ = 0;
+	int edits_since_snapshot_ = 0;
+
+	std::map<int, FileMeta> files_;
+	int last_file_id_ = -1;
+
+	std::string ManifestPath(uint64_t number);
+
+	void Apply(const VersionEdit& edit);
+
+	int AppendRecord(WritableFile* file, const VersionEdit& edit);
+
+	// Write the files to a new manifest and point CURRENT to it. Return -1 on
+	// failure, also when the switch may not survive a crash.
+	// REQUIRES: mutex_ held.
+	int WriteSnapshot();
+
+	// Remove every manifest but the current one.
+	void RemoveObsoleteManifests();
+
+public:
+	Manifest(const std::string& folder, Logger* log, int snapshot_interval = 1024);
+
+	~Manifest();
+
+	// Load the files of the manifest CURRENT names. Return 0 on success, -1
+	// if there is no CURRENT and -2 if its manifest cannot be read or has a
+	// corrupted record before the last one.
+	int Recover();
+
+	// Apply edit to the recovered files, start a new manifest with them and
+	// make it current. Return 0 on success.
+	int Open(const VersionEdit& edit = VersionEdit());
+
+	// Log edit and apply it. Return 0 once the record is synced, the edit is
+	// not applied if logging it failed.
+	int LogAndApply(const VersionEdit& edit);
+
+	std::vector<FileMeta> Files();
+
+	int LastFileId();
+
+	uint64_t ManifestNumber();
+};
+
+#endif  // MANIFEST_H_
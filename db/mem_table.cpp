@@ -0,0 +1,199 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include "mem_table.h"
+#include "../util/coding.h"
+#include "../util/hash.h"
+#include "../util/utils.h"
+
+MemTable::MemTable(int shards_num, uint32_t bloom_bits, int max_height, int branching)
+	: bloom_(nullptr), size_(0), older_(nullptr), log_number_(0), flushing_(false), has_range_tombstones_(false)
+{
+	assert(shards_num > 0);
+	for (int i = 0; i < shards_num; ++i)
+	{
+		shards_.push_back(new Shard(cmp_, max_height, branching));
+	}
+
+	if (bloom_bits > 0)
+	{
+		bloom_ = new DynamicBloom(&shards_[0]->memory_, bloom_bits);
+	}
+}
+
+MemTable::~MemTable()
+{
+	delete bloom_;
+
+	for (auto shard : shards_)
+	{
+		delete shard;
+	}
+}
+
+void MemTable::AddRangeDeletion(const ByteArray& begin, const ByteArray& end)
+{
+	std::unique_lock<std::mutex> lock(range_mutex_);
+	range_tombstones_.emplace_back(begin, end);
+	has_range_tombstones_.store(true, std::memory_order_release);
+}
+
+bool MemTable::RangeDeleted(const ByteArray& key)
+{
+	if (!has_range_tombstones_.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock(range_mutex_);
+	for (auto& tombstone : range_tombstones_)
+	{
+		if (tombstone.Covers(key))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+std::vector<RangeTombstone> MemTable::RangeDeletions()
+{
+	std::unique_lock<std::mutex> lock(range_mutex_);
+	return range_tombstones_;
+}
+
+uint32_t MemTable::BloomHash(const char* key, uint32_t key_size)
+{
+	// Not the shard seed, the keys of a shard would share filter bits.
+	return Hash(key, key_size, 0x9747b28c);
+}
+
+MemTable::Shard* MemTable::GetShard(const char* key, uint32_t key_size) const
+{
+	if (shards_.size() == 1)
+	{
+		return shards_[0];
+	}
+
+	return shards_[Hash(key, key_size, 0xbc9f1d34) % shards_.size()];
+}
+
+uint32_t MemTable::Add(const ByteArray& key, const ByteArray& value, ValueType type)
+{
+	uint32_t key_size = key.Size();
+	uint32_t value_size = value.Size();
+	const uint32_t encoded_len = 
+		VarintLength(key_size) + key_size + 1 +
+		VarintLength(value_size) + value_size;
+
+	if (bloom_ != nullptr)
+	{
+		bloom_->Add(BloomHash(key.Data(), key_size));
+	}
+
+	Shard* shard = GetShard(key.Data(), key_size);
+	char* buf = shard->memory_.Allocate(encoded_len);
+
+	char* p = EncodeVarint32(buf, key_size);
+	memcpy(p, key.Data(), key_size);
+	p += key_size;
+	*p++ = static_cast<char>(type);
+	p = EncodeVarint32(p, value_size);
+	memcpy(p, value.Data(), value_size);
+
+	assert((p + value_size) - buf == encoded_len);
+
+	shard->table_.Insert(buf);
+	return size_.fetch_add(encoded_len, std::memory_order_relaxed) + encoded_len;
+}
+
+uint32_t MemTable::AddEntries(const ByteArray& entries)
+{
+	if (entries.Size() == 0)
+	{
+		return Size();
+	}
+
+	// The entries are linked into the shards of their keys but share one
+	// buffer, every arena lives as long as the table.
+	char* buf = shards_[0]->memory_.Allocate(entries.Size());
+	memcpy(buf, entries.Data(), entries.Size());
+
+	const char* p = buf;
+	const char* limit = buf + entries.Size();
+	while (p < limit)
+	{
+		uint32_t key_size;
+		const char* key = GetVarint32Ptr(p, limit, &key_size);
+		if (bloom_ != nullptr)
+		{
+			bloom_->Add(BloomHash(key, key_size));
+		}
+
+		GetShard(key, key_size)->table_.Insert(p);
+		p += EntrySize(p);
+	}
+
+	return size_.fetch_add(entries.Size(), std::memory_order_relaxed) + entries.Size();
+}
+
+int MemTable::Get(const char* encoded_key, std::string& value_out, ValueType* type)
+{
+	uint32_t key_size;
+	const char* key = GetVarint32Ptr(encoded_key, encoded_key + 5, &key_size);
+	Table::Iterator it(&GetShard(key, key_size)->table_);
+	it.Seek(encoded_key);
+	if (!it.Valid())
+	{
+		return -1;
+	}
+
+	ByteArray value(ExtractUserValue(it.key()));
+	value_out.assign(value.Data(), value.Size());
+	if (type != nullptr)
+	{
+		*type = ExtractValueType(it.key());
+	}
+
+	return 0;
+}
+
+MemTable::Iterator::Iterator(const MemTable* mem_table) : mem_table_(mem_table), current_(-1)
+{
+	for (auto shard : mem_table_->shards_)
+	{
+		its_.push_back(Table::Iterator(&shard->table_));
+	}
+}
+
+void MemTable::Iterator::FindSmallest()
+{
+	// Shards hold disjoint keys and are few, a linear scan is enough.
+	current_ = -1;
+	for (size_t i = 0; i < its_.size(); ++i)
+	{
+		if (its_[i].Valid() && (current_ < 0 || mem_table_->cmp_(its_[i].key(), its_[current_].key()) < 0))
+		{
+			current_ = i;
+		}
+	}
+}
+
+void MemTable::Iterator::SeekToFirst()
+{
+	for (auto& it : its_)
+	{
+		it.SeekToFirst();
+	}
+
+	FindSmallest();
+}
+
+void MemTable::Iterator::Next()
+{
+	assert(Valid());
+	its_[current_].Next();
+	FindSmallest();
+}
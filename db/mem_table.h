@@ -0,0 +1,176 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef MEM_TABLE_H_
+#define MEM_TABLE_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "format.h"
+#include "../type/byte_array.h"
+#include "../type/value_type.h"
+#include "../util/comparator.h"
+#include "../structure/dynamic_bloom.h"
+#include "../structure/memory.h"
+#include "../structure/skip_list.h"
+
+// Sorted in-memory table of encoded entries, backing the income and
+// immutable buffers. Add and Get are safe to call from several threads at once.
+//
+// The table can be split into shards chosen by key hash, each with its own
+// skip list and arena, so concurrent writers do not all contend on the same
+// splices and arena lock. Iterator merges the shards back into key order.
+//
+// An optional bloom filter over the user keys lets lookups of keys that
+// were never added skip the skip list walk.
+//
+// Range tombstones are kept in a list of their own and delete the keys of
+// the table, whenever they were added, and of every older table and file.
+// StorageBuffer switches the table right after a range deletion, so the
+// keys added later go to a newer one.
+class MemTable
+{
+public:
+	typedef SkipList<const char*, Comparator> Table;
+
+	// Entries of all the shards in key order.
+	class Iterator
+	{
+	private:
+		const MemTable* mem_table_;
+		std::vector<Table::Iterator> its_;
+		// Shard holding the current entry, -1 when not Valid().
+		int current_;
+
+		void FindSmallest();
+
+	public:
+		explicit Iterator(const MemTable* mem_table);
+
+		bool Valid() const
+		{
+			return current_ >= 0;
+		}
+
+		const char* key() const
+		{
+			return its_[current_].key();
+		}
+
+		void SeekToFirst();
+
+		void Next();
+	};
+
+private:
+	struct Shard
+	{
+		Memory memory_;
+		Table table_;
+
+		Shard(Comparator cmp, int max_height, int branching) : table_(cmp, &memory_, max_height, branching) { }
+	};
+
+	Comparator cmp_;
+	std::vector<Shard*> shards_;
+	// nullptr when the table has no filter.
+	DynamicBloom* bloom_;
+	std::atomic<uint32_t> size_;
+	// Next older table waiting to be flushed, see StorageBuffer.
+	std::atomic<MemTable*> older_;
+	// First log segment holding records of this table.
+	uint64_t log_number_;
+	// Picked by a flush worker, guarded by the StorageBuffer mutex.
+	bool flushing_;
+	std::mutex range_mutex_;
+	std::vector<RangeTombstone> range_tombstones_;
+	// Lookups skip range_mutex_ while there are no tombstones.
+	std::atomic<bool> has_range_tombstones_;
+
+	MemTable(const MemTable&) = delete;
+	void operator=(const MemTable&) = delete;
+
+	Shard* GetShard(const char* key, uint32_t key_size) const;
+
+public:
+	// bloom_bits sizes the filter, 0 disables it. max_height and branching
+	// shape the skip lists, see SkipList.
+	MemTable(int shards_num = 1, uint32_t bloom_bits = 0, int max_height = 12, int branching = 4);
+	~MemTable();
+
+	// Return the encoded size of all the entries added so far, this one included.
+	uint32_t Add(const ByteArray& key, const ByteArray& value, ValueType type = TypeValue);
+
+	// Add entries encoded back to back with a single allocation. Return the
+	// encoded size of all the entries added so far, these ones included.
+	uint32_t AddEntries(const ByteArray& entries);
+
+	// encoded_key holds "key_size | key". Return 0 if the key is found, a
+	// deletion included, and store the type of its entry in type if given.
+	int Get(const char* encoded_key, std::string& value_out, ValueType* type = nullptr);
+
+	void AddRangeDeletion(const ByteArray& begin, const ByteArray& end);
+
+	// Return true if a range tombstone of the table covers the key.
+	bool RangeDeleted(const ByteArray& key);
+
+	// Copy of the range tombstones added so far.
+	std::vector<RangeTombstone> RangeDeletions();
+
+	// Hash of a user key for MayContain.
+	static uint32_t BloomHash(const char* key, uint32_t key_size);
+
+	// Return false if the key with this hash was never added.
+	bool MayContain(uint32_t hash) const
+	{
+		return bloom_ == nullptr || bloom_->MayContain(hash);
+	}
+
+	bool HasBloom() const
+	{
+		return bloom_ != nullptr;
+	}
+
+	uint32_t Size() const
+	{
+		return size_.load(std::memory_order_relaxed);
+	}
+
+	MemTable* Older() const
+	{
+		return older_.load(std::memory_order_acquire);
+	}
+
+	void SetOlder(MemTable* older)
+	{
+		older_.store(older, std::memory_order_release);
+	}
+
+	uint64_t LogNumber() const
+	{
+		return log_number_;
+	}
+
+	void SetLogNumber(uint64_t log_number)
+	{
+		log_number_ = log_number;
+	}
+
+	bool Flushing() const
+	{
+		return flushing_;
+	}
+
+	void SetFlushing()
+	{
+		flushing_ = true;
+	}
+};
+
+#endif  // MEM_TABLE_H_
@@ -18,6 +18,16 @@
 #define THREAD_NUM 16
 #define CACHE_NUM 100
 #define LEVEL0_FILE_NUM_LIMIT 4
+#define LOG_SYNC_INTERVAL_MS 10
+#define MAX_IMMUTABLE_BUFFERS 4
+#define MEMTABLE_SHARD_NUM 8
+#define FLUSH_THREAD_NUM 2
+#define IMMUTABLE_SLOWDOWN_TRIGGER 3
+#define LEVEL0_SLOWDOWN_TRIGGER (LEVEL0_FILE_NUM_LIMIT * 2)
+#define LEVEL0_STOP_TRIGGER (LEVEL0_FILE_NUM_LIMIT * 3)
+#define BLOOM_BITS_PER_KEY 10
+#define VALUE_LOG_THRESHOLD 512
+#define TABLE_BYTES_PER_SYNC (1 << 20)
 
 class NetworkTask : public Task
 {
@@ -104,13 +114,8 @@ public:
 
 					value = std::string(p, value_size);
 				}
-				else if (order_type == Delete)
-				{
-					value = Constant::TombValue;
-				}
 
-				data_base_->Add(Put, key, value);
-				return_msg.append("OK");
+				return_msg.append(data_base_->Add(order_type, key, value) == 0 ? "OK" : "FAILED");
 			}
 
 			if (send(socket_fd_, return_msg.c_str(), return_msg.size(), 0) != return_msg.size())
@@ -135,12 +140,23 @@ int main()
 {
 	EventManager event_manager;
     FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
-    StorageBuffer storage_buffer(4 << 20, &file_logger, &event_manager);
+    StorageBuffer storage_buffer(4 << 20, &file_logger, &event_manager, MAX_IMMUTABLE_BUFFERS, MEMTABLE_SHARD_NUM);
     LRUCache cache(CACHE_NUM);
-    StorageEngine storage_engine(&file_logger, LEVEL0_FILE_NUM_LIMIT, &event_manager, &storage_buffer);
-    DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache);
-
-    data_base.Start();
+    TableOptions table_options;
+    table_options.bloom_bits_per_key = BLOOM_BITS_PER_KEY;
+    table_options.value_log_threshold = VALUE_LOG_THRESHOLD;
+    table_options.bytes_per_sync = TABLE_BYTES_PER_SYNC;
+    ValueLog value_log(&file_logger);
+    StorageEngine storage_engine(&file_logger, LEVEL0_FILE_NUM_LIMIT, &event_manager, &storage_buffer, table_options, &value_log);
+    WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncInterval, LOG_SYNC_INTERVAL_MS);
+    WriteController write_controller(&storage_buffer, &storage_engine, &file_logger, IMMUTABLE_SLOWDOWN_TRIGGER, LEVEL0_SLOWDOWN_TRIGGER, LEVEL0_STOP_TRIGGER);
+    DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log, &write_controller, FLUSH_THREAD_NUM, &value_log);
+
+    if (data_base.Start() != 0)
+    {
+        file_logger.Error("Starting the Database Failed, Server Not Started.");
+        exit(1);
+    }
 
 	ThreadPool thread_pool(THREAD_NUM);
 	thread_pool.Start();
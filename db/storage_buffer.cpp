@@ -3,173 +3,177 @@
 // that can be found in the LICENSE file.
 
 #include <set>
+#include <thread>
 
 #include <unistd.h>
 #include <errno.h>
 
 #include "storage_buffer.h"
+#include "../type/constant.h"
 #include "../util/coding.h"
 
 void StorageBuffer::Add(OrderType order_type, const ByteArray& key, const ByteArray& value)
 {	
-	uint32_t key_size = key.Size();
-	uint32_t value_size = value.Size();
-	const uint32_t encoded_len = 
-		VarintLength(key_size) + key_size +
-		VarintLength(value_size) + value_size;
+	ValueType type = order_type == Delete ? TypeDeletion : TypeValue;
+	int epoch = rcu_.ReadLock();
+	uint32_t income_size = income_buffer_.load()->Add(key, value, type);
+	rcu_.ReadUnlock(epoch);
 
-	std::unique_lock<std::mutex> lock(mutex_);
-
-	char* buf = income_memory_->Allocate(encoded_len);
-
-	char* p = EncodeVarint32(buf, key_size);
-	memcpy(p, key.Data(), key_size);
-	p += key_size;
-	p = EncodeVarint32(p, value_size);
-	memcpy(p, value.Data(), value_size);
-
-	assert((p + value_size) - buf == encoded_len);
-
-	income_buffer_->Insert(buf);
-	income_size_ += encoded_len;
-
-	if (income_size_ > buffer_size_ && flush_thread_ready_)
+	if (income_size > buffer_size_ && immutable_buffers_number_ < max_immutable_buffers_)
 	{
-		// TODO: What if the speed of flushing is not comparable to the speed of writing, 
-		// which may cause income_buffer_ continuing growing.
-
-		SetFlushThreadBusy();
-
-		SwapBuffer();
-
-		event_manager_->event_flush_buffer_.Notify();
-
-		log_->Info("Flush Notify");
+		std::unique_lock<std::mutex> lock(mutex_);
+		MaybeSwapBuffer();
 	}
 }
 
-void StorageBuffer::SwapBuffer()
+void StorageBuffer::AddBatch(const WriteBatch& batch)
 {
-	income_size_ = 0;
-
-	flush_memory_ = income_memory_;
-	income_memory_ = new Memory();
-
-	flush_buffer_ = income_buffer_;
-	income_buffer_ = new SkipList<const char*, Comparator>(cmp_, income_memory_);
-
-	flush_buffer_ready_ = true;
+	// Batches never interleave with each other, and a batch always lands in
+	// a single buffer.
+	std::unique_lock<std::mutex> batch_lock(batch_mutex_);
+	int epoch = rcu_.ReadLock();
+	++batch_sequence_;
+	uint32_t income_size = income_buffer_.load()->AddEntries(batch.Data());
+	++batch_sequence_;
+	rcu_.ReadUnlock(epoch);
+	batch_lock.unlock();
+
+	if (income_size > buffer_size_ && immutable_buffers_number_ < max_immutable_buffers_)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		MaybeSwapBuffer();
+	}
 }
 
-void StorageBuffer::Flush(FILE* stream, std::vector<ByteArray>& content, std::unordered_map<std::string, uint32_t>& key_offset, uint32_t data_size)
+void StorageBuffer::AddRangeDeletion(const ByteArray& begin, const ByteArray& end)
 {
-	if (content.empty())
+	// The tombstone deletes every key of its buffer, the keys added after it
+	// must go to a newer one. Wait for room in the queue first, so the buffer
+	// holding it can be switched right away.
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!is_stop_ && immutable_buffers_number_ >= max_immutable_buffers_)
 	{
-		log_->Info("Flush content is empty");
+		queue_cv_.wait(lock);
 	}
 
-	uint32_t offset = 0;
+	int epoch = rcu_.ReadLock();
+	income_buffer_.load()->AddRangeDeletion(begin, end);
+	rcu_.ReadUnlock(epoch);
 
-	char encoded_uint32[6] = { 0 };
-	char* encoded_ptr = nullptr;
-	int len = 0;
+	SwapBuffer();
+	event_manager_->event_flush_buffer_.Notify();
+}
 
-	ByteArray lower = content.front();
-	ByteArray upper = content.back();
+void StorageBuffer::MaybeSwapBuffer()
+{
+	// Another writer may have switched the buffers in the meantime.
+	if (income_buffer_.load()->Size() <= buffer_size_ || immutable_buffers_number_ >= max_immutable_buffers_)
+	{
+		return;
+	}
 
-	uint32_t key_size;
-	const char* p = lower.Data();
-	len = GetVarint32(p, 5, &key_size);
+	SwapBuffer();
 
-	fwrite(lower.Data(), sizeof(char), len + key_size, stream);
-	offset += len + key_size;
+	event_manager_->event_flush_buffer_.Notify();
 
-	p = upper.Data();
-	len = GetVarint32(p, 5, &key_size);
+	log_->Info("Flush Notify");
+}
 
-	fwrite(upper.Data(), sizeof(char), len + key_size, stream);
-	offset += len + key_size;
+void StorageBuffer::SwapBuffer()
+{
+	MemTable* income_buffer = income_buffer_.load();
+	MemTable* new_buffer = new MemTable(memtable_shards_, memtable_bloom_bits_, skip_list_max_height_, skip_list_branching_);
+	new_buffer->SetOlder(income_buffer);
+	if (write_ahead_log_ != nullptr)
+	{
+		new_buffer->SetLogNumber(write_ahead_log_->NewSegment());
+	}
 
-	uint32_t index_offset = offset + 4 + data_size;
-	EncodeFixed32(encoded_uint32, index_offset);
-	fwrite(encoded_uint32, sizeof(char), 4, stream);
-	offset += 4;
+	// The old income buffer stays reachable through the new one, so a Get
+	// never misses it.
+	income_buffer_ = new_buffer;
+	++immutable_buffers_number_;
+	++pending_buffers_number_;
+}
 
-	std::string prev = "00000";	// DEBUG
-	for (auto& entry : content)
+MemTable* StorageBuffer::PickFlushBuffer()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	MemTable* picked = nullptr;
+	for (MemTable* buffer = income_buffer_.load()->Older(); buffer != nullptr; buffer = buffer->Older())
 	{
-		ByteArray key(ExtractUserKey(entry));
-		std::string user_key(key.Data(), key.Size());
-		key_offset[user_key] = offset;
-
-		if (user_key < prev)
+		if (!buffer->Flushing())
 		{
-			log_->Info("wrong order! prev: %s, user_key: %s.", prev.c_str(), user_key.c_str());
+			picked = buffer;
 		}
-
-		assert(user_key >= prev);	// DEBUG
-		prev = user_key;	// DEBUG
-
-		fwrite(entry.Data(), sizeof(char), entry.Size(), stream);
-		offset += entry.Size();
 	}
 
-	for (auto& item : key_offset)
+	if (picked != nullptr)
 	{
-		encoded_ptr = encoded_uint32;
-		encoded_ptr = EncodeVarint32(encoded_ptr, item.first.size());
-		
-		fwrite(encoded_uint32, sizeof(char), encoded_ptr - encoded_uint32, stream);
-
-		fwrite(item.first.c_str(), sizeof(char), item.first.size(), stream);
-
-		encoded_ptr = encoded_uint32;
-		encoded_ptr = EncodeVarint32(encoded_ptr, item.second);
-
-		fwrite(encoded_uint32, sizeof(char), encoded_ptr - encoded_uint32, stream);
+		picked->SetFlushing();
+		--pending_buffers_number_;
 	}
 
-	fclose(stream);
+	return picked;
 }
 
-void StorageBuffer::FlushBuffer(FILE* stream, std::unordered_map<std::string, uint32_t>& key_offset)
+int StorageBuffer::FlushBuffer(MemTable* flush_buffer, TableBuilder* builder)
 {
 	log_->Info("Starting Flush");
 
-	assert(flush_buffer_ != nullptr);
-
-	std::vector<ByteArray> content;
-	uint32_t flush_size = 0;
+	// Wait for the writers still adding to the buffer before it was switched.
+	rcu_.Synchronize();
 
-	SkipList<const char*, Comparator>::Iterator it(flush_buffer_);
+	// The shards are merged into one sorted file. The keys deleted by the
+	// tombstones of the buffer are left out, the tombstones go to the file
+	// for the older files.
+	MemTable::Iterator it(flush_buffer);
 	
 	for (it.SeekToFirst(); it.Valid(); it.Next())
 	{
-		uint32_t entry_size = EntrySize(it.key());
-		content.push_back(ByteArray(it.key(), entry_size));
+		ByteArray key = ExtractUserKey(it.key());
+		if (!flush_buffer->RangeDeleted(key))
+		{
+			builder->Add(key, ExtractUserValue(it.key()), ExtractValueType(it.key()));
+		}
+	}
 
-		flush_size += entry_size;
+	for (auto& tombstone : flush_buffer->RangeDeletions())
+	{
+		builder->AddRangeDeletion(tombstone);
 	}
 
-	Flush(stream, content, key_offset, flush_size);
+	int status = builder->Finish();
 
-	log_->Info("Ending Flush. Content Size: %d, %d Entries Flushed.", flush_size, content.size());
+	log_->Info("Ending Flush. File Size: %llu, %llu Entries Flushed.", (unsigned long long)builder->FileSize(), (unsigned long long)builder->NumEntries());
+	return status;
 }
 
-void StorageBuffer::ClearFlushBuffer()
+void StorageBuffer::ClearFlushBuffer(MemTable* flush_buffer)
 {
 	std::unique_lock<std::mutex> lock(mutex_);
 
-	flush_buffer_ready_ = false;
+	MemTable* newer = income_buffer_.load();
+	while (newer->Older() != flush_buffer)
+	{
+		newer = newer->Older();
+	}
+
+	assert(flush_buffer->Older() == nullptr);
+	newer->SetOlder(nullptr);
+	--immutable_buffers_number_;
+	queue_cv_.notify_all();
 
-	delete flush_memory_;
-	flush_memory_ = nullptr;
+	// The income buffer may have filled up while the queue was full.
+	MaybeSwapBuffer();
 
-	delete flush_buffer_;
-	flush_buffer_ = nullptr;
+	lock.unlock();
+
+	rcu_.Synchronize();
+	delete flush_buffer;
 }
 
-int StorageBuffer::Get(std::string& key, std::string& value_out)
+int StorageBuffer::Get(std::string& key, std::string& value_out, ValueType* type)
 {
 	// TODO: Use better enum type to indicate the return status.
 	int status = -1;
@@ -180,30 +184,54 @@ int StorageBuffer::Get(std::string& key, std::string& value_out)
 	p = EncodeVarint32(p, key.size());
 	memcpy(p, key.c_str(), key.size());
 
-	std::unique_lock<std::mutex> lock(mutex_);
-	if (income_buffer_ != nullptr)
+	int epoch = rcu_.ReadLock();
+
+	uint32_t hash = MemTable::BloomHash(key.c_str(), key.size());
+
+	// A batch linked while looking may have been seen in part, look again
+	// once it is done.
+	uint64_t sequence;
+	do
 	{
-		SkipList<const char*, Comparator>::Iterator it(income_buffer_);
-		it.Seek(temp);
-		if (it.Valid())
+		sequence = batch_sequence_;
+		if (sequence & 1)
 		{
-			status = 0;
-			ByteArray value(ExtractUserValue(it.key()));
-			value_out.assign(value.Data(), value.Size());
+			std::this_thread::yield();
+			continue;
 		}
-	}
 
-	if (status != 0 && flush_buffer_ != nullptr)
-	{
-		SkipList<const char*, Comparator>::Iterator it(flush_buffer_);
-		it.Seek(temp);
-		if (it.Valid())
+		status = -1;
+
+		// Newest buffer first, the latest value of the key wins.
+		for (MemTable* buffer = income_buffer_.load(); buffer != nullptr && status != 0; buffer = buffer->Older())
 		{
-			status = 0;
-			ByteArray value(ExtractUserValue(it.key()));
-			value_out.assign(value.Data(), value.Size());
+			if (buffer->RangeDeleted(ByteArray(key.data(), key.size())))
+			{
+				value_out.clear();
+				if (type != nullptr)
+				{
+					*type = TypeDeletion;
+				}
+
+				status = 0;
+				break;
+			}
+
+			if (!buffer->MayContain(hash))
+			{
+				bloom_hit_count_.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+
+			status = buffer->Get(temp, value_out, type);
+			if (status != 0 && buffer->HasBloom())
+			{
+				bloom_false_positive_count_.fetch_add(1, std::memory_order_relaxed);
+			}
 		}
-	}
+	} while ((sequence & 1) || batch_sequence_ != sequence);
+
+	rcu_.ReadUnlock(epoch);
 
 	delete[] temp;
 
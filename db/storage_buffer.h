@@ -1,6 +1,8 @@
 #ifndef STORAGE_BUFFER_H_
 #define STORAGE_BUFFER_H_
 
+#include <atomic>
+#include <condition_variable>
 #include <unordered_map>
 #include <mutex>
 #include <string>
@@ -8,89 +10,167 @@
 #include <stdio.h>
 
 #include "event_manager.h"
+#include "mem_table.h"
+#include "table_builder.h"
+#include "write_batch.h"
+#include "write_ahead_log.h"
 #include "../type/byte_array.h"
 #include "../type/order_type.h"
 #include "../util/logger.h"
 #include "../util/comparator.h"
-#include "../structure/memory.h"
-#include "../structure/skip_list.h"
+#include "../structure/rcu.h"
 
 class StorageBuffer
 {
 private:
 	uint32_t buffer_size_;
-	uint32_t income_size_ = 0;
+	// Buffers switched out and not flushed yet are kept up to this number,
+	// past it the income buffer keeps growing until the write controller
+	// stalls the writers.
+	int max_immutable_buffers_;
+	// Every memtable is split into this many shards by key hash.
+	int memtable_shards_;
+	// Bits of the memtable bloom filters, 0 disables them.
+	uint32_t memtable_bloom_bits_;
+	// Shape of the memtable skip lists, large buffers want taller ones.
+	int skip_list_max_height_;
+	int skip_list_branching_;
+	// Only serializes buffer switching, Add and Get never take it.
 	std::mutex mutex_;
-	SkipList<const char*, Comparator>* income_buffer_ = nullptr;
-	SkipList<const char*, Comparator>* flush_buffer_ = nullptr;
-	Memory* income_memory_ = nullptr;
-	Memory* flush_memory_ = nullptr;
+	// Signaled when an immutable buffer is dropped or on Stop().
+	std::condition_variable queue_cv_;
+	// No flush drains the queue any more.
+	bool is_stop_ = false;
+	// Serializes AddBatch.
+	std::mutex batch_mutex_;
+	// Odd while a batch is being linked into the income buffer. Get retries
+	// the lookup if the sequence was odd or moved meanwhile, so a batch is
+	// seen either whole or not at all.
+	std::atomic<uint64_t> batch_sequence_;
+	// Readers and writers pin the buffers through rcu_, a buffer is released
+	// only after every Add or Get that could see it has returned.
+	Rcu rcu_;
+	// Newest first: the income buffer, then the immutable buffers linked
+	// through MemTable::Older(). The oldest one is flushed first.
+	std::atomic<MemTable*> income_buffer_;
+	std::atomic<int> immutable_buffers_number_;
+	// Immutable buffers no flush worker has picked yet.
+	std::atomic<int> pending_buffers_number_;
 	EventManager* event_manager_;
 	Logger* log_;
-	Comparator cmp_;
-	bool flush_thread_ready_;
-	bool flush_buffer_ready_;
+	WriteAheadLog* write_ahead_log_ = nullptr;
+	// Lookups a bloom filter ruled out, and the ones it let through to a
+	// skip list that did not have the key.
+	std::atomic<uint64_t> bloom_hit_count_;
+	std::atomic<uint64_t> bloom_false_positive_count_;
+
+	// Switch the income buffer if it is full and the queue has room.
+	// REQUIRES: mutex_ held.
+	void MaybeSwapBuffer();
+
 
 public:
-	StorageBuffer(uint32_t buffer_size, Logger* log, EventManager* event_manager) : buffer_size_(buffer_size), log_(log), event_manager_(event_manager), flush_thread_ready_(false), flush_buffer_ready_(false)
+	// Every memtable gets a bloom filter of buffer_size / memtable_bloom_ratio
+	// bytes, 0 disables them.
+	StorageBuffer(uint32_t buffer_size, Logger* log, EventManager* event_manager, int max_immutable_buffers = 2, int memtable_shards = 1, int memtable_bloom_ratio = 32, int skip_list_max_height = 12, int skip_list_branching = 4)
+		: buffer_size_(buffer_size), max_immutable_buffers_(max_immutable_buffers), memtable_shards_(memtable_shards),
+		  memtable_bloom_bits_(memtable_bloom_ratio > 0 ? (uint64_t)buffer_size * 8 / memtable_bloom_ratio : 0),
+		  skip_list_max_height_(skip_list_max_height), skip_list_branching_(skip_list_branching),
+		  batch_sequence_(0), immutable_buffers_number_(0), pending_buffers_number_(0), event_manager_(event_manager), log_(log),
+		  bloom_hit_count_(0), bloom_false_positive_count_(0)
 	{
-		income_memory_ = new Memory();
-		income_buffer_ = new SkipList<const char*, Comparator>(cmp_, income_memory_); 
+		income_buffer_ = new MemTable(memtable_shards_, memtable_bloom_bits_, skip_list_max_height_, skip_list_branching_);
 	}
 
 	~StorageBuffer() 
 	{
-		if (income_memory_ != nullptr)
-		{
-			delete income_memory_;
-		}
-
-		if (flush_memory_ != nullptr)
-		{
-			delete flush_memory_;
-		}
-
-		if (income_buffer_ != nullptr)
-		{
-			delete income_buffer_;
-		}
-
-		if (flush_buffer_ != nullptr)
+		MemTable* buffer = income_buffer_.load();
+		while (buffer != nullptr)
 		{
-			delete flush_buffer_;
+			MemTable* older = buffer->Older();
+			delete buffer;
+			buffer = older;
 		}
 	}
 
 	// Put record to Income Buffer
 	void Add(OrderType order_type, const ByteArray& key, const ByteArray& value);
-	// Flush Flush Buffer
-	void FlushBuffer(FILE* data_file, std::unordered_map<std::string, uint32_t>& key_offset);
-	// General Flush function, reused by compaction process
-	void Flush(FILE* stream, std::vector<ByteArray>& content, std::unordered_map<std::string, uint32_t>& key_offset, uint32_t data_size);
-	// Clear Flush Buffer
-	void ClearFlushBuffer();
-	// Get Operation from Buffers
-	int Get(std::string& key, std::string& value_out);
-	// Swap Income Buffer and Flush Buffer
+	// Delete the keys from begin up to end, excluded, from the income buffer
+	// and everything older, then switch the income buffer. Blocks while the
+	// immutable buffer queue is full.
+	void AddRangeDeletion(const ByteArray& begin, const ByteArray& end);
+	// Put all the records of batch to Income Buffer, Get sees them all at once.
+	void AddBatch(const WriteBatch& batch);
+	// Hand the oldest immutable buffer no flush worker has picked yet to the
+	// caller, or return nullptr. Buffers are picked in the order they were
+	// switched out.
+	MemTable* PickFlushBuffer();
+	// Flush an immutable buffer returned by PickFlushBuffer into a table file,
+	// safe to call for several buffers at once. Return 0 on success.
+	int FlushBuffer(MemTable* flush_buffer, TableBuilder* builder);
+	// Drop the flushed buffer, which must be the oldest immutable buffer
+	void ClearFlushBuffer(MemTable* flush_buffer);
+	// Get Operation from Buffers. Return 0 if the newest entry of the key is
+	// found, a deletion included, and store its type in type if given. A key
+	// covered by a range tombstone is returned as TypeDeletion.
+	int Get(std::string& key, std::string& value_out, ValueType* type = nullptr);
+	// Turn the income buffer into the newest immutable buffer
+	// REQUIRES: mutex_ held, or no concurrent Add.
 	void SwapBuffer();
+	// Release the writers waiting for room in the queue, which is let grow
+	// past max_immutable_buffers_ from now on.
+	void Stop()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		is_stop_ = true;
+		queue_cv_.notify_all();
+	}
+
+	// Switch log segments together with the buffers from now on.
+	void SetWriteAheadLog(WriteAheadLog* write_ahead_log)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		write_ahead_log_ = write_ahead_log;
+		income_buffer_.load()->SetLogNumber(write_ahead_log->SegmentNumber());
+	}
+
 	uint32_t BufferSize()
 	{
 		return buffer_size_;
 	}
 
-	void SetFlushThreadIdle()
+	bool FlushBufferReady()
 	{
-		flush_thread_ready_ = true;
+		return pending_buffers_number_ > 0;
 	}
 
-	void SetFlushThreadBusy()
+	int ImmutableBuffersNumber()
 	{
-		flush_thread_ready_ = false;
+		return immutable_buffers_number_;
 	}
 
-	bool FlushBufferReady()
+	int MaxImmutableBuffers()
+	{
+		return max_immutable_buffers_;
+	}
+
+	uint64_t BloomHitCount()
+	{
+		return bloom_hit_count_.load(std::memory_order_relaxed);
+	}
+
+	uint64_t BloomFalsePositiveCount()
+	{
+		return bloom_false_positive_count_.load(std::memory_order_relaxed);
+	}
+
+	// The income buffer is past the buffer size and waits to be switched.
+	bool IncomeBufferFull()
 	{
-		return flush_buffer_ready_;
+		int epoch = rcu_.ReadLock();
+		bool full = income_buffer_.load()->Size() > buffer_size_;
+		rcu_.ReadUnlock(epoch);
+		return full;
 	}
 };
 
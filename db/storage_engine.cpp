@@ -4,17 +4,71 @@
 
 #include "storage_engine.h"
 
-StorageEngine::StorageEngine(Logger* log, int level0_files_number_limit, EventManager* event_manager, StorageBuffer* storage_buffer) 
-	: log_(log), 
-	  level0_files_number_limit_(level0_files_number_limit),
+namespace {
+
+// "<level>_<file id>", see FileName().
+bool IsTableFileName(const char* name)
+{
+	const char* p = name;
+	while (isdigit(*p))
+	{
+		++p;
+	}
+
+	if (p == name || *p != '_' || !isdigit(*(p + 1)))
+	{
+		return false;
+	}
+
+	for (++p; isdigit(*p); ++p) { }
+	return *p == '\0';
+}
+
+}  // namespace
+
+StorageEngine::StorageEngine(Logger* log, int level0_files_number_limit, EventManager* event_manager, StorageBuffer* storage_buffer, const TableOptions& table_options, ValueLog* value_log, double deletion_compaction_ratio) 
+	: level0_files_number_limit_(level0_files_number_limit),
+	  log_(log), 
 	  event_manager_(event_manager),
-	  storage_buffer_(storage_buffer)
+	  storage_buffer_(storage_buffer),
+	  table_options_(table_options),
+	  value_log_(value_log),
+	  deletion_compaction_ratio_(deletion_compaction_ratio)
 {
 	if (access(Constant::DataFolder.c_str(), 0) != 0)
 	{
 		mkdir(Constant::DataFolder.c_str(), 0777);
 	}
 
+	std::map<int, std::vector<File*>> level_files;
+	std::unordered_map<int, File*> files_map;
+	manifest_ = new Manifest(Constant::DataFolder, log_);
+	int status = manifest_->Recover();
+	if (status == -2)
+	{
+		// The levels cannot be told from the names, a moved file keeps its
+		// own. Nothing is touched until the manifest is repaired.
+		log_->Error("The Manifest Cannot Be Read, Refusing to Open the Data Files.");
+		has_error_ = true;
+		current_ = new Version(level_files);
+		return;
+	}
+
+	if (status == 0)
+	{
+		for (auto& meta : manifest_->Files())
+		{
+			File* file = new File(meta);
+			level_files[file->LevelId()].push_back(file);
+			files_map[file->FileId()] = file;
+		}
+
+		file_id_ = std::max(file_id_, manifest_->LastFileId());
+	}
+
+	// Without a manifest every table file is opened to learn its bounds,
+	// and the level comes from its name. With one, the files it does not
+	// list were written by a flush or a compaction that never finished.
 	DIR* dir;
 	struct dirent* ptr;
 	if ((dir = opendir(Constant::DataFolder.c_str())) == NULL)
@@ -22,155 +76,367 @@ StorageEngine::StorageEngine(Logger* log, int level0_files_number_limit, EventMa
 		log_->Error("Openning DataBase Data Directory Failed.");
 	}
 
-	while ((ptr = readdir(dir)) != NULL)
+	VersionEdit edit;
+	while (dir != NULL && (ptr = readdir(dir)) != NULL)
 	{
-		if (strcmp(ptr->d_name, ".") == 0 || strcmp(ptr->d_name, "..") == 0
-			|| ptr->d_name[0] == '.')	// Prevent some hidden file like ".swp"
+		if (!IsTableFileName(ptr->d_name))	// Manifests and hidden files like ".swp"
 		{
 			continue;
 		}
 
 		std::string file_name(ptr->d_name);
+		if (status == 0)
+		{
+			int file_id = stoi(file_name.substr(file_name.find("_") + 1));
+			if (files_map.count(file_id) == 0 || files_map[file_id]->FileName() != file_name)
+			{
+				log_->Info("Removing %s File Missing from the Manifest.", ptr->d_name);
+				remove((Constant::DataFolder + "/" + file_name).c_str());
+			}
+
+			continue;
+		}
+
 		File* file = new File(file_name);
-		level_files_[file->LevelId()].push_back(file);
-		files_map_[file->FileId()] = file;
 		log_->Info("Read %s File", ptr->d_name);
+		LogFileMeta(file);
+		if (file->Corrupted())
+		{
+			has_error_ = true;
+			delete file;
+			continue;
+		}
+
+		level_files[file->LevelId()].push_back(file);
+		files_map[file->FileId()] = file;
+		edit.added_files_.push_back(file->Meta());
 
-		// TODO: Give better file id management.
 		file_id_ = std::max(file_id_, file->FileId());	
 	}
 
-	for (auto& item : level_files_)
+	if (dir != NULL)
+	{
+		closedir(dir);
+	}
+
+	for (auto& item : level_files)
 	{
 		// TODO: Find somewhere else to put the cmp function.
 		std::sort(item.second.begin(), item.second.end(), StorageEngine::cmp);
 	}
 
-	log_->Info("Reading %d Data Files.", files_map_.size());
+	current_ = new Version(level_files);
+	if (has_error_)
+	{
+		// A manifest written without the corrupted files would have the next
+		// start remove them.
+		log_->Error("Corrupted Data Files Found, Refusing to Open the Data Files.");
+		return;
+	}
+
+	edit.last_file_id_ = file_id_;
+	if (manifest_->Open(edit) != 0)
+	{
+		log_->Error("Opening the Manifest Failed, Changes of the Files Are Not Logged.");
+	}
+
+	log_->Info("Reading %d Data Files.", (int)files_map.size());
+}
+
+StorageEngine::~StorageEngine()
+{
+	current_.load()->Unref();
+	delete manifest_;
+}
+
+Version* StorageEngine::CurrentVersion()
+{
+	int epoch = rcu_.ReadLock();
+	Version* version = current_.load();
+	version->Ref();
+	rcu_.ReadUnlock(epoch);
+	return version;
+}
+
+void StorageEngine::InsertFile(std::vector<File*>& files, File* file)
+{
+	auto it = std::lower_bound(files.begin(), files.end(), file, StorageEngine::cmp);
+	files.insert(it, file);
+}
+
+void StorageEngine::InstallVersion(const std::map<int, std::vector<File*>>& level_files)
+{
+	Version* old_version = current_.load();
+	current_.store(new Version(level_files));
+
+	// Lookups that loaded the old version before the switch may still be
+	// reading it.
+	rcu_.Synchronize();
+	old_version->Unref();
 }
 
-FILE* StorageEngine::NewWritableFile(int& file_id, std::string& file_name, int level_id)
+WritableFile* StorageEngine::NewWritableFile(int& file_id, std::string& file_name, int level_id)
 {
 	mutex_.lock();
 	file_id = ++file_id_;
 	mutex_.unlock();
 	file_name = FileName(level_id, file_id);
+	return OpenWritableFile(file_name);
+}
 
+WritableFile* StorageEngine::OpenWritableFile(const std::string& file_name)
+{
 	// TODO: Duplicate codes, try to reuse the function in "file.h".
 	std::string file_path = Constant::DataFolder + std::string("/") + file_name;
 
-	FILE* file_stream = fopen(file_path.c_str(), "w");
-	return file_stream;
+	// Flushed and compacted files are cut at about the size of a buffer.
+	return WritableFile::Open(file_path, storage_buffer_->BufferSize(), table_options_.bytes_per_sync);
 }
 
-void StorageEngine::AddFile(std::string file_name)
+void StorageEngine::LogFileMeta(File* file)
 {
-	WriteLock();
+	if (file->Corrupted())
+	{
+		log_->Error("File \"%s\": Corrupted, %llu Bytes.", file->FileName().c_str(), (unsigned long long)file->FileSize());
+		return;
+	}
 
-	File* file = new File(file_name);
+	if (file->Reader() == nullptr)
+	{
+		log_->Info("File \"%s\": Legacy Format, %llu Bytes.", file->FileName().c_str(), (unsigned long long)file->FileSize());
+		return;
+	}
 
-	// TODO: Use binary search to optimize this.
-	auto it = level_files_[file->LevelId()].begin();
-	while (it != level_files_[file->LevelId()].end() && file->LowerBound() > (*it)->LowerBound())
+	log_->Info("File \"%s\": Table Format Version %d, %llu Bytes, Filter Type %d, %u Bytes, %llu Entries, %llu Deletions, %d Range Tombstones.",
+		file->FileName().c_str(), file->Reader()->Version(), (unsigned long long)file->FileSize(), file->Reader()->GetFilterType(), file->Reader()->FilterSize(),
+		(unsigned long long)file->Reader()->Properties().num_entries_, (unsigned long long)file->Reader()->Properties().num_deletions_,
+		(int)file->Reader()->RangeDeletions().size());
+}
+
+TableBuilder* StorageEngine::NewTableBuilder(WritableFile* file, int level_id)
+{
+	TableOptions options = table_options_;
+	const std::vector<CompressionType>& per_level = table_options_.compression_per_level;
+	if (!per_level.empty())
 	{
-		++it;
+		options.compression = per_level[std::min<size_t>(level_id, per_level.size() - 1)];
 	}
 
-	level_files_[file->LevelId()].insert(it, file);
-	files_map_[file->FileId()] = file;
-	if (level_files_[0].size() > level0_files_number_limit_)
+	if (IsLastLevel(level_id))
 	{
-		event_manager_->event_compact_.Notify();
+		options.filter_type = table_options_.last_level_filter_type;
+		if (options.compression != NoCompression)
+		{
+			options.compression = table_options_.last_level_compression;
+		}
 	}
 
-	WriteUnlock();
+	return new TableBuilder(options, file, value_log_);
 }
 
-void StorageEngine::GetContainsFiles(std::string& key, std::vector<std::vector<File*>>& contains_files) 
+void StorageEngine::AddTableStats(const TableBuilder* builder)
 {
-	for (auto& item : level_files_)
+	raw_data_bytes_.fetch_add(builder->RawDataSize(), std::memory_order_relaxed);
+	data_bytes_.fetch_add(builder->DataSize(), std::memory_order_relaxed);
+}
+
+bool StorageEngine::IsLastLevel(int level_id)
+{
+	// Level 0 files are compacted away soon whatever is below them.
+	if (level_id == 0)
 	{
-		std::vector<File*> tmp;
-		int i = 0;
-		while (i < item.second.size() && key >= item.second[i]->LowerBound())
-		{
-			if (key <= item.second[i]->UpperBound())
-			{
-				tmp.push_back(item.second[i]);
-			}
+		return false;
+	}
 
-			i++;
-		}
+	int epoch;
+	bool is_last = BeginRead(epoch)->LastLevel() <= level_id;
+	EndRead(epoch);
+	return is_last;
+}
+
+int StorageEngine::AddFile(std::string file_name)
+{
+	if (HasError())
+	{
+		log_->Error("Refusing File \"%s\" after a Manifest Failure.", file_name.c_str());
+		return -1;
+	}
+
+	File* file = new File(file_name);
+	if (file->Corrupted())
+	{
+		log_->Error("File \"%s\" Cannot Be Read Back, Not Added.", file_name.c_str());
+		delete file;
+		return -1;
+	}
 
-		std::sort(tmp.begin(), tmp.end(), [](const File* f1, const File* f2) { return f1->FileId() > f2->FileId(); });
-		contains_files.push_back(tmp);
+	// The callers drop the log segments of the file once it is added.
+	if (SyncFolder(Constant::DataFolder) != 0)
+	{
+		log_->Error("Syncing the Data Folder for File \"%s\" Failed.", file_name.c_str());
+		has_error_ = true;
+		delete file;
+		return -1;
+	}
+
+	VersionEdit edit;
+	edit.added_files_.push_back(file->Meta());
+	mutex_.lock();
+	edit.last_file_id_ = file_id_;
+	mutex_.unlock();
+	if (manifest_->LogAndApply(edit) != 0)
+	{
+		// Left on disk, the next start removes it as missing from the manifest.
+		log_->Error("Logging File \"%s\" to the Manifest Failed.", file_name.c_str());
+		has_error_ = true;
+		delete file;
+		return -1;
 	}
+
+	LogFileMeta(file);
+
+	std::unique_lock<std::mutex> lock(version_mutex_);
+	std::map<int, std::vector<File*>> level_files(current_.load()->LevelFiles());
+	InsertFile(level_files[file->LevelId()], file);
+	InstallVersion(level_files);
+	if ((int)level_files[0].size() > level0_files_number_limit_)
+	{
+		event_manager_->event_compact_.Notify();
+	}
+
+	return 0;
 }
 
-void StorageEngine::LoadKeyOffset(int file_id, std::unordered_map<std::string, uint32_t>& key_offset)
+int StorageEngine::LoadKeyOffset(File* file, std::unordered_map<std::string, uint64_t>& key_offset)
 {
-	char* buf = const_cast<char*>(files_map_[file_id]->MMap());
-	char* p = buf;
+	if (file->Corrupted() || file->Reader() != nullptr)
+	{
+		return -1;
+	}
+
+	const char* buf = file->MMap();
+	const char* p = buf;
+	const char* limit = buf + file->FileSize();
 	uint32_t size;
-	int length = GetVarint32(p, 5, &size);
-	p += length + size;
-	length = GetVarint32(p, 5, &size);
-	p += length + size;
+	for (int i = 0; i < 2; ++i)
+	{
+		if ((p = GetVarint32Ptr(p, limit, &size)) == nullptr || (uint64_t)(limit - p) < size)
+		{
+			return -1;
+		}
+
+		p += size;
+	}
 
 	uint32_t index_offset;
+	if (limit - p < 4)
+	{
+		return -1;
+	}
+
 	GetFixed32(p, &index_offset);
+	if (index_offset > file->FileSize())
+	{
+		return -1;
+	}
 
 	p = buf + index_offset;
-	while (p - buf < files_map_[file_id]->FileSize())
+	while (p < limit)
 	{
-		length = GetVarint32(p, 5, &size);
-		p += length;
+		uint64_t offset;
+		if ((p = GetVarint32Ptr(p, limit, &size)) == nullptr || (uint64_t)(limit - p) < size)
+		{
+			return -1;
+		}
+
 		std::string key(p, size);
-		p += size;
-		uint32_t offset;
-		length = GetVarint32(p, 5, &offset);
-		p += length;
+		if ((p = GetVarint64Ptr(p + size, limit, &offset)) == nullptr)
+		{
+			return -1;
+		}
+
 		key_offset[key] = offset;
 	}
+
+	return 0;
 }
 
-void StorageEngine::GetValueByOffset(int file_id, uint32_t offset, std::string& value_out)
+int StorageEngine::GetValueByOffset(File* file, uint64_t offset, std::string& value_out)
 {
-	char* p = const_cast<char*>(files_map_[file_id]->MMap());
-	p += offset;
-	int length = 0;
+	if (file->Corrupted() || file->Reader() != nullptr || offset >= file->FileSize())
+	{
+		return -1;
+	}
+
+	const char* p = file->MMap() + offset;
+	const char* limit = file->MMap() + file->FileSize();
 	uint32_t size;
-	length = GetVarint32(p, 5, &size);
-	p += length + size;
-	length = GetVarint32(p, 5, &size);
-	value_out.assign(p + length, size);
+	if ((p = GetVarint32Ptr(p, limit, &size)) == nullptr || (uint64_t)(limit - p) < size
+		|| (p = GetVarint32Ptr(p + size, limit, &size)) == nullptr || (uint64_t)(limit - p) < size)
+	{
+		return -1;
+	}
+
+	value_out.assign(p, size);
+	return 0;
 }
 
 void StorageEngine::Compact(int level_id)
 {
-	ReadLock();
-	std::map<int, std::vector<File*>> level_files(level_files_);
-	ReadUnlock();
+	if (HasError())
+	{
+		return;
+	}
+
+	// The version keeps the files picked alive until the compaction is over.
+	Version* version = CurrentVersion();
+	std::map<int, std::vector<File*>> level_files(version->LevelFiles());
 	
-	if (level_files[level_id].size() <= level0_files_number_limit_ * (int)pow(10, level_id))
+	// A full level is compacted from its first file. Otherwise a file mostly
+	// made of deletions is, so the space of what they delete is reclaimed.
+	// Level 0 files are compacted away soon whatever they hold.
+	File* first_file = nullptr;
+	File* deletion_file = nullptr;
+	if ((int)level_files[level_id].size() > level0_files_number_limit_ * (int)pow(10, level_id))
+	{
+		first_file = level_files[level_id][0];
+	}
+	else if (level_id > 0)
+	{
+		first_file = deletion_file = PickDeletionFile(level_files[level_id]);
+	}
+
+	if (first_file == nullptr)
 	{
-		log_->Info("Current Level: %d. This Level File Number: %d. Limit: %d.", level_id, level_files[level_id].size(), level0_files_number_limit_ * (int)pow(10, level_id));
+		log_->Info("Current Level: %d. This Level File Number: %d. Limit: %d.", level_id, (int)level_files[level_id].size(), level0_files_number_limit_ * (int)pow(10, level_id));
+		version->Unref();
 		return;
 	}
 
+	if (deletion_file != nullptr)
+	{
+		log_->Info("File \"%s\" Compacted for its Deletion Ratio %.2f.", deletion_file->FileName().c_str(), deletion_file->DeletionRatio());
+	}
+
+	// A file of the last level is rewritten in place, nothing below needs
+	// its deletions.
 	int next_level = level_id + 1;
+	if (deletion_file != nullptr && version->LastLevel() <= level_id)
+	{
+		next_level = level_id;
+	}
 
 	std::vector<File*> compact_files;	
-	compact_files.push_back(level_files[level_id][0]);
-	std::string lowerbound = level_files[level_id][0]->LowerBound();
-	std::string upperbound = level_files[level_id][0]->UpperBound();
+	compact_files.push_back(first_file);
+	std::string lowerbound = first_file->LowerBound();
+	std::string upperbound = first_file->UpperBound();
 
 	if (level_id == 0)
 	{
-		FindOverlapFilesLevel0(level_files[level_id], compact_files, lowerbound, upperbound);
+		FindOverlapFilesLevel0(level_files[level_id], compact_files, upperbound);
 	}
 	
-	if (level_files.find(next_level) != level_files.end())
+	if (next_level != level_id && level_files.find(next_level) != level_files.end())
 	{
 		FindOverlapFilesBasedOnBound(level_files[next_level], compact_files, lowerbound, upperbound);
 	}
@@ -183,21 +449,45 @@ void StorageEngine::Compact(int level_id)
 		file_names.append("\"" + file->FileName() + "\" ");
 	}
 
-	log_->Info("%d Files to be Compacted, including %s", compact_files.size(), file_names.c_str());
+	log_->Info("%d Files to be Compacted, including %s", (int)compact_files.size(), file_names.c_str());
 
 	std::vector<File*> compacted_files;
 
-	if (compact_files.size() == 1)
+	// A file compacted for its deletions is rewritten without them.
+	if (compact_files.size() == 1 && deletion_file == nullptr)
 	{
-		compacted_files = TrivialMove(compact_files);	
+		if (TrivialMove(compact_files, compacted_files) != 0)
+		{
+			log_->Error("Level %d Compaction Failed.", level_id);
+			version->Unref();
+			return;
+		}
 	}
 	else
 	{
-		compacted_files = NWayCompaction(compact_files, level_id);
-		UpdateMapAfterCompaction(compacted_files, compact_files, true);
+		if (NWayCompaction(version, compact_files, next_level, compacted_files) != 0)
+		{
+			log_->Error("Level %d Compaction Failed.", level_id);
+			version->Unref();
+			return;
+		}
+
+		if (UpdateMapAfterCompaction(compacted_files, compact_files, true) != 0)
+		{
+			// The outputs stay on disk, the manifest may hold them if only
+			// its sync failed. The next start removes them otherwise.
+			for (auto& file : compacted_files)
+			{
+				delete file;
+			}
+
+			log_->Error("Level %d Compaction Failed.", level_id);
+			version->Unref();
+			return;
+		}
 	}
 
-	log_->Info("Ending Level %d Compaction Processing. Compacting %d Old Files, Generating %d New Files.", level_id, compact_files.size(), compacted_files.size());
+	log_->Info("Ending Level %d Compaction Processing. Compacting %d Old Files, Generating %d New Files.", level_id, (int)compact_files.size(), (int)compacted_files.size());
 	file_names = "";
 	for (auto& file : compacted_files)
 	{
@@ -205,223 +495,449 @@ void StorageEngine::Compact(int level_id)
 	}
 
 	log_->Info("Generated New Files Includes %s", file_names.c_str());
+	version->Unref();
 	Compact(level_id);
 	Compact(level_id + 1);
 }
 
-std::vector<File*> StorageEngine::TrivialMove(std::vector<File*>& compact_files)
+void StorageEngine::CompactLevels()
 {
-	std::vector<File*> compacted_files;
-	for (auto& file : compact_files)
+	int epoch;
+	int last_level = BeginRead(epoch)->LastLevel();
+	EndRead(epoch);
+
+	for (int level_id = 0; level_id <= last_level; ++level_id)
 	{
-		mutex_.lock();
-		int file_id = ++file_id_;
-		mutex_.unlock();
-		
-		std::string file_name = FileName(file->LevelId() + 1, file_id);
+		Compact(level_id);
+	}
+}
 
-		// TODO: Duplicate codes, try to reuse the function in "file.h".
-		std::string file_path = Constant::DataFolder + std::string("/") + file_name;
-		
-		rename(file->FilePath().c_str(), file_path.c_str());
+File* StorageEngine::PickDeletionFile(std::vector<File*>& files)
+{
+	if (deletion_compaction_ratio_ <= 0)
+	{
+		return nullptr;
+	}
 
-		compacted_files.push_back(new File(file_name));
+	File* picked = nullptr;
+	double max_ratio = deletion_compaction_ratio_;
+	for (auto& file : files)
+	{
+		double ratio = file->DeletionRatio();
+		if (ratio >= max_ratio)
+		{
+			picked = file;
+			max_ratio = ratio;
+		}
 	}
 
-	UpdateMapAfterCompaction(compacted_files, compact_files, false);
-	return compacted_files;
+	return picked;
 }
 
-void StorageEngine::UpdateMapAfterCompaction(std::vector<File*>& compacted_files, std::vector<File*>& compact_files, bool need_remove_file)
+int StorageEngine::LevelFilesNumber(int level_id)
 {
-	WriteLock();
+	int epoch;
+	int files_number = BeginRead(epoch)->LevelFilesNumber(level_id);
+	EndRead(epoch);
+	return files_number;
+}
 
-	log_->Info("Starting Updating Level Files Map.");
-	for (auto& compact_file : compact_files)
+int StorageEngine::TrivialMove(std::vector<File*>& compact_files, std::vector<File*>& compacted_files)
+{
+	// Only the manifest changes, the file keeps its name and its id.
+	for (auto& file : compact_files)
 	{
-		for (auto it = level_files_[compact_file->LevelId()].begin(); it != level_files_[compact_file->LevelId()].end(); ++it)
+		compacted_files.push_back(new File(file->Meta(file->LevelId() + 1)));
+	}
+
+	if (UpdateMapAfterCompaction(compacted_files, compact_files, false) != 0)
+	{
+		for (auto& file : compacted_files)
 		{
-			if ((*it)->FileId() == compact_file->FileId())
-			{
-				log_->Info("Find File %d", compact_file->FileId());
-				level_files_[compact_file->LevelId()].erase(it);
-				break;
-			}
+			delete file;
 		}
 
-		log_->Info("To Erase file id");
-		files_map_.erase(compact_file->FileId());
-		log_->Info("Finish Erasing");
+		compacted_files.clear();
+		return -1;
 	}
 
-	log_->Info("Ending Removing Old Files form Level Files Map.");
+	return 0;
+}
 
-	for (auto& compacted_file : compacted_files)
+int StorageEngine::UpdateMapAfterCompaction(std::vector<File*>& compacted_files, std::vector<File*>& compact_files, bool need_remove_file)
+{
+	if (HasError())
 	{
-		auto it = level_files_[compacted_file->LevelId()].begin();
-		while (it != level_files_[compacted_file->LevelId()].end() && compacted_file->LowerBound() > (*it)->LowerBound())
-		{
-			++it;
-		}
+		return -1;
+	}
 
-		level_files_[compacted_file->LevelId()].insert(it, compacted_file);
-		log_->Info("Inserting %d new file to level files", compacted_file->FileId());
-		files_map_[compacted_file->FileId()] = compacted_file;
-		log_->Info("Inserting %d new file to files map", compacted_file->FileId());
+	// The inputs are deleted only once the edit replacing them is synced.
+	VersionEdit edit;
+	for (auto& compact_file : compact_files)
+	{
+		edit.deleted_files_.push_back(compact_file->FileId());
 	}
 
-	log_->Info("Ending Updating Level Files Map.");
+	for (auto& compacted_file : compacted_files)
+	{
+		edit.added_files_.push_back(compacted_file->Meta());
+	}
 
-	WriteUnlock();
+	if (!compacted_files.empty() && SyncFolder(Constant::DataFolder) != 0)
+	{
+		log_->Error("Syncing the Data Folder for the Compaction Outputs Failed.");
+		has_error_ = true;
+		return -1;
+	}
 
-	log_->Info("Starting Releasing Old Files' Resources.");
+	mutex_.lock();
+	edit.last_file_id_ = file_id_;
+	mutex_.unlock();
+	if (manifest_->LogAndApply(edit) != 0)
+	{
+		log_->Error("Logging the Compaction to the Manifest Failed.");
+		has_error_ = true;
+		return -1;
+	}
+
+	std::unique_lock<std::mutex> lock(version_mutex_);
+	std::map<int, std::vector<File*>> level_files(current_.load()->LevelFiles());
 	for (auto& compact_file : compact_files)
 	{
-		if (need_remove_file && compact_file->Delete() != 0)
+		std::vector<File*>& files = level_files[compact_file->LevelId()];
+		files.erase(std::remove(files.begin(), files.end(), compact_file), files.end());
+		if (need_remove_file)
 		{
-			log_->Info("Delete Old File Failed");
+			compact_file->MarkObsolete();
 		}
+	}
 
-		delete compact_file;
+	for (auto& compacted_file : compacted_files)
+	{
+		InsertFile(level_files[compacted_file->LevelId()], compacted_file);
+		LogFileMeta(compacted_file);
 	}
 
-	log_->Info("Ending Releasing Old Files' Resources.");
+	InstallVersion(level_files);
+	return 0;
 }
 
-std::vector<File*> StorageEngine::NWayCompaction(std::vector<File*>& compact_files, int level_id)
+int StorageEngine::NWayCompaction(Version* version, std::vector<File*>& compact_files, int output_level, std::vector<File*>& compacted_files)
 {
-	std::vector<File*> compacted_files;
 	int len = compact_files.size();
 
-	std::vector<char*> buf_array(len);
-	std::vector<char*> ptr_array(len);
+	// A range tombstone deletes the keys of the inputs older than its own.
+	std::vector<std::pair<int, RangeTombstone>> input_tombstones;
 	for (int i = 0; i < len; ++i)
 	{
-		
-		buf_array[i] = const_cast<char*>(compact_files[i]->MMap());
-		ptr_array[i] = buf_array[i];
-
-		// Skip the lowerbound and upperbound in the file header
-		auto entry = ExtractEntry(ptr_array[i], compact_files[i], i);
-		assert(entry.size_ == ptr_array[i] - buf_array[i]);
+		if (compact_files[i]->Reader() != nullptr)
+		{
+			for (auto& tombstone : compact_files[i]->Reader()->RangeDeletions())
+			{
+				input_tombstones.emplace_back(i, tombstone);
+			}
+		}
 	}
 
-	std::vector<uint32_t> index_offset(len);
-	for (int i = 0; i < len; ++i)
+	auto range_deleted = [&compact_files, &input_tombstones](int index, const ByteArray& key)
 	{
-		GetFixed32(ptr_array[i], &index_offset[i]);
-		ptr_array[i] += 4;
-	}
+		for (auto& input_tombstone : input_tombstones)
+		{
+			if (Newer(compact_files[input_tombstone.first], compact_files[index]) && input_tombstone.second.Covers(key))
+			{
+				return true;
+			}
+		}
 
-	std::string prev = "";
-	bool has_initial = false;
-	std::priority_queue<Entry, std::vector<Entry>, priority_queue_cmp> pq;
+		return false;
+	};
 
-	for (int i = 0; i < len; ++i)
+	// Files below the output level, in key order within each level. Only
+	// compaction, which runs on one thread, changes these levels.
+	std::vector<std::vector<File*>> deeper_files;
+	const std::map<int, std::vector<File*>>& level_files = version->LevelFiles();
+	for (auto level = level_files.upper_bound(output_level); level != level_files.end(); ++level)
 	{
-		if (ptr_array[i] - buf_array[i] < index_offset[i])
+		if (!level->second.empty())
 		{
-			pq.push(ExtractEntry(ptr_array[i], compact_files[i], i));
+			deeper_files.push_back(level->second);
 		}
 	}
 
-	std::vector<ByteArray> content;
-	uint32_t content_size = 0;
-	while (!pq.empty())
+	// A deletion is kept as long as a deeper level may hold the key. Keys
+	// come in order, each level is walked once.
+	std::vector<size_t> deeper_cursors(deeper_files.size(), 0);
+	auto deeper_may_contain = [&deeper_files, &deeper_cursors](const ByteArray& key)
 	{
-		Entry entry = pq.top();
-		pq.pop();
-		if (!has_initial || entry.key_ != prev)
+		std::string target(key.Data(), key.Size());
+		for (size_t i = 0; i < deeper_files.size(); ++i)
 		{
-			if (!has_initial) 
+			size_t& cursor = deeper_cursors[i];
+			while (cursor < deeper_files[i].size() && deeper_files[i][cursor]->UpperBound() < target)
 			{
-				has_initial = true;
+				++cursor;
 			}
 
-			prev = entry.key_;
+			if (cursor < deeper_files[i].size() && deeper_files[i][cursor]->LowerBound() <= target)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	std::vector<RangeTombstone> output_tombstones;
+	for (auto& input_tombstone : input_tombstones)
+	{
+		const RangeTombstone& tombstone = input_tombstone.second;
+		bool overlapped = false;
+		for (size_t i = 0; i < deeper_files.size() && !overlapped; ++i)
+		{
+			for (auto& file : deeper_files[i])
+			{
+				if (file->LowerBound() < tombstone.end_ && file->UpperBound() >= tombstone.begin_)
+				{
+					overlapped = true;
+					break;
+				}
+			}
+		}
+
+		if (overlapped)
+		{
+			output_tombstones.push_back(tombstone);
+		}
+	}
+
+	// Legacy and table files are merged alike through their iterators, the
+	// output is always written in the table format.
+	std::vector<TableIterator*> iterators(len);
+	CompactionInputCmp cmp(compact_files, iterators);
+	std::priority_queue<int, std::vector<int>, CompactionInputCmp> pq(cmp);
+	// Values of the dropped pointers, garbage once the inputs are deleted.
+	std::vector<ValuePointer> discarded;
+	for (int i = 0; i < len; ++i)
+	{
+		iterators[i] = compact_files[i]->NewIterator();
+		iterators[i]->SeekToFirst();
+
+		bool covered = false;
+		for (auto& input_tombstone : input_tombstones)
+		{
+			if (Newer(compact_files[input_tombstone.first], compact_files[i])
+				&& input_tombstone.second.Covers(compact_files[i]->LowerBound(), compact_files[i]->UpperBound()))
+			{
+				covered = true;
+				break;
+			}
+		}
 
-			if (!entry.is_delete_)
+		if (covered)
+		{
+			// Deleted as a whole, the file is not merged. Only its pointers are
+			// read, for the value log to reclaim their values.
+			log_->Info("File \"%s\" Deleted by a Range Tombstone.", compact_files[i]->FileName().c_str());
+			for (; value_log_ != nullptr && iterators[i]->Valid(); iterators[i]->Next())
 			{
-				ByteArray temp(entry.p_, entry.size_);
+				ValuePointer pointer;
+				if (iterators[i]->type() == TypeValuePointer && pointer.DecodeFrom(iterators[i]->value()))
+				{
+					discarded.push_back(pointer);
+				}
+			}
+
+			continue;
+		}
+
+		if (iterators[i]->Valid())
+		{
+			pq.push(i);
+		}
+	}
 
-				content.push_back(temp);
+	std::string prev = "";
+	bool has_initial = false;
+	TableBuilder* builder = nullptr;
+	std::string file_name;
+	// The output files split the key space at their first keys, each one
+	// takes the parts of the tombstones between its first key and the next
+	// file's. A full file is finished once that key is known.
+	std::string lower = "";
+	bool cut_pending = false;
+	int status = 0;
+
+	while (!pq.empty() && status == 0)
+	{
+		int index = pq.top();
+		pq.pop();
+		TableIterator* it = iterators[index];
+		ByteArray key = it->key();
+		if (!has_initial || Compare(key, ByteArray(prev.data(), prev.size())) != 0)
+		{
+			has_initial = true;
+			prev.assign(key.Data(), key.Size());
 
-				content_size += temp.Size();
-				if (content_size > storage_buffer_->BufferSize())
+			if (range_deleted(index, key))
+			{
+				// The older entries of the key are skipped below.
+				ValuePointer pointer;
+				if (it->type() == TypeValuePointer && pointer.DecodeFrom(it->value()))
 				{
-					log_->Info("vector size: %d, content size: %d", content.size(), content_size);
-					std::string file_name = FlushCompactedFile(content, content_size, level_id + 1);
+					discarded.push_back(pointer);
+				}
+			}
+			else if (it->type() != TypeDeletion || deeper_may_contain(key))
+			{
+				if (cut_pending)
+				{
+					AddRangeDeletions(builder, output_tombstones, lower, &prev);
+					File* file = FinishCompactedFile(builder, file_name);
+					builder = nullptr;
+					if (file == nullptr)
+					{
+						status = -1;
+						break;
+					}
+
+					compacted_files.push_back(file);
+					lower = prev;
+					cut_pending = false;
 					log_->Info("NWay add file %s", file_name.c_str());
-					compacted_files.push_back(new File(file_name));
-					log_->Info("File id: %d, Level id: %d", compacted_files.back()->FileId(), compacted_files.back()->LevelId());
-					content.clear();
-					content_size = 0;
 				}
+
+				if (builder == nullptr)
+				{
+					int file_id;
+					builder = NewTableBuilder(NewWritableFile(file_id, file_name, output_level), output_level);
+					log_->Info("Starting Flushing Compacted file \"%s\".", file_name.c_str());
+				}
+
+				builder->Add(key, it->value(), it->type());
+				cut_pending = builder->FileSize() >= storage_buffer_->BufferSize();
 			}
 		}
-		
-		if (ptr_array[entry.index_] - buf_array[entry.index_] < index_offset[entry.index_])
+		else if (it->type() == TypeValuePointer)
 		{
-			pq.push(ExtractEntry(ptr_array[entry.index_], compact_files[entry.index_], entry.index_));
-		}	
+			ValuePointer pointer;
+			if (pointer.DecodeFrom(it->value()))
+			{
+				discarded.push_back(pointer);
+			}
+		}
+
+		it->Next();
+		if (it->Valid())
+		{
+			pq.push(index);
+		}
 	}
 
-	if (!content.empty())
+	if (status == 0 && builder == nullptr && !output_tombstones.empty())
 	{
-		std::string file_name = FlushCompactedFile(content, content_size, level_id + 1);
-		compacted_files.push_back(new File(file_name));
-		log_->Info("Final NWay add file %s", file_name.c_str());
-		log_->Info("File id: %d, Level id: %d", compacted_files.back()->FileId(), compacted_files.back()->LevelId());
+		// Every key was deleted, the tombstones still delete the keys of the
+		// deeper levels.
+		int file_id;
+		builder = NewTableBuilder(NewWritableFile(file_id, file_name, output_level), output_level);
 	}
 
-	return compacted_files;
-}
+	if (builder != nullptr)
+	{
+		AddRangeDeletions(builder, output_tombstones, lower, nullptr);
+		File* file = FinishCompactedFile(builder, file_name);
+		if (file == nullptr)
+		{
+			status = -1;
+		}
+		else
+		{
+			compacted_files.push_back(file);
+			log_->Info("Final NWay add file %s", file_name.c_str());
+		}
+	}
 
-std::string StorageEngine::FlushCompactedFile(std::vector<ByteArray>& content, uint32_t content_size, int level_id)
-{
-	int file_id;
-	std::string file_name;
-	auto file_stream = NewWritableFile(file_id, file_name, level_id);
-	std::unordered_map<std::string, uint32_t> key_offset;
+	for (int i = 0; i < len; ++i)
+	{
+		if (iterators[i]->status() != 0)
+		{
+			log_->Error("Corrupted Block in File \"%s\", Keeping the Compaction Inputs.", compact_files[i]->FileName().c_str());
+			status = -1;
+		}
 
-	log_->Info("Starting Flushing Compacted file \"%s\".", file_name.c_str());
-	storage_buffer_->Flush(file_stream, content, key_offset, content_size);
-	
-	log_->Info("Ending Flushing Compacted file \"%s\".", file_name.c_str());
-	return file_name;
+		delete iterators[i];
+	}
+
+	if (status != 0)
+	{
+		// The output misses the entries after the corrupted block or the
+		// failed file.
+		for (auto& file : compacted_files)
+		{
+			file->Delete();
+			delete file;
+		}
+
+		compacted_files.clear();
+	}
+	else if (value_log_ != nullptr)
+	{
+		for (auto& pointer : discarded)
+		{
+			value_log_->Discard(pointer);
+		}
+	}
+
+	return status;
 }
 
-StorageEngine::Entry StorageEngine::ExtractEntry(char*& p, File* file, int index)
+void StorageEngine::AddRangeDeletions(TableBuilder* builder, const std::vector<RangeTombstone>& tombstones, const std::string& lower, const std::string* upper)
 {
-	uint32_t total_len = 0;
-	char* original = p;
+	for (auto& tombstone : tombstones)
+	{
+		RangeTombstone clipped = tombstone;
+		if (clipped.begin_ < lower)
+		{
+			clipped.begin_ = lower;
+		}
 
-	uint32_t size;
-	int length = GetVarint32(p, 5, &size);
-	p += length;
-	std::string key(p, size);
-	
-	total_len += length + size;
+		if (upper != nullptr && *upper < clipped.end_)
+		{
+			clipped.end_ = *upper;
+		}
 
-	p += size;
-	length = GetVarint32(p, 5, &size);
-	p += length;
+		if (clipped.begin_ < clipped.end_)
+		{
+			builder->AddRangeDeletion(clipped);
+		}
+	}
+}
 
-	total_len += length + size;
+File* StorageEngine::FinishCompactedFile(TableBuilder* builder, const std::string& file_name)
+{
+	if (builder->Finish() != 0)
+	{
+		log_->Error("Flushing Compacted file \"%s\" Failed.", file_name.c_str());
+		delete builder;
+		remove((Constant::DataFolder + "/" + file_name).c_str());
+		return nullptr;
+	}
 
-	bool is_delete = false;
-	if (size == Constant::TombValue.size())
+	log_->Info("Ending Flushing Compacted file \"%s\". %llu Entries, Filter %.2f Bits per Key, Data %llu Bytes Compressed to %llu.", file_name.c_str(),
+		(unsigned long long)builder->NumEntries(), builder->NumEntries() == 0 ? 0.0 : builder->FilterSize() * 8.0 / builder->NumEntries(),
+		(unsigned long long)builder->RawDataSize(), (unsigned long long)builder->DataSize());
+	AddTableStats(builder);
+	delete builder;
+
+	File* file = new File(file_name);
+	if (file->Corrupted())
 	{
-		std::string value(p, size);
-		std::string tomb = Constant::TombValue;
-		if (value == tomb)
-		{
-			is_delete = true;
-		}
+		log_->Error("Compacted file \"%s\" Cannot Be Read Back.", file_name.c_str());
+		delete file;
+		remove((Constant::DataFolder + "/" + file_name).c_str());
+		return nullptr;
 	}
 
-	p += size;
-	return Entry(key, file->LevelId(), file->FileId(), is_delete, original, total_len, index);
+	return file;
 }
 
 void StorageEngine::FindOverlapFilesBasedOnBound(std::vector<File*>& candidate_files, std::vector<File*>& compact_files, std::string& lowerbound, std::string& upperbound)
@@ -435,9 +951,9 @@ void StorageEngine::FindOverlapFilesBasedOnBound(std::vector<File*>& candidate_f
 	}
 }
 
-void StorageEngine::FindOverlapFilesLevel0(std::vector<File*>& candidate_files, std::vector<File*>& compact_files, std::string& lowerbound, std::string& upperbound)
+void StorageEngine::FindOverlapFilesLevel0(std::vector<File*>& candidate_files, std::vector<File*>& compact_files, std::string& upperbound)
 {
-	for (int i = 1; i < candidate_files.size(); ++i)
+	for (size_t i = 1; i < candidate_files.size(); ++i)
 	{
 		if (candidate_files[i]->LowerBound() <= upperbound)
 		{
@@ -5,6 +5,7 @@
 #ifndef STORAGE_ENGINE_H_
 #define STORAGE_ENGINE_H_
 
+#include <atomic>
 #include <map>
 #include <vector>
 #include <algorithm>
@@ -17,6 +18,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <string.h>
 #include <fcntl.h>
@@ -25,13 +27,19 @@
 #include <sys/mman.h>
 
 #include "file.h"
+#include "format.h"
+#include "manifest.h"
+#include "table_builder.h"
+#include "table_iterator.h"
 #include "storage_buffer.h"
+#include "value_log.h"
+#include "version.h"
 #include "event_manager.h"
 #include "../util/utils.h"
 #include "../util/logger.h"
 #include "../type/byte_array.h"
 #include "../type/constant.h"
-#include "../structure/read_write_lock.h"
+#include "../structure/rcu.h"
 
 class StorageEngine
 {
@@ -39,97 +47,216 @@ private:
 	int file_id_ = -1;
 	int level0_files_number_limit_;
 
-	std::map<int, std::vector<File*>> level_files_;
-	std::unordered_map<int, File*> files_map_;
+	// The version lookups and compactions read. Readers pin it through rcu_,
+	// a replaced version loses the reference of the engine only after every
+	// read-side section that could see it is over.
+	std::atomic<Version*> current_;
+	Rcu rcu_;
+	// Serializes installing versions.
+	std::mutex version_mutex_;
 
 	std::mutex mutex_;
 
 	Logger* log_;
 	EventManager* event_manager_;
 	StorageBuffer* storage_buffer_;
-	ReadWriteLock rw_lock_;
 
-	struct Entry
+	TableOptions table_options_;
+	// Optional, every value stays in the tables without it.
+	ValueLog* value_log_;
+	// Files of every level, so startup and moving a file between levels
+	// need no table file opened.
+	Manifest* manifest_;
+	// Files below level 0 whose DeletionRatio() reaches this are compacted
+	// even if their level is not full, 0 disables it.
+	double deletion_compaction_ratio_;
+
+	// Set once a change of the files could not be logged to the manifest,
+	// or at startup if the manifest or a data file could not be read. No
+	// version is installed afterwards, so nothing the manifest still lists is
+	// removed.
+	std::atomic<bool> has_error_{false};
+
+	// Data block bytes of the tables written, before and after compression.
+	std::atomic<uint64_t> raw_data_bytes_{0};
+	std::atomic<uint64_t> data_bytes_{0};
+
+	// Order the inputs of a compaction by their current key. On equal keys the
+	// newer entry, from the lower level or the larger file id, comes first.
+	struct CompactionInputCmp
 	{
-		std::string key_;
-		int level_id_;
-		int file_id_;
-		int index_;
-		bool is_delete_;
-		char* p_;
-		uint32_t size_;
-		
-		Entry(std::string key, int level_id, int file_id, bool is_delete, char* p, uint32_t size, int index)
-			: key_(key),
-			  level_id_(level_id),
-			  file_id_(file_id),
-			  is_delete_(is_delete),
-			  p_(p),
-			  size_(size),
-			  index_(index)
+		const std::vector<File*>& files_;
+		const std::vector<TableIterator*>& iterators_;
+
+		CompactionInputCmp(const std::vector<File*>& files, const std::vector<TableIterator*>& iterators)
+			: files_(files), iterators_(iterators) { }
+
+		bool operator()(int a, int b) const
 		{
+			int r = Compare(iterators_[a]->key(), iterators_[b]->key());
+			if (r != 0)
+			{
+				return r > 0;
+			}
+
+			return Newer(files_[b], files_[a]);
 		}
 	};
 
-	struct priority_queue_cmp
+	// The entries of file a were written after the ones of file b: a is at
+	// a lower level, or at the same level with a larger file id.
+	static bool Newer(const File* a, const File* b)
 	{
-		bool operator()(Entry& a, Entry& b)
+		if (a->LevelId() != b->LevelId())
 		{
-			return (a.key_ > b.key_) || (a.key_ == b.key_ && (a.level_id_ > b.level_id_ || (a.level_id_ == b.level_id_ && a.file_id_ < b.file_id_)));
+			return a->LevelId() < b->LevelId();
 		}
-	};
+
+		return a->FileId() > b->FileId();
+	}
 
 	static bool cmp(const File* file1, const File* file2)
 	{
 		return file1->LowerBound() < file2->LowerBound();
 	}
 
-	// Only one file to compact, just move it to next level.
-	std::vector<File*> TrivialMove(std::vector<File*>& compact_files);
+	// Log the format and the filter of a file.
+	void LogFileMeta(File* file);
+
+	// Insert file into files, keeping them sorted by LowerBound().
+	static void InsertFile(std::vector<File*>& files, File* file);
+
+	// Make the files of level_files the current version.
+	// REQUIRES: version_mutex_ held.
+	void InstallVersion(const std::map<int, std::vector<File*>>& level_files);
 
-	// Update File Map after compaction finishing.
-	void UpdateMapAfterCompaction(std::vector<File*>& compacted_files, std::vector<File*>& compact_files, bool need_remove_file);
+	// Only one file to compact, just move it to next level. Return 0 on
+	// success, -1 and no file if the move cannot be logged.
+	int TrivialMove(std::vector<File*>& compact_files, std::vector<File*>& compacted_files);
 
-	// N Way Compaction on compact_files
-	std::vector<File*> NWayCompaction(std::vector<File*>& compact_files, int level_id);
+	// Install a version with compacted_files in place of compact_files. The
+	// inputs are removed from disk with their last reference if
+	// need_remove_file is set. Return -1 and change nothing if the edit
+	// cannot be logged, the engine is then in the error state.
+	int UpdateMapAfterCompaction(std::vector<File*>& compacted_files, std::vector<File*>& compact_files, bool need_remove_file);
 
-	// Flush single file during N Way Compaction process
-	std::string FlushCompactedFile(std::vector<ByteArray>& content, uint32_t content_size, int level_id);
+	// N Way Compaction on compact_files of version into files of output_level.
+	// Return -1 and no file if an input is corrupted or an output cannot be
+	// written.
+	int NWayCompaction(Version* version, std::vector<File*>& compact_files, int output_level, std::vector<File*>& compacted_files);
 
-	// Extract Entry from Data File
-	Entry ExtractEntry(char*& p, File* file, int index);
+	// Add the parts of tombstones from lower up to upper, excluded, to builder.
+	// The tombstones are not clipped at the top if upper is nullptr.
+	void AddRangeDeletions(TableBuilder* builder, const std::vector<RangeTombstone>& tombstones, const std::string& lower, const std::string* upper);
+
+	// Finish and release a table written by compaction, return its file, or
+	// nullptr once the partial file is removed if writing it failed.
+	File* FinishCompactedFile(TableBuilder* builder, const std::string& file_name);
+
+	// No level below level_id holds files.
+	bool IsLastLevel(int level_id);
+
+	// File of the level with the largest DeletionRatio(), if it reaches
+	// deletion_compaction_ratio_, or nullptr.
+	File* PickDeletionFile(std::vector<File*>& files);
 
 	// Find Overlap Files in Next Level
 	void FindOverlapFilesBasedOnBound(std::vector<File*>& candidate_files, std::vector<File*>& compact_files, std::string& lowerbound, std::string& upperbound);
 
 	// Find Overlap Files in Level 0
-	void FindOverlapFilesLevel0(std::vector<File*>& candidate_files, std::vector<File*>& compact_files, std::string& lowerbound, std::string& upperbound);
+	void FindOverlapFilesLevel0(std::vector<File*>& candidate_files, std::vector<File*>& compact_files, std::string& upperbound);
 
 public:
 	// Create New File for Flush
-	FILE* NewWritableFile(int& file_id, std::string& file_name, int level_id = 0);
+	WritableFile* NewWritableFile(int& file_id, std::string& file_name, int level_id = 0);
 
-	StorageEngine(Logger* log, int level0_files_number_limit, EventManager* event_manager, StorageBuffer* storage_buffer);
+	// Create or truncate the data file file_name again, for a flush retried
+	// under the file id it was given.
+	WritableFile* OpenWritableFile(const std::string& file_name);
 
-	// Add New File to File Map
-	void AddFile(std::string file_name);
+	StorageEngine(Logger* log, int level0_files_number_limit, EventManager* event_manager, StorageBuffer* storage_buffer, const TableOptions& table_options = TableOptions(), ValueLog* value_log = nullptr, double deletion_compaction_ratio = 0.5);
 
-	// Get possible files possible to contain corresponding key
-	void GetContainsFiles(std::string& key, std::vector<std::vector<File*>>& contains_files); 
+	~StorageEngine();
 
-	// Read Key-Offset table from file
-	void LoadKeyOffset(int file_id, std::unordered_map<std::string, uint32_t>& key_offset);
+	// Table builder writing a new file of level_id to stream, with the codec
+	// and the filter of that level.
+	TableBuilder* NewTableBuilder(WritableFile* file, int level_id = 0);
+
+	// Verify the checksums of the blocks read by lookups.
+	bool VerifyChecksums() const
+	{
+		return table_options_.verify_checksums;
+	}
 
-	// Get value from file
-	void GetValueByOffset(int file_id, uint32_t offset, std::string& value_out);
+	// Count the data written by a finished builder in the compression stats.
+	void AddTableStats(const TableBuilder* builder);
+
+	uint64_t RawDataBytes()
+	{
+		return raw_data_bytes_.load(std::memory_order_relaxed);
+	}
+
+	uint64_t DataBytes()
+	{
+		return data_bytes_.load(std::memory_order_relaxed);
+	}
+
+	// Uncompressed over compressed size of all the data blocks written.
+	double CompressionRatio()
+	{
+		uint64_t data_bytes = DataBytes();
+		return data_bytes == 0 ? 1.0 : (double)RawDataBytes() / data_bytes;
+	}
+
+	// Add New File to File Map. Return -1 if the file cannot be made durable
+	// or logged, it is not added then and the engine is in the error state.
+	int AddFile(std::string file_name);
+
+	// A change of the files failed to be logged, every later one is refused.
+	bool HasError() const
+	{
+		return has_error_.load();
+	}
+
+	// Enter a read-side section and return the current version, which stays
+	// valid until EndRead(). Never blocks, and must not be nested in a call
+	// installing a version.
+	Version* BeginRead(int& epoch)
+	{
+		epoch = rcu_.ReadLock();
+		return current_.load();
+	}
+
+	void EndRead(int epoch)
+	{
+		rcu_.ReadUnlock(epoch);
+	}
+
+	// Reference the current version, for readers that outlive a lookup.
+	// Release it with Version::Unref().
+	Version* CurrentVersion();
+
+	// Wait until every read-side section entered before this call is over.
+	void WaitForReaders()
+	{
+		rcu_.Synchronize();
+	}
+
+	// Read Key-Offset table from a legacy file. Return -1 if the file is not
+	// a legacy one or its index runs past its end.
+	int LoadKeyOffset(File* file, std::unordered_map<std::string, uint64_t>& key_offset);
+
+	// Get value from a legacy file. Return -1 if the entry runs past its end.
+	int GetValueByOffset(File* file, uint64_t offset, std::string& value_out);
 
 	// Compaction on given Level
 	void Compact(int level_id);
 
-	void ReadLock() { rw_lock_.ReadLock(); }
-	void ReadUnlock() { rw_lock_.ReadUnlock(); }
-	void WriteLock() { rw_lock_.WriteLock(); }
-	void WriteUnlock() { rw_lock_.WriteUnlock(); }
+	// Compact every level that needs it, from level 0 down.
+	void CompactLevels();
+
+	// Number of files in the given Level
+	int LevelFilesNumber(int level_id);
 };
 
 #endif  // STORAGE_ENGINE_H_
@@ -0,0 +1,279 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+
+#include <assert.h>
+#include <string.h>
+
+#include "table_builder.h"
+#include "../util/coding.h"
+#include "../util/crc32c.h"
+#include "../util/utils.h"
+#include "../structure/bloom_filter.h"
+#include "../structure/blocked_bloom_filter.h"
+#include "../structure/xor_filter.h"
+
+namespace
+{
+
+// Shorten start to a key in [start, limit) if possible.
+void FindShortestSeparator(std::string& start, const ByteArray& limit)
+{
+	size_t min_size = std::min<size_t>(start.size(), limit.Size());
+	size_t diff_index = 0;
+	while (diff_index < min_size && start[diff_index] == limit.Data()[diff_index])
+	{
+		diff_index++;
+	}
+
+	if (diff_index >= min_size)
+	{
+		// One key is a prefix of the other.
+		return;
+	}
+
+	uint8_t diff_byte = static_cast<uint8_t>(start[diff_index]);
+	if (diff_byte < 0xff && diff_byte + 1 < static_cast<uint8_t>(limit.Data()[diff_index]))
+	{
+		start[diff_index]++;
+		start.resize(diff_index + 1);
+	}
+}
+
+// Shorten key to a key not smaller than it.
+void FindShortSuccessor(std::string& key)
+{
+	for (size_t i = 0; i < key.size(); ++i)
+	{
+		if (static_cast<uint8_t>(key[i]) != 0xff)
+		{
+			key[i]++;
+			key.resize(i + 1);
+			return;
+		}
+	}
+}
+
+}  // namespace
+
+TableBuilder::TableBuilder(const TableOptions& options, WritableFile* file, ValueLog* value_log)
+	: options_(options),
+	  file_(file),
+	  status_(file == nullptr ? -1 : 0),
+	  offset_(0),
+	  num_entries_(0),
+	  num_deletions_(0),
+	  data_block_(options.block_restart_interval),
+	  pending_index_entry_(false),
+	  filter_size_(0),
+	  raw_data_size_(0),
+	  data_size_(0),
+	  value_log_(value_log),
+	  separated_values_(0)
+{
+}
+
+TableBuilder::~TableBuilder()
+{
+	assert(file_ == nullptr);
+}
+
+void TableBuilder::Add(const ByteArray& key, const ByteArray& value, ValueType type)
+{
+	if (pending_index_entry_)
+	{
+		FindShortestSeparator(last_key_, key);
+		AddIndexEntry(ByteArray(last_key_.data(), last_key_.size()));
+	}
+
+	value_buf_.assign(1, static_cast<char>(type));
+	ValuePointer pointer;
+	if (type == TypeValue && value_log_ != nullptr && options_.value_log_threshold > 0 && value.Size() >= options_.value_log_threshold
+		&& value_log_->Add(key, value, pointer) == 0)
+	{
+		value_buf_[0] = static_cast<char>(TypeValuePointer);
+		pointer.EncodeTo(value_buf_);
+		separated_values_++;
+	}
+	else
+	{
+		value_buf_.append(value.Data(), value.Size());
+	}
+
+	data_block_.Add(key, ByteArray(value_buf_.data(), value_buf_.size()));
+	num_entries_++;
+	if (type == TypeDeletion)
+	{
+		num_deletions_++;
+	}
+
+	if (options_.filter_type != FilterNone && options_.bloom_bits_per_key > 0)
+	{
+		key_hashes_.push_back(BloomFilter::KeyHash(key));
+	}
+
+	if (data_block_.CurrentSizeEstimate() >= options_.block_size)
+	{
+		FlushDataBlock();
+	}
+}
+
+void TableBuilder::FlushDataBlock()
+{
+	if (data_block_.Empty())
+	{
+		return;
+	}
+
+	// Indexed by a key between the block and the next one, the first block
+	// whose key is not smaller than the target is the only one that can hold it.
+	last_key_ = data_block_.LastKey();
+	uint64_t offset = offset_;
+	raw_data_size_ += data_block_.CurrentSizeEstimate();
+	WriteBlock(data_block_, pending_handle_, options_.compression);
+	data_size_ += offset_ - offset;
+	pending_index_entry_ = true;
+}
+
+void TableBuilder::AddIndexEntry(const ByteArray& separator)
+{
+	std::string encoded_handle;
+	pending_handle_.EncodeTo(encoded_handle);
+	index_block_.Add(separator, ByteArray(encoded_handle.data(), encoded_handle.size()));
+	pending_index_entry_ = false;
+}
+
+void TableBuilder::WriteBlock(BlockBuilder& block, BlockHandle& handle, CompressionType type)
+{
+	ByteArray contents = block.Finish();
+
+	const Compressor* compressor = GetCompressor(type);
+	if (compressor != nullptr && compressor->Compress(contents.Data(), contents.Size(), compressed_)
+		&& compressed_.size() < contents.Size() - contents.Size() / 8)
+	{
+		contents = ByteArray(compressed_.data(), compressed_.size());
+	}
+	else
+	{
+		type = NoCompression;
+	}
+
+	handle.offset_ = offset_;
+	handle.size_ = contents.Size();
+	WriteRaw(contents.Data(), contents.Size());
+
+	char trailer[kBlockTrailerSize];
+	trailer[0] = static_cast<char>(type);
+	uint32_t crc = Crc32cValue(contents.Data(), contents.Size());
+	EncodeFixed32(trailer + 1, Crc32cMask(Crc32cExtend(crc, trailer, 1)));
+	WriteRaw(trailer, kBlockTrailerSize);
+	block.Reset();
+}
+
+void TableBuilder::WriteRaw(const char* data, uint32_t size)
+{
+	if (status_ == 0 && file_->Append(data, size) != 0)
+	{
+		status_ = -1;
+	}
+
+	offset_ += size;
+}
+
+void TableBuilder::WriteMetaBlock(BlockBuilder& metaindex_block, const char* name, const std::string& contents)
+{
+	BlockHandle handle;
+	handle.offset_ = offset_;
+	handle.size_ = contents.size();
+	WriteRaw(contents.data(), contents.size());
+
+	char crc[4];
+	EncodeFixed32(crc, Crc32cMask(Crc32cValue(contents.data(), contents.size())));
+	WriteRaw(crc, sizeof(crc));
+
+	std::string encoded_handle;
+	handle.EncodeTo(encoded_handle);
+	metaindex_block.Add(ByteArray(name, strlen(name)), ByteArray(encoded_handle.data(), encoded_handle.size()));
+}
+
+int TableBuilder::Finish()
+{
+	// The pointers must not be read before the values are.
+	if (separated_values_ > 0 && value_log_->Sync() != 0)
+	{
+		status_ = -1;
+	}
+
+	FlushDataBlock();
+	if (pending_index_entry_)
+	{
+		FindShortSuccessor(last_key_);
+		AddIndexEntry(ByteArray(last_key_.data(), last_key_.size()));
+	}
+
+	Footer footer;
+	BlockBuilder metaindex_block;
+
+	if (!key_hashes_.empty())
+	{
+		std::string filter;
+		const char* name;
+		if (options_.filter_type == FilterXor && XorFilter::CreateFilter(key_hashes_, filter))
+		{
+			name = kXorFilterBlockName;
+		}
+		else if (options_.filter_type == FilterBlockedBloom || options_.filter_type == FilterXor)
+		{
+			// Align the lines with the cache lines of the mmap'd file.
+			uint32_t padding = (BlockedBloomFilter::kLineBytes - offset_ % BlockedBloomFilter::kLineBytes) % BlockedBloomFilter::kLineBytes;
+			filter.assign(padding, 0);
+			WriteRaw(filter.data(), filter.size());
+			filter.clear();
+
+			BlockedBloomFilter(options_.bloom_bits_per_key).CreateFilter(key_hashes_, filter);
+			name = kBlockedBloomFilterBlockName;
+		}
+		else
+		{
+			BloomFilter(options_.bloom_bits_per_key).CreateFilter(key_hashes_, filter);
+			name = kBloomFilterBlockName;
+		}
+
+		WriteMetaBlock(metaindex_block, name, filter);
+		filter_size_ = filter.size();
+	}
+
+	// The metaindex is sorted by name, the filters come first.
+	TableProperties properties;
+	properties.num_entries_ = num_entries_;
+	properties.num_deletions_ = num_deletions_;
+	std::string encoded_properties;
+	properties.EncodeTo(encoded_properties);
+	WriteMetaBlock(metaindex_block, kPropertiesBlockName, encoded_properties);
+
+	if (!range_tombstones_.empty())
+	{
+		std::string contents;
+		EncodeRangeTombstones(range_tombstones_, contents);
+		WriteMetaBlock(metaindex_block, kRangeDeletionBlockName, contents);
+	}
+
+	WriteBlock(metaindex_block, footer.metaindex_handle_);
+	WriteBlock(index_block_, footer.index_handle_);
+
+	std::string encoded_footer;
+	footer.EncodeTo(encoded_footer);
+	WriteRaw(encoded_footer.data(), encoded_footer.size());
+
+	// The file must be on disk before the log or the inputs it replaces go.
+	if (file_ != nullptr && (file_->Sync() != 0 || file_->Close() != 0))
+	{
+		status_ = -1;
+	}
+
+	delete file_;
+	file_ = nullptr;
+	return status_;
+}
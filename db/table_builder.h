@@ -0,0 +1,129 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef TABLE_BUILDER_H_
+#define TABLE_BUILDER_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "block.h"
+#include "format.h"
+#include "value_log.h"
+#include "writable_file.h"
+#include "../type/byte_array.h"
+
+// Write a table file, see format.h, from entries added in key order.
+class TableBuilder
+{
+private:
+	TableOptions options_;
+	WritableFile* file_;
+	int status_;
+	uint64_t offset_;
+	uint64_t num_entries_;
+	uint64_t num_deletions_;
+	BlockBuilder data_block_;
+	BlockBuilder index_block_;
+	// The index entry of the last data block waits for the first key of the
+	// next one, so the shortest key separating them can be used.
+	bool pending_index_entry_;
+	BlockHandle pending_handle_;
+	std::string last_key_;
+	// Hashes of the keys added, turned into the filter block by Finish().
+	std::vector<uint32_t> key_hashes_;
+	uint32_t filter_size_;
+	// Bytes of the data blocks before and after compression.
+	uint64_t raw_data_size_;
+	uint64_t data_size_;
+	std::string compressed_;
+	// Optional, values are never separated without it.
+	ValueLog* value_log_;
+	uint64_t separated_values_;
+	// Type and value of the entry being added.
+	std::string value_buf_;
+	std::vector<RangeTombstone> range_tombstones_;
+
+	TableBuilder(const TableBuilder&) = delete;
+	void operator=(const TableBuilder&) = delete;
+
+	void FlushDataBlock();
+
+	void AddIndexEntry(const ByteArray& separator);
+
+	// Write the block and its trailer, compressed with type if it pays off.
+	void WriteBlock(BlockBuilder& block, BlockHandle& handle, CompressionType type = NoCompression);
+
+	void WriteRaw(const char* data, uint32_t size);
+
+	// Write contents and its checksum, and add it to the metaindex as name.
+	void WriteMetaBlock(BlockBuilder& metaindex_block, const char* name, const std::string& contents);
+
+public:
+	// Take over file, it is closed and deleted by Finish(). Values reaching
+	// options.value_log_threshold are appended to value_log if given.
+	TableBuilder(const TableOptions& options, WritableFile* file, ValueLog* value_log = nullptr);
+	~TableBuilder();
+
+	// REQUIRES: key is larger than any key added before.
+	void Add(const ByteArray& key, const ByteArray& value, ValueType type = TypeValue);
+
+	// Written to the range deletion block by Finish(). The tombstone must not
+	// cover the keys added to this file, see format.h.
+	void AddRangeDeletion(const RangeTombstone& tombstone)
+	{
+		range_tombstones_.push_back(tombstone);
+	}
+
+	// Write the index and the footer and close the file, after syncing the
+	// values appended to the value log. Return 0 on success.
+	int Finish();
+
+	// Size of the filter block, 0 if there is none.
+	uint32_t FilterSize() const
+	{
+		return filter_size_;
+	}
+
+	uint64_t RawDataSize() const
+	{
+		return raw_data_size_;
+	}
+
+	uint64_t DataSize() const
+	{
+		return data_size_;
+	}
+
+	uint64_t NumEntries() const
+	{
+		return num_entries_;
+	}
+
+	uint64_t NumDeletions() const
+	{
+		return num_deletions_;
+	}
+
+	const std::vector<RangeTombstone>& RangeDeletions() const
+	{
+		return range_tombstones_;
+	}
+
+	// Values moved to the value log by this builder.
+	uint64_t SeparatedValues() const
+	{
+		return separated_values_;
+	}
+
+	// Bytes written so far, plus the pending data block.
+	uint64_t FileSize() const
+	{
+		return offset_ + data_block_.CurrentSizeEstimate();
+	}
+};
+
+#endif  // TABLE_BUILDER_H_
@@ -0,0 +1,70 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef TABLE_ITERATOR_H_
+#define TABLE_ITERATOR_H_
+
+#include "format.h"
+#include "../type/byte_array.h"
+
+// Entries of a data file in key order, whatever its format. key() and
+// value() are valid until the iterator moves.
+class TableIterator
+{
+public:
+	virtual ~TableIterator() { }
+
+	virtual bool Valid() const = 0;
+
+	virtual void SeekToFirst() = 0;
+
+	virtual void Next() = 0;
+
+	virtual ByteArray key() const = 0;
+
+	// Without the type, a ValuePointer if type() is TypeValuePointer.
+	virtual ByteArray value() const = 0;
+
+	virtual ValueType type() const
+	{
+		return TypeValue;
+	}
+
+	// -1 if the iteration ended early on a corrupted block, 0 otherwise.
+	virtual int status() const
+	{
+		return 0;
+	}
+};
+
+// Entries of a file in neither format: none, with status -1.
+class CorruptedTableIterator : public TableIterator
+{
+public:
+	bool Valid() const override
+	{
+		return false;
+	}
+
+	void SeekToFirst() override { }
+
+	void Next() override { }
+
+	ByteArray key() const override
+	{
+		return ByteArray(nullptr, 0);
+	}
+
+	ByteArray value() const override
+	{
+		return ByteArray(nullptr, 0);
+	}
+
+	int status() const override
+	{
+		return -1;
+	}
+};
+
+#endif  // TABLE_ITERATOR_H_
@@ -0,0 +1,493 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string.h>
+
+#include "table_reader.h"
+#include "../structure/bloom_filter.h"
+#include "../structure/blocked_bloom_filter.h"
+#include "../structure/xor_filter.h"
+#include "../util/coding.h"
+#include "../util/compression.h"
+#include "../util/crc32c.h"
+#include "../util/utils.h"
+
+TableReader* TableReader::Open(const char* data, uint64_t size)
+{
+	Footer footer;
+	if (data == nullptr || footer.DecodeFrom(data, size) != 0)
+	{
+		return nullptr;
+	}
+
+	TableReader* table = new TableReader(data, size, footer);
+	table->ReadMeta();
+
+	// The index is read by every lookup, verify it once here.
+	std::string buf;
+	ByteArray contents(nullptr, 0);
+	table->index_corrupted_ = table->index_corrupted_ || !table->ReadBlock(footer.index_handle_, buf, contents);
+	return table;
+}
+
+int TableReader::FindMetaBlock(const char* name, ByteArray& contents) const
+{
+	std::string buf;
+	ByteArray metaindex_contents(nullptr, 0);
+	if (!ReadBlock(footer_.metaindex_handle_, buf, metaindex_contents))
+	{
+		return -2;
+	}
+
+	Block metaindex_block(metaindex_contents);
+	Block::Iterator it(&metaindex_block);
+	ByteArray target(name, strlen(name));
+	it.Seek(target);
+
+	BlockHandle handle;
+	if (!it.Valid() || Compare(it.key(), target) != 0)
+	{
+		return -1;
+	}
+
+	if (!DecodeHandle(it.value(), handle))
+	{
+		return -2;
+	}
+
+	// Meta blocks are raw bytes, read once when the file is opened.
+	contents = BlockContents(handle);
+	if (footer_.version_ == 1)
+	{
+		return 0;
+	}
+
+	uint32_t crc;
+	if (size_ - handle.offset_ - handle.size_ < 4)
+	{
+		return -2;
+	}
+
+	GetFixed32(data_ + handle.offset_ + handle.size_, &crc);
+	return Crc32cUnmask(crc) == Crc32cValue(contents.Data(), contents.Size()) ? 0 : -2;
+}
+
+void TableReader::ReadMeta()
+{
+	// A file without a usable filter is still read, only slower.
+	if (FindMetaBlock(kXorFilterBlockName, filter_) == 0)
+	{
+		filter_type_ = FilterXor;
+	}
+	else if (FindMetaBlock(kBlockedBloomFilterBlockName, filter_) == 0)
+	{
+		filter_type_ = FilterBlockedBloom;
+	}
+	else if (FindMetaBlock(kBloomFilterBlockName, filter_) == 0)
+	{
+		filter_type_ = FilterBloom;
+	}
+
+	// Only statistics, a file without them is read as usual.
+	ByteArray contents(nullptr, 0);
+	if (FindMetaBlock(kPropertiesBlockName, contents) == 0)
+	{
+		properties_.DecodeFrom(contents);
+	}
+
+	// Without its tombstones, the keys they delete would come back.
+	int status = FindMetaBlock(kRangeDeletionBlockName, contents);
+	if (status == -2 || (status == 0 && !DecodeRangeTombstones(contents, range_tombstones_)))
+	{
+		index_corrupted_ = true;
+	}
+}
+
+bool TableReader::KeyMayMatch(const ByteArray& key) const
+{
+	if (filter_type_ == FilterBlockedBloom)
+	{
+		return BlockedBloomFilter::KeyMayMatch(BloomFilter::KeyHash(key), filter_);
+	}
+
+	if (filter_type_ == FilterXor)
+	{
+		return XorFilter::KeyMayMatch(BloomFilter::KeyHash(key), filter_);
+	}
+
+	if (filter_type_ == FilterBloom)
+	{
+		return BloomFilter::KeyMayMatch(BloomFilter::KeyHash(key), filter_);
+	}
+
+	return true;
+}
+
+bool TableReader::DecodeHandle(const ByteArray& value, BlockHandle& handle) const
+{
+	if (handle.DecodeFrom(value.Data(), value.Data() + value.Size(), footer_.version_) == nullptr)
+	{
+		return false;
+	}
+
+	// Blocks are viewed through ByteArray, sized with 32 bits.
+	return handle.offset_ <= size_ && handle.size_ <= size_ - handle.offset_ && handle.size_ <= UINT32_MAX;
+}
+
+bool TableReader::ReadBlock(const BlockHandle& handle, std::string& buf, ByteArray& contents, bool verify_checksum) const
+{
+	contents = BlockContents(handle);
+	if (footer_.version_ == 1)
+	{
+		return true;
+	}
+
+	// The type and the checksum of the block follow its contents.
+	if (size_ - handle.offset_ - handle.size_ < kBlockTrailerSize)
+	{
+		return false;
+	}
+
+	const char* trailer = data_ + handle.offset_ + handle.size_;
+	if (verify_checksum)
+	{
+		uint32_t crc;
+		GetFixed32(trailer + 1, &crc);
+		if (Crc32cUnmask(crc) != Crc32cExtend(Crc32cValue(contents.Data(), contents.Size()), trailer, 1))
+		{
+			return false;
+		}
+	}
+
+	int type = static_cast<unsigned char>(trailer[0]);
+	if (type == NoCompression)
+	{
+		return true;
+	}
+
+	const Compressor* compressor = GetCompressor(type);
+	if (compressor == nullptr || !compressor->Uncompress(contents.Data(), contents.Size(), buf))
+	{
+		return false;
+	}
+
+	contents = ByteArray(buf.data(), buf.size());
+	return true;
+}
+
+int TableReader::Get(const ByteArray& key, std::string& value_out, bool verify_checksums, ValueType* type) const
+{
+	std::string index_buf;
+	ByteArray index_contents(nullptr, 0);
+	if (index_corrupted_ || !ReadBlock(footer_.index_handle_, index_buf, index_contents, false))
+	{
+		return -2;
+	}
+
+	Block index_block(index_contents);
+	Block::Iterator index_it(&index_block);
+	index_it.Seek(key);
+
+	BlockHandle handle;
+	std::string data_buf;
+	ByteArray data_contents(nullptr, 0);
+	if (!index_it.Valid())
+	{
+		return -1;
+	}
+
+	if (!DecodeHandle(index_it.value(), handle) || !ReadBlock(handle, data_buf, data_contents, verify_checksums))
+	{
+		return -2;
+	}
+
+	Block data_block(data_contents);
+	Block::Iterator data_it(&data_block);
+	data_it.Seek(key);
+	if (!data_it.Valid() || Compare(data_it.key(), key) != 0)
+	{
+		return -1;
+	}
+
+	ByteArray value = data_it.value();
+	ValueType value_type;
+	if (footer_.version_ == 1)
+	{
+		value_type = LegacyValueType(value);
+	}
+	else
+	{
+		if (value.Size() == 0)
+		{
+			return -2;
+		}
+
+		value_type = static_cast<ValueType>(value.Data()[0]);
+		value = ByteArray(value.Data() + 1, value.Size() - 1);
+	}
+
+	if (type != nullptr)
+	{
+		*type = value_type;
+	}
+
+	value_out.assign(value.Data(), value.Size());
+	return 0;
+}
+
+std::string TableReader::FirstKey() const
+{
+	Iterator it(this);
+	it.SeekToFirst();
+	if (!it.Valid())
+	{
+		return "";
+	}
+
+	return std::string(it.key().Data(), it.key().Size());
+}
+
+bool TableReader::Empty() const
+{
+	Iterator it(this);
+	it.SeekToFirst();
+	return !it.Valid();
+}
+
+std::string TableReader::LastKey() const
+{
+	// The index holds separators, not keys, the last one is in the last block.
+	std::string index_buf;
+	ByteArray index_contents(nullptr, 0);
+	if (!ReadBlock(footer_.index_handle_, index_buf, index_contents))
+	{
+		return "";
+	}
+
+	Block index_block(index_contents);
+	Block::Iterator index_it(&index_block);
+	index_it.SeekToLast();
+
+	BlockHandle handle;
+	std::string data_buf;
+	ByteArray data_contents(nullptr, 0);
+	if (!index_it.Valid() || !DecodeHandle(index_it.value(), handle) || !ReadBlock(handle, data_buf, data_contents))
+	{
+		return "";
+	}
+
+	Block data_block(data_contents);
+	Block::Iterator data_it(&data_block);
+	data_it.SeekToLast();
+	if (!data_it.Valid())
+	{
+		return "";
+	}
+
+	return std::string(data_it.key().Data(), data_it.key().Size());
+}
+
+TableIterator* TableReader::NewIterator() const
+{
+	return new Iterator(this);
+}
+
+TableReader::Iterator::Iterator(const TableReader* table)
+	: table_(table),
+	  index_block_(ByteArray(nullptr, 0)),
+	  index_it_(&index_block_),
+	  data_block_(ByteArray(nullptr, 0)),
+	  data_it_(&data_block_),
+	  status_(0)
+{
+	// A corrupted index leaves the iterator empty.
+	ByteArray contents(nullptr, 0);
+	if (!table_->index_corrupted_ && table_->ReadBlock(table_->footer_.index_handle_, index_buf_, contents, false))
+	{
+		index_block_ = Block(contents);
+		index_it_ = Block::Iterator(&index_block_);
+	}
+	else
+	{
+		status_ = -1;
+	}
+}
+
+void TableReader::Iterator::InitDataBlock()
+{
+	while (index_it_.Valid())
+	{
+		BlockHandle handle;
+		ByteArray contents(nullptr, 0);
+		if (!table_->DecodeHandle(index_it_.value(), handle) || !table_->ReadBlock(handle, data_buf_, contents))
+		{
+			// Malformed index or block, end the iteration.
+			index_it_ = Block::Iterator(&index_block_);
+			status_ = -1;
+			return;
+		}
+
+		data_block_ = Block(contents);
+		data_it_ = Block::Iterator(&data_block_);
+		data_it_.SeekToFirst();
+		if (data_it_.Valid())
+		{
+			return;
+		}
+
+		index_it_.Next();
+	}
+}
+
+void TableReader::Iterator::SeekToFirst()
+{
+	index_it_.SeekToFirst();
+	InitDataBlock();
+}
+
+void TableReader::Iterator::Next()
+{
+	data_it_.Next();
+	if (!data_it_.Valid())
+	{
+		index_it_.Next();
+		InitDataBlock();
+	}
+}
+
+bool IsLegacyTable(const char* data, uint64_t size)
+{
+	if (data == nullptr)
+	{
+		return false;
+	}
+
+	// Header: the lower and upper bound, then the offset of the index.
+	const char* p = data;
+	const char* limit = data + size;
+	uint32_t key_size, value_size;
+	for (int i = 0; i < 2; ++i)
+	{
+		if ((p = GetVarint32Ptr(p, limit, &key_size)) == nullptr || static_cast<uint32_t>(limit - p) < key_size)
+		{
+			return false;
+		}
+
+		p += key_size;
+	}
+
+	uint32_t index_offset;
+	if (limit - p < 4)
+	{
+		return false;
+	}
+
+	GetFixed32(p, &index_offset);
+	p += 4;
+	uint64_t first_offset = p - data;
+	if (index_offset < first_offset || index_offset > size)
+	{
+		return false;
+	}
+
+	// Entries: key_size | key | value_size | value, up to the index.
+	const char* index = data + index_offset;
+	while (p < index)
+	{
+		if ((p = GetVarint32Ptr(p, index, &key_size)) == nullptr || static_cast<uint32_t>(index - p) < key_size
+			|| (p = GetVarint32Ptr(p + key_size, index, &value_size)) == nullptr || static_cast<uint32_t>(index - p) < value_size)
+		{
+			return false;
+		}
+
+		p += value_size;
+	}
+
+	// Index: key_size | key | varint64 offset of the entry, up to the end.
+	while (p < limit)
+	{
+		uint64_t offset;
+		if ((p = GetVarint32Ptr(p, limit, &key_size)) == nullptr || static_cast<uint32_t>(limit - p) < key_size
+			|| (p = GetVarint64Ptr(p + key_size, limit, &offset)) == nullptr || offset < first_offset || offset >= index_offset)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+LegacyTableIterator::LegacyTableIterator(const char* data, uint64_t size)
+	: first_(data),
+	  limit_(data),
+	  p_(data),
+	  next_(data),
+	  key_(nullptr, 0),
+	  value_(nullptr, 0)
+{
+	// Skip the lower and upper bound, the index follows the entries.
+	const char* p = data;
+	const char* limit = data + size;
+	uint32_t key_size;
+	for (int i = 0; i < 2; ++i)
+	{
+		if ((p = GetVarint32Ptr(p, limit, &key_size)) == nullptr || static_cast<uint32_t>(limit - p) < key_size)
+		{
+			return;
+		}
+
+		p += key_size;
+	}
+
+	uint32_t index_offset;
+	if (limit - p < 4)
+	{
+		return;
+	}
+
+	GetFixed32(p, &index_offset);
+	first_ = p + 4;
+	limit_ = index_offset <= size ? data + index_offset : first_;
+	p_ = limit_;
+}
+
+void LegacyTableIterator::Parse()
+{
+	uint32_t key_size, value_size;
+	const char* p = p_;
+	if ((p = GetVarint32Ptr(p, limit_, &key_size)) == nullptr || static_cast<uint32_t>(limit_ - p) < key_size)
+	{
+		p_ = limit_;
+		return;
+	}
+
+	key_ = ByteArray(p, key_size);
+	p += key_size;
+	if ((p = GetVarint32Ptr(p, limit_, &value_size)) == nullptr || static_cast<uint32_t>(limit_ - p) < value_size)
+	{
+		p_ = limit_;
+		return;
+	}
+
+	value_ = ByteArray(p, value_size);
+	next_ = p + value_size;
+}
+
+void LegacyTableIterator::SeekToFirst()
+{
+	p_ = first_;
+	if (Valid())
+	{
+		Parse();
+	}
+}
+
+void LegacyTableIterator::Next()
+{
+	p_ = next_;
+	if (Valid())
+	{
+		Parse();
+	}
+}
@@ -0,0 +1,238 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef TABLE_READER_H_
+#define TABLE_READER_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "block.h"
+#include "format.h"
+#include "table_iterator.h"
+#include "../type/byte_array.h"
+
+// Read a table file, see format.h, in place: lookups binary search the
+// index and data blocks inside the mapped file without building anything,
+// unless the data block is compressed and has to be uncompressed first.
+class TableReader
+{
+private:
+	const char* data_;
+	uint64_t size_;
+	Footer footer_;
+	// Contents of the filter block, empty if the file has none.
+	ByteArray filter_;
+	FilterType filter_type_;
+	TableProperties properties_;
+	std::vector<RangeTombstone> range_tombstones_;
+	// The checksum of the index block or the range deletion block, verified
+	// on open, did not match. Lookups and iterators fail rather than bring
+	// deleted keys back.
+	bool index_corrupted_;
+
+	TableReader(const char* data, uint64_t size, const Footer& footer)
+		: data_(data), size_(size), footer_(footer), filter_(nullptr, 0), filter_type_(FilterNone), index_corrupted_(false) { }
+
+	// Return 0 and the contents of meta block "name" if the file has it, -1
+	// if it does not and -2 if the block is corrupted.
+	int FindMetaBlock(const char* name, ByteArray& contents) const;
+
+	// Look the meta blocks up in the metaindex block.
+	void ReadMeta();
+
+	TableReader(const TableReader&) = delete;
+	void operator=(const TableReader&) = delete;
+
+	ByteArray BlockContents(const BlockHandle& handle) const
+	{
+		return ByteArray(data_ + handle.offset_, handle.size_);
+	}
+
+	// Decode a handle stored as an index value, return false if malformed.
+	bool DecodeHandle(const ByteArray& value, BlockHandle& handle) const;
+
+	// Point contents to the block, uncompressed into buf if it has to.
+	// Return false if the block is corrupted or its codec is unknown.
+	bool ReadBlock(const BlockHandle& handle, std::string& buf, ByteArray& contents, bool verify_checksum = true) const;
+
+public:
+	class Iterator;
+
+	// Return nullptr if the file is not in the table format. data must stay
+	// mapped as long as the reader is used.
+	static TableReader* Open(const char* data, uint64_t size);
+
+	int Version() const
+	{
+		return footer_.version_;
+	}
+
+	// Return false if the filter block rules the key out. Nothing but the
+	// filter is read.
+	bool KeyMayMatch(const ByteArray& key) const;
+
+	// Return 0 and the value if the key is in the file, -1 if it is not and
+	// -2 if a block on the way is corrupted. The filter is not consulted,
+	// call KeyMayMatch() first. The value is a ValuePointer if type is set to
+	// TypeValuePointer, and the key was deleted if it is set to TypeDeletion.
+	int Get(const ByteArray& key, std::string& value_out, bool verify_checksums = true, ValueType* type = nullptr) const;
+
+	uint32_t FilterSize() const
+	{
+		return filter_.Size();
+	}
+
+	FilterType GetFilterType() const
+	{
+		return filter_type_;
+	}
+
+	// Smallest and largest keys of the file, empty if the file has none.
+	std::string FirstKey() const;
+	std::string LastKey() const;
+
+	// Return true if the file has no entries, a file may only hold range
+	// tombstones.
+	bool Empty() const;
+
+	const std::vector<RangeTombstone>& RangeDeletions() const
+	{
+		return range_tombstones_;
+	}
+
+	// Zero counts if the file has no properties block.
+	const TableProperties& Properties() const
+	{
+		return properties_;
+	}
+
+	// Return true if a tombstone of the file covers the key, which deletes
+	// it from the older files only.
+	bool RangeDeleted(const ByteArray& key) const
+	{
+		for (auto& tombstone : range_tombstones_)
+		{
+			if (tombstone.Covers(key))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	TableIterator* NewIterator() const;
+};
+
+// Walk the index block and the data blocks one after another.
+class TableReader::Iterator : public TableIterator
+{
+private:
+	const TableReader* table_;
+	std::string index_buf_;
+	Block index_block_;
+	Block::Iterator index_it_;
+	std::string data_buf_;
+	Block data_block_;
+	Block::Iterator data_it_;
+	int status_;
+
+	// Open the block index_it_ points to, and move on until an entry is found.
+	void InitDataBlock();
+
+public:
+	explicit Iterator(const TableReader* table);
+
+	bool Valid() const override
+	{
+		return index_it_.Valid() && data_it_.Valid();
+	}
+
+	void SeekToFirst() override;
+
+	void Next() override;
+
+	ByteArray key() const override
+	{
+		return data_it_.key();
+	}
+
+	ByteArray value() const override
+	{
+		ByteArray value = data_it_.value();
+		if (table_->footer_.version_ == 1 || value.Size() == 0)
+		{
+			return value;
+		}
+
+		return ByteArray(value.Data() + 1, value.Size() - 1);
+	}
+
+	ValueType type() const override
+	{
+		ByteArray value = data_it_.value();
+		if (table_->footer_.version_ == 1)
+		{
+			return LegacyValueType(value);
+		}
+
+		return value.Size() > 0 ? static_cast<ValueType>(value.Data()[0]) : TypeValue;
+	}
+
+	int status() const override
+	{
+		return status_;
+	}
+};
+
+// Return true if the size bytes at data are a whole file in the legacy
+// format: header | entries | index, each entry and index entry within its
+// part. Files in neither format are corrupted.
+bool IsLegacyTable(const char* data, uint64_t size);
+
+// Entries of a file in the legacy format: header | entries | index.
+class LegacyTableIterator : public TableIterator
+{
+private:
+	const char* first_;
+	const char* limit_;
+	const char* p_;
+	const char* next_;
+	ByteArray key_;
+	ByteArray value_;
+
+	void Parse();
+
+public:
+	LegacyTableIterator(const char* data, uint64_t size);
+
+	bool Valid() const override
+	{
+		return p_ < limit_;
+	}
+
+	void SeekToFirst() override;
+
+	void Next() override;
+
+	ByteArray key() const override
+	{
+		return key_;
+	}
+
+	ByteArray value() const override
+	{
+		return value_;
+	}
+
+	ValueType type() const override
+	{
+		return LegacyValueType(value_);
+	}
+};
+
+#endif  // TABLE_READER_H_
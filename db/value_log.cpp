@@ -0,0 +1,445 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "value_log.h"
+#include "../type/constant.h"
+#include "../util/coding.h"
+#include "../util/crc32c.h"
+
+void ValuePointer::EncodeTo(std::string& dst) const
+{
+	char buf[10 + 10 + 5];
+	char* p = EncodeVarint64(buf, file_number_);
+	p = EncodeVarint64(p, offset_);
+	p = EncodeVarint32(p, size_);
+	dst.append(buf, p - buf);
+}
+
+bool ValuePointer::DecodeFrom(const ByteArray& input)
+{
+	const char* p = input.Data();
+	const char* limit = p + input.Size();
+	if ((p = GetVarint64Ptr(p, limit, &file_number_)) == nullptr || (p = GetVarint64Ptr(p, limit, &offset_)) == nullptr)
+	{
+		return false;
+	}
+
+	p = GetVarint32Ptr(p, limit, &size_);
+	return p == limit;
+}
+
+ValueLog::ValueLog(Logger* log, uint64_t file_size, double gc_ratio)
+	: log_(log),
+	  file_size_(file_size),
+	  gc_ratio_(gc_ratio)
+{
+}
+
+ValueLog::~ValueLog()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	WriteBuffer();
+	for (auto& item : files_)
+	{
+		close(item.second.fd_);
+	}
+}
+
+std::string ValueLog::FilePath(uint64_t number)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "/%06llu.vlog", (unsigned long long)number);
+	return Constant::ValueLogFolder + buf;
+}
+
+int ValueLog::Open()
+{
+	if (access(Constant::ValueLogFolder.c_str(), 0) != 0)
+	{
+		mkdir(Constant::ValueLogFolder.c_str(), 0777);
+	}
+
+	DIR* dir;
+	struct dirent* ptr;
+	if ((dir = opendir(Constant::ValueLogFolder.c_str())) == NULL)
+	{
+		log_->Error("Opening Value Log Directory Failed: %s", strerror(errno));
+		return -1;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	uint64_t last_number = 0;
+	while ((ptr = readdir(dir)) != NULL)
+	{
+		char* end = nullptr;
+		uint64_t number = strtoull(ptr->d_name, &end, 10);
+		if (end == ptr->d_name || strcmp(end, ".vlog") != 0)
+		{
+			continue;
+		}
+
+		LogFile file;
+		struct stat statbuff;
+		file.fd_ = open(FilePath(number).c_str(), O_RDONLY);
+		if (file.fd_ < 0 || fstat(file.fd_, &statbuff) < 0)
+		{
+			log_->Error("Opening Value Log File %llu Failed: %s", (unsigned long long)number, strerror(errno));
+			if (file.fd_ >= 0)
+			{
+				close(file.fd_);
+			}
+
+			closedir(dir);
+			return -1;
+		}
+
+		file.size_ = statbuff.st_size;
+		file.discarded_ = 0;
+		files_[number] = file;
+		last_number = std::max(last_number, number);
+	}
+
+	closedir(dir);
+
+	log_->Info("Reading %d Value Log Files.", (int)files_.size());
+	return OpenHead(last_number + 1);
+}
+
+int ValueLog::OpenHead(uint64_t number)
+{
+	if (head_number_ != 0)
+	{
+		if (WriteBuffer() != 0 || fdatasync(files_[head_number_].fd_) != 0)
+		{
+			log_->Error("Syncing Value Log File %llu Failed: %s", (unsigned long long)head_number_, strerror(errno));
+			return -1;
+		}
+	}
+
+	LogFile file;
+	file.fd_ = open(FilePath(number).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file.fd_ < 0)
+	{
+		log_->Error("Creating Value Log File %llu Failed: %s", (unsigned long long)number, strerror(errno));
+		return -1;
+	}
+
+	file.size_ = 0;
+	file.discarded_ = 0;
+	files_[number] = file;
+	head_number_ = number;
+	log_->Info("Value Log File %llu Created.", (unsigned long long)number);
+	return 0;
+}
+
+int ValueLog::WriteBuffer()
+{
+	if (buffer_.empty() || head_number_ == 0)
+	{
+		return 0;
+	}
+
+	LogFile& head = files_[head_number_];
+	const char* p = buffer_.data();
+	size_t left = buffer_.size();
+	off_t offset = head.size_ - buffer_.size();
+	while (left > 0)
+	{
+		ssize_t n = pwrite(head.fd_, p, left, offset);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			log_->Error("Writing Value Log File %llu Failed: %s", (unsigned long long)head_number_, strerror(errno));
+			return -1;
+		}
+
+		p += n;
+		left -= n;
+		offset += n;
+	}
+
+	buffer_.clear();
+	return 0;
+}
+
+int ValueLog::Add(const ByteArray& key, const ByteArray& value, ValuePointer& pointer)
+{
+	std::string record(4, 0);
+	char buf[5];
+	record.append(buf, EncodeVarint32(buf, key.Size()) - buf);
+	record.append(key.Data(), key.Size());
+	record.append(buf, EncodeVarint32(buf, value.Size()) - buf);
+	record.append(value.Data(), value.Size());
+	EncodeFixed32(&record[0], Crc32cMask(Crc32cValue(record.data() + 4, record.size() - 4)));
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (head_number_ == 0)
+	{
+		return -1;
+	}
+
+	LogFile& head = files_[head_number_];
+	pointer.file_number_ = head_number_;
+	pointer.offset_ = head.size_;
+	pointer.size_ = record.size();
+
+	buffer_.append(record);
+	head.size_ += record.size();
+	if (head.size_ >= file_size_)
+	{
+		return OpenHead(head_number_ + 1);
+	}
+
+	if (buffer_.size() >= kMaxBufferSize)
+	{
+		return WriteBuffer();
+	}
+
+	return 0;
+}
+
+int ValueLog::Sync()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (head_number_ == 0)
+	{
+		return -1;
+	}
+
+	if (WriteBuffer() != 0 || fdatasync(files_[head_number_].fd_) != 0)
+	{
+		log_->Error("Syncing Value Log File %llu Failed: %s", (unsigned long long)head_number_, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+namespace
+{
+
+// Parse the record at p, return false if it is corrupted.
+bool ParseRecord(const char* p, uint32_t size, ValueLog::Record& record)
+{
+	const char* limit = p + size;
+	uint32_t crc, key_size, value_size;
+	if (size < 4)
+	{
+		return false;
+	}
+
+	GetFixed32(p, &crc);
+	if (Crc32cUnmask(crc) != Crc32cValue(p + 4, size - 4))
+	{
+		return false;
+	}
+
+	p += 4;
+	if ((p = GetVarint32Ptr(p, limit, &key_size)) == nullptr || static_cast<uint32_t>(limit - p) < key_size)
+	{
+		return false;
+	}
+
+	record.key_ = ByteArray(p, key_size);
+	p += key_size;
+	if ((p = GetVarint32Ptr(p, limit, &value_size)) == nullptr || static_cast<uint32_t>(limit - p) != value_size)
+	{
+		return false;
+	}
+
+	record.value_ = ByteArray(p, value_size);
+	return true;
+}
+
+// Read size bytes at offset of fd into buf.
+bool ReadFully(int fd, uint64_t offset, uint64_t size, char* buf)
+{
+	uint64_t read_size = 0;
+	while (read_size < size)
+	{
+		ssize_t n = pread(fd, buf + read_size, size - read_size, offset + read_size);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (n <= 0)
+		{
+			return false;
+		}
+
+		read_size += n;
+	}
+
+	return true;
+}
+
+}  // namespace
+
+int ValueLog::Get(const ValuePointer& pointer, std::string& value_out)
+{
+	rw_lock_.ReadLock();
+
+	int fd = -1;
+	mutex_.lock();
+	auto it = files_.find(pointer.file_number_);
+	if (it != files_.end() && pointer.offset_ + pointer.size_ <= it->second.size_ - (pointer.file_number_ == head_number_ ? buffer_.size() : 0))
+	{
+		fd = it->second.fd_;
+	}
+
+	mutex_.unlock();
+
+	std::string buf(pointer.size_, 0);
+	Record record;
+	bool ok = fd >= 0 && ReadFully(fd, pointer.offset_, pointer.size_, &buf[0]) && ParseRecord(buf.data(), buf.size(), record);
+	rw_lock_.ReadUnlock();
+
+	if (!ok)
+	{
+		log_->Error("Reading Value Log File %llu at Offset %llu Failed.", (unsigned long long)pointer.file_number_, (unsigned long long)pointer.offset_);
+		return -1;
+	}
+
+	value_out.assign(record.value_.Data(), record.value_.Size());
+	return 0;
+}
+
+void ValueLog::Discard(const ValuePointer& pointer)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	auto it = files_.find(pointer.file_number_);
+	if (it != files_.end())
+	{
+		it->second.discarded_ += pointer.size_;
+	}
+}
+
+uint64_t ValueLog::PickGarbageFile()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	uint64_t picked = 0;
+	double picked_ratio = gc_ratio_;
+	for (auto& item : files_)
+	{
+		if (item.first == head_number_ || item.second.size_ == 0)
+		{
+			continue;
+		}
+
+		double ratio = (double)item.second.discarded_ / item.second.size_;
+		if (ratio >= picked_ratio)
+		{
+			picked = item.first;
+			picked_ratio = ratio;
+		}
+	}
+
+	return picked;
+}
+
+int ValueLog::ReadFile(uint64_t number, std::string& buf, std::vector<Record>& records)
+{
+	rw_lock_.ReadLock();
+
+	int fd = -1;
+	uint64_t size = 0;
+	mutex_.lock();
+	auto it = files_.find(number);
+	if (it != files_.end() && number != head_number_)
+	{
+		fd = it->second.fd_;
+		size = it->second.size_;
+	}
+
+	mutex_.unlock();
+
+	buf.resize(size);
+	bool ok = fd >= 0 && ReadFully(fd, 0, size, &buf[0]);
+	rw_lock_.ReadUnlock();
+
+	if (!ok)
+	{
+		log_->Error("Reading Value Log File %llu Failed.", (unsigned long long)number);
+		return -1;
+	}
+
+	const char* p = buf.data();
+	const char* limit = p + buf.size();
+	while (limit - p > 4)
+	{
+		// The size of a record is not stored, it is parsed to find the next one.
+		uint32_t key_size, value_size;
+		const char* q = GetVarint32Ptr(p + 4, limit, &key_size);
+		if (q == nullptr || static_cast<uint32_t>(limit - q) < key_size
+			|| (q = GetVarint32Ptr(q + key_size, limit, &value_size)) == nullptr || static_cast<uint32_t>(limit - q) < value_size)
+		{
+			log_->Warn("Dropping Torn Record at Offset %llu of Value Log File %llu.", (unsigned long long)(p - buf.data()), (unsigned long long)number);
+			break;
+		}
+
+		Record record;
+		uint32_t record_size = q + value_size - p;
+		if (ParseRecord(p, record_size, record))
+		{
+			record.pointer_.file_number_ = number;
+			record.pointer_.offset_ = p - buf.data();
+			record.pointer_.size_ = record_size;
+			records.push_back(record);
+		}
+		else
+		{
+			log_->Warn("Skipping Corrupted Record at Offset %llu of Value Log File %llu.", (unsigned long long)(p - buf.data()), (unsigned long long)number);
+		}
+
+		p += record_size;
+	}
+
+	return 0;
+}
+
+void ValueLog::RemoveFile(uint64_t number)
+{
+	rw_lock_.WriteLock();
+	mutex_.lock();
+	auto it = files_.find(number);
+	if (it != files_.end() && number != head_number_)
+	{
+		close(it->second.fd_);
+		files_.erase(it);
+		if (remove(FilePath(number).c_str()) != 0)
+		{
+			log_->Error("Removing Value Log File %llu Failed: %s", (unsigned long long)number, strerror(errno));
+		}
+	}
+
+	mutex_.unlock();
+	rw_lock_.WriteUnlock();
+}
+
+uint64_t ValueLog::TotalSize()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	uint64_t total = 0;
+	for (auto& item : files_)
+	{
+		total += item.second.size_;
+	}
+
+	return total;
+}
@@ -0,0 +1,148 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef VALUE_LOG_H_
+#define VALUE_LOG_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "../type/byte_array.h"
+#include "../util/logger.h"
+#include "../structure/read_write_lock.h"
+
+// Location of a record in the value log.
+struct ValuePointer
+{
+	uint64_t file_number_ = 0;
+	uint64_t offset_ = 0;
+	uint32_t size_ = 0;
+
+	// varint64 file_number | varint64 offset | varint32 size
+	void EncodeTo(std::string& dst) const;
+
+	// Return false if input is not exactly one pointer.
+	bool DecodeFrom(const ByteArray& input);
+
+	bool operator==(const ValuePointer& other) const
+	{
+		return file_number_ == other.file_number_ && offset_ == other.offset_ && size_ == other.size_;
+	}
+};
+
+// Values kept out of the tables, see TableOptions::value_log_threshold. A
+// table entry of type TypeValuePointer holds a ValuePointer to a record here
+// instead of the value, so compaction moves the pointer and never the value.
+//
+// The log is split into numbered files under Constant::ValueLogFolder and only
+// the newest one is appended to.
+//
+// Record format: fixed32 masked crc | varint32 key_size | key |
+//                varint32 value_size | value
+// The crc covers everything after it. The key lets garbage collection find
+// the table entry pointing to the record.
+//
+// Records of keys overwritten or deleted stay in place. Compaction reports the
+// pointers it drops through Discard(), and a file whose discarded share
+// reaches gc_ratio is collected by DataBase::CollectValueLogGarbage(). The
+// counts are kept in memory only, garbage dropped before a restart is found
+// again when the file is collected for other reasons.
+class ValueLog
+{
+public:
+	struct Record
+	{
+		ByteArray key_;
+		ByteArray value_;
+		ValuePointer pointer_;
+
+		Record() : key_(nullptr, 0), value_(nullptr, 0) { }
+	};
+
+private:
+	struct LogFile
+	{
+		int fd_;
+		uint64_t size_;
+		uint64_t discarded_;
+	};
+
+	// Appended records are written out once this many bytes are pending.
+	const uint32_t kMaxBufferSize = 1 << 20;
+
+	Logger* log_;
+	uint64_t file_size_;
+	double gc_ratio_;
+
+	// Protects files_, the head file and buffer_.
+	std::mutex mutex_;
+	std::map<uint64_t, LogFile> files_;
+	uint64_t head_number_ = 0;
+	// Records appended to the head file and not written yet.
+	std::string buffer_;
+
+	// Held by readers of the files, and by RemoveFile() to close one.
+	ReadWriteLock rw_lock_;
+
+	ValueLog(const ValueLog&) = delete;
+	void operator=(const ValueLog&) = delete;
+
+	std::string FilePath(uint64_t number);
+
+	// Write buffer_ to the head file.
+	// REQUIRES: mutex_ held.
+	int WriteBuffer();
+
+	// Sync the head file and start file "number".
+	// REQUIRES: mutex_ held.
+	int OpenHead(uint64_t number);
+
+public:
+	ValueLog(Logger* log, uint64_t file_size = 64 << 20, double gc_ratio = 0.5);
+	~ValueLog();
+
+	// Open the files in the log folder and start a new head file after them.
+	// Return -1 if one of them cannot be opened, its values would be lost.
+	int Open();
+
+	// Append a record and return its pointer. The value cannot be read before
+	// Sync() returns.
+	int Add(const ByteArray& key, const ByteArray& value, ValuePointer& pointer);
+
+	// Write the appended records and sync them. Return 0 on success.
+	int Sync();
+
+	// Read the value of the record at pointer. Return -1 if it is missing or
+	// corrupted.
+	int Get(const ValuePointer& pointer, std::string& value_out);
+
+	// Count the record at pointer as garbage.
+	void Discard(const ValuePointer& pointer);
+
+	// Number of the file with the largest share of garbage, if it reaches
+	// gc_ratio, 0 otherwise. The head file is never picked.
+	uint64_t PickGarbageFile();
+
+	// Load file "number" into buf and parse its records. A torn record at the
+	// end is dropped.
+	int ReadFile(uint64_t number, std::string& buf, std::vector<Record>& records);
+
+	// Close and delete file "number".
+	void RemoveFile(uint64_t number);
+
+	int FilesNumber()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		return files_.size();
+	}
+
+	// Bytes in all the files, garbage included.
+	uint64_t TotalSize();
+};
+
+#endif  // VALUE_LOG_H_
@@ -0,0 +1,121 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef VERSION_H_
+#define VERSION_H_
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "file.h"
+
+// The files of every level at one point in time, sorted by LowerBound()
+// within a level. A version never changes once built, the storage engine
+// installs a new one for every flush and compaction.
+//
+// A version holds a reference on each of its files, and whoever reads the
+// files holds a reference on the version, so a file replaced by a compaction
+// is only unmapped, and removed from disk, once no reader can reach it.
+class Version
+{
+private:
+	std::map<int, std::vector<File*>> level_files_;
+	std::atomic<int> refs_;
+
+	Version(const Version&) = delete;
+	void operator=(const Version&) = delete;
+
+	~Version()
+	{
+		for (auto& item : level_files_)
+		{
+			for (auto& file : item.second)
+			{
+				file->Unref();
+			}
+		}
+	}
+
+public:
+	// Start with one reference, held by the caller.
+	explicit Version(const std::map<int, std::vector<File*>>& level_files)
+		: level_files_(level_files),
+		  refs_(1)
+	{
+		for (auto& item : level_files_)
+		{
+			for (auto& file : item.second)
+			{
+				file->Ref();
+			}
+		}
+	}
+
+	void Ref()
+	{
+		refs_.fetch_add(1);
+	}
+
+	// Delete the version with the last reference.
+	void Unref()
+	{
+		if (refs_.fetch_sub(1) == 1)
+		{
+			delete this;
+		}
+	}
+
+	const std::map<int, std::vector<File*>>& LevelFiles() const
+	{
+		return level_files_;
+	}
+
+	int LevelFilesNumber(int level_id) const
+	{
+		auto it = level_files_.find(level_id);
+		return it == level_files_.end() ? 0 : it->second.size();
+	}
+
+	// Deepest level holding files, 0 if there is none.
+	int LastLevel() const
+	{
+		for (auto it = level_files_.rbegin(); it != level_files_.rend(); ++it)
+		{
+			if (!it->second.empty())
+			{
+				return it->first;
+			}
+		}
+
+		return 0;
+	}
+
+	// Files possible to contain key, one list per level from level 0 down,
+	// newest first within a level.
+	void GetContainsFiles(const std::string& key, std::vector<std::vector<File*>>& contains_files) const
+	{
+		for (auto& item : level_files_)
+		{
+			std::vector<File*> tmp;
+			size_t i = 0;
+			while (i < item.second.size() && key >= item.second[i]->LowerBound())
+			{
+				if (key <= item.second[i]->UpperBound())
+				{
+					tmp.push_back(item.second[i]);
+				}
+
+				i++;
+			}
+
+			std::sort(tmp.begin(), tmp.end(), [](const File* f1, const File* f2) { return f1->FileId() > f2->FileId(); });
+			contains_files.push_back(tmp);
+		}
+	}
+};
+
+#endif  // VERSION_H_
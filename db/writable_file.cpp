@@ -0,0 +1,224 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "writable_file.h"
+
+namespace {
+
+// Buffers of the closed files, at most kMaxPooledBuffers of them are kept.
+const size_t kMaxPooledBuffers = 16;
+std::mutex pool_mutex;
+std::vector<char*> pool;
+
+char* AcquireBuffer()
+{
+	{
+		std::unique_lock<std::mutex> lock(pool_mutex);
+		if (!pool.empty())
+		{
+			char* buffer = pool.back();
+			pool.pop_back();
+			return buffer;
+		}
+	}
+
+	void* buffer = nullptr;
+	if (posix_memalign(&buffer, WritableFile::kAlignment, WritableFile::kBufferSize) != 0)
+	{
+		return nullptr;
+	}
+
+	return static_cast<char*>(buffer);
+}
+
+void ReleaseBuffer(char* buffer)
+{
+	{
+		std::unique_lock<std::mutex> lock(pool_mutex);
+		if (pool.size() < kMaxPooledBuffers)
+		{
+			pool.push_back(buffer);
+			return;
+		}
+	}
+
+	free(buffer);
+}
+
+}  // namespace
+
+WritableFile* WritableFile::Open(const std::string& path, uint64_t preallocate_size, uint64_t bytes_per_sync)
+{
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		return nullptr;
+	}
+
+	WritableFile* file = new WritableFile(fd, preallocate_size, bytes_per_sync);
+	if (file->buffer_ == nullptr)
+	{
+		delete file;
+		return nullptr;
+	}
+
+	return file;
+}
+
+WritableFile::WritableFile(int fd, uint64_t preallocate_size, uint64_t bytes_per_sync)
+	: fd_(fd),
+	  buffer_(AcquireBuffer()),
+	  buffer_used_(0),
+	  file_offset_(0),
+	  preallocated_size_(0),
+	  bytes_per_sync_(bytes_per_sync),
+	  synced_offset_(0),
+	  status_(0)
+{
+#ifdef __linux__
+	// Only a hint, the file grows as usual where it is not supported.
+	if (preallocate_size > 0 && fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, preallocate_size) == 0)
+	{
+		preallocated_size_ = preallocate_size;
+	}
+#endif
+}
+
+WritableFile::~WritableFile()
+{
+	if (fd_ >= 0)
+	{
+		Close();
+	}
+
+	if (buffer_ != nullptr)
+	{
+		ReleaseBuffer(buffer_);
+	}
+}
+
+int WritableFile::Append(const char* data, size_t size)
+{
+	if (status_ != 0)
+	{
+		return status_;
+	}
+
+	while (size > 0)
+	{
+		// Nothing to gather, write large pieces straight from the caller.
+		if (buffer_used_ == 0 && size >= kBufferSize)
+		{
+			return WriteUnbuffered(data, size);
+		}
+
+		size_t n = std::min(size, kBufferSize - buffer_used_);
+		memcpy(buffer_ + buffer_used_, data, n);
+		buffer_used_ += n;
+		data += n;
+		size -= n;
+
+		if (buffer_used_ == kBufferSize && Flush() != 0)
+		{
+			return status_;
+		}
+	}
+
+	return 0;
+}
+
+int WritableFile::Flush()
+{
+	if (status_ == 0 && buffer_used_ > 0)
+	{
+		size_t size = buffer_used_;
+		buffer_used_ = 0;
+		WriteUnbuffered(buffer_, size);
+	}
+
+	return status_;
+}
+
+int WritableFile::WriteUnbuffered(const char* data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t n = write(fd_, data, size);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			status_ = -1;
+			return status_;
+		}
+
+		data += n;
+		size -= n;
+		file_offset_ += n;
+	}
+
+	RangeSync();
+	return status_;
+}
+
+void WritableFile::RangeSync()
+{
+#ifdef __linux__
+	if (bytes_per_sync_ == 0 || file_offset_ - synced_offset_ < bytes_per_sync_)
+	{
+		return;
+	}
+
+	// Only starts the writeback, nothing waits for it here.
+	if (sync_file_range(fd_, synced_offset_, file_offset_ - synced_offset_, SYNC_FILE_RANGE_WRITE) == 0)
+	{
+		synced_offset_ = file_offset_;
+	}
+#endif
+}
+
+int WritableFile::Sync()
+{
+	if (Flush() == 0 && fdatasync(fd_) != 0)
+	{
+		status_ = -1;
+	}
+
+	return status_;
+}
+
+int WritableFile::Close()
+{
+	if (fd_ < 0)
+	{
+		return status_;
+	}
+
+	Flush();
+	if (status_ == 0 && preallocated_size_ > file_offset_ && ftruncate(fd_, file_offset_) != 0)
+	{
+		status_ = -1;
+	}
+
+	if (close(fd_) != 0)
+	{
+		status_ = -1;
+	}
+
+	fd_ = -1;
+	return status_;
+}
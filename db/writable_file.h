@@ -0,0 +1,80 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef WRITABLE_FILE_H_
+#define WRITABLE_FILE_H_
+
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sequential writer of table files.
+//
+// Appends are gathered in a large page aligned buffer and written with one
+// write() whenever it fills up, so building a file costs a system call per
+// kBufferSize bytes instead of a libc call per entry. The buffers are kept
+// in a pool when a file is closed and taken again by the next one.
+//
+// The file can be given its expected size up front, which lets the file
+// system allocate it in one extent. With bytes_per_sync set, the writeback of
+// every bytes_per_sync bytes written is started right away, so the page cache
+// does not build up a whole file of dirty pages to be written in one burst.
+class WritableFile
+{
+private:
+	int fd_;
+	char* buffer_;
+	size_t buffer_used_;
+	// Bytes written to the file, not counting the buffer.
+	uint64_t file_offset_;
+	uint64_t preallocated_size_;
+	uint64_t bytes_per_sync_;
+	uint64_t synced_offset_;
+	int status_;
+
+	WritableFile(int fd, uint64_t preallocate_size, uint64_t bytes_per_sync);
+
+	WritableFile(const WritableFile&) = delete;
+	void operator=(const WritableFile&) = delete;
+
+	int WriteUnbuffered(const char* data, size_t size);
+
+	// Start the writeback of the bytes written since the last call, once
+	// there are bytes_per_sync_ of them.
+	void RangeSync();
+
+public:
+	static const size_t kBufferSize = 1 << 20;
+	static const size_t kAlignment = 4096;
+
+	// Create or truncate the file at path. Space for preallocate_size bytes
+	// is reserved if the file system supports it, the size of the file is
+	// still what has been appended. Return nullptr on failure.
+	static WritableFile* Open(const std::string& path, uint64_t preallocate_size = 0, uint64_t bytes_per_sync = 0);
+
+	// Close the file if Close() was not called.
+	~WritableFile();
+
+	// Return 0 on success. Once an append fails, the following ones fail too.
+	int Append(const char* data, size_t size);
+
+	// Write the buffer to the file.
+	int Flush();
+
+	// Flush and fdatasync the file.
+	int Sync();
+
+	// Flush and close the file, releasing the space reserved past its end.
+	// Return 0 if every write succeeded.
+	int Close();
+
+	// Bytes appended so far.
+	uint64_t Size() const
+	{
+		return file_offset_ + buffer_used_;
+	}
+};
+
+#endif  // WRITABLE_FILE_H_
@@ -0,0 +1,432 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "write_ahead_log.h"
+#include "../type/constant.h"
+#include "../util/coding.h"
+#include "../util/crc32c.h"
+#include "../util/utils.h"
+
+WriteAheadLog::WriteAheadLog(Logger* log, SyncPolicy sync_policy, int sync_interval_ms, uint32_t segment_size)
+	: log_(log),
+	  sync_policy_(sync_policy),
+	  sync_interval_ms_(sync_interval_ms),
+	  segment_size_(segment_size),
+	  last_sync_(std::chrono::steady_clock::now())
+{
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+	Close();
+}
+
+std::string WriteAheadLog::SegmentPath(uint64_t number)
+{
+	return Constant::LogFolder + std::string("/") + LogFileName(number);
+}
+
+int WriteAheadLog::Open()
+{
+	if (access(Constant::LogFolder.c_str(), 0) != 0)
+	{
+		mkdir(Constant::LogFolder.c_str(), 0777);
+	}
+
+	std::vector<uint64_t> segments = Segments();
+	uint64_t number = segments.empty() ? 1 : segments.back() + 1;
+
+	std::unique_lock<std::mutex> lock(file_mutex_);
+	int status = OpenSegment(number);
+	if (sync_policy_ == SyncInterval && !sync_thread_.joinable())
+	{
+		stop_sync_ = false;
+		sync_thread_ = std::thread(&WriteAheadLog::SyncLoop, this);
+	}
+
+	return status;
+}
+
+void WriteAheadLog::SyncLoop()
+{
+	std::unique_lock<std::mutex> lock(file_mutex_);
+	while (!stop_sync_)
+	{
+		sync_cv_.wait_for(lock, std::chrono::milliseconds(std::max(sync_interval_ms_, 1)));
+
+		// A leader that wrote in the meantime may have synced already.
+		auto now = std::chrono::steady_clock::now();
+		if (stop_sync_ || !unsynced_ || fd_ < 0
+			|| std::chrono::duration_cast<std::chrono::milliseconds>(now - last_sync_).count() < sync_interval_ms_)
+		{
+			continue;
+		}
+
+		if (fdatasync(fd_) != 0)
+		{
+			log_->Error("Syncing Log Segment %llu Failed: %s", (unsigned long long)segment_number_, strerror(errno));
+			continue;
+		}
+
+		unsynced_ = false;
+		last_sync_ = now;
+	}
+}
+
+int WriteAheadLog::OpenSegment(uint64_t number)
+{
+	if (fd_ >= 0)
+	{
+		if (sync_policy_ != SyncNone && fdatasync(fd_) != 0)
+		{
+			log_->Error("Syncing Log Segment %llu Failed: %s", (unsigned long long)segment_number_, strerror(errno));
+		}
+
+		close(fd_);
+	}
+
+	unsynced_ = false;
+	segment_number_ = number;
+	segment_offset_ = 0;
+	fd_ = open(SegmentPath(number).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd_ < 0)
+	{
+		log_->Error("Creating Log Segment %llu Failed: %s", (unsigned long long)number, strerror(errno));
+		return -1;
+	}
+
+	char header[8];
+	EncodeFixed32(header, 0);
+	EncodeFixed32(header + 4, kLogFormatVersion);
+	if (write(fd_, header, sizeof(header)) != sizeof(header))
+	{
+		log_->Error("Writing Log Segment %llu Header Failed: %s", (unsigned long long)number, strerror(errno));
+		close(fd_);
+		fd_ = -1;
+		return -1;
+	}
+
+	segment_offset_ = sizeof(header);
+	log_->Info("Log Segment %llu Created.", (unsigned long long)number);
+	return 0;
+}
+
+int WriteAheadLog::AddRecord(const ByteArray& record, const std::function<void()>& apply)
+{
+	Writer w(record, apply);
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	writers_.push_back(&w);
+	while (!w.done_ && &w != writers_.front())
+	{
+		w.cv_.wait(lock);
+	}
+
+	if (w.done_)
+	{
+		return w.status_;
+	}
+
+	// This writer is the leader now, take the queued records as one group.
+	batch_.clear();
+	std::vector<Writer*> group;
+	char header[8];
+	for (auto writer : writers_)
+	{
+		if (writer != &w && batch_.size() + writer->record_.Size() > kMaxBatchSize)
+		{
+			break;
+		}
+
+		EncodeFixed32(header, Crc32cMask(Crc32cValue(writer->record_.Data(), writer->record_.Size())));
+		EncodeFixed32(header + 4, writer->record_.Size());
+		batch_.append(header, sizeof(header));
+		batch_.append(writer->record_.Data(), writer->record_.Size());
+		group.push_back(writer);
+	}
+
+	// Followers keep queueing while the group is being written and applied,
+	// the next leader waits until this group is popped.
+	lock.unlock();
+	int status = WriteBatch();
+	if (status == 0)
+	{
+		for (auto writer : group)
+		{
+			if (writer->apply_)
+			{
+				writer->apply_();
+			}
+		}
+	}
+
+	lock.lock();
+	Writer* last = group.back();
+
+	while (true)
+	{
+		Writer* ready = writers_.front();
+		writers_.pop_front();
+		if (ready != &w)
+		{
+			ready->status_ = status;
+			ready->done_ = true;
+			ready->cv_.notify_one();
+		}
+
+		if (ready == last)
+		{
+			break;
+		}
+	}
+
+	if (!writers_.empty())
+	{
+		writers_.front()->cv_.notify_one();
+	}
+
+	return status;
+}
+
+int WriteAheadLog::WriteBatch()
+{
+	std::unique_lock<std::mutex> lock(file_mutex_);
+	if (fd_ < 0)
+	{
+		return -1;
+	}
+
+	const char* p = batch_.data();
+	size_t left = batch_.size();
+	while (left > 0)
+	{
+		ssize_t n = write(fd_, p, left);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			log_->Error("Writing Log Segment %llu Failed: %s", (unsigned long long)segment_number_, strerror(errno));
+			return -1;
+		}
+
+		p += n;
+		left -= n;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	bool need_sync = (sync_policy_ == SyncEveryBatch) ||
+		(sync_policy_ == SyncInterval &&
+		 std::chrono::duration_cast<std::chrono::milliseconds>(now - last_sync_).count() >= sync_interval_ms_);
+
+	if (need_sync)
+	{
+		if (fdatasync(fd_) != 0)
+		{
+			log_->Error("Syncing Log Segment %llu Failed: %s", (unsigned long long)segment_number_, strerror(errno));
+			return -1;
+		}
+
+		last_sync_ = now;
+	}
+
+	unsynced_ = !need_sync;
+
+	segment_offset_ += batch_.size();
+	if (segment_offset_ >= segment_size_)
+	{
+		OpenSegment(segment_number_ + 1);
+	}
+
+	return 0;
+}
+
+uint64_t WriteAheadLog::NewSegment()
+{
+	std::unique_lock<std::mutex> lock(file_mutex_);
+	OpenSegment(segment_number_ + 1);
+	return segment_number_;
+}
+
+void WriteAheadLog::RemoveSegmentsBefore(uint64_t number)
+{
+	for (auto segment : Segments())
+	{
+		if (segment >= number)
+		{
+			break;
+		}
+
+		if (remove(SegmentPath(segment).c_str()) != 0)
+		{
+			log_->Error("Removing Log Segment %llu Failed: %s", (unsigned long long)segment, strerror(errno));
+		}
+	}
+}
+
+std::vector<uint64_t> WriteAheadLog::Segments()
+{
+	std::vector<uint64_t> segments;
+
+	DIR* dir;
+	struct dirent* ptr;
+	if ((dir = opendir(Constant::LogFolder.c_str())) == NULL)
+	{
+		return segments;
+	}
+
+	while ((ptr = readdir(dir)) != NULL)
+	{
+		char* end = nullptr;
+		uint64_t number = strtoull(ptr->d_name, &end, 10);
+		if (end != ptr->d_name && strcmp(end, ".log") == 0)
+		{
+			segments.push_back(number);
+		}
+	}
+
+	closedir(dir);
+
+	std::sort(segments.begin(), segments.end());
+	return segments;
+}
+
+int WriteAheadLog::ReadSegment(uint64_t number, Memory* memory, std::vector<const char*>& entries)
+{
+	int fd = open(SegmentPath(number).c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		log_->Error("Opening Log Segment %llu Failed: %s", (unsigned long long)number, strerror(errno));
+		return -1;
+	}
+
+	struct stat statbuff;
+	if (fstat(fd, &statbuff) < 0)
+	{
+		log_->Error("Acquiring Log Segment %llu Size Failed: %s", (unsigned long long)number, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	uint32_t size = statbuff.st_size;
+	if (size == 0)
+	{
+		close(fd);
+		return 0;
+	}
+
+	char* buf = memory->Allocate(size);
+	uint32_t read_size = 0;
+	while (read_size < size)
+	{
+		ssize_t n = pread(fd, buf + read_size, size - read_size, read_size);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (n <= 0)
+		{
+			log_->Error("Reading Log Segment %llu Failed: %s", (unsigned long long)number, strerror(errno));
+			close(fd);
+			return -1;
+		}
+
+		read_size += n;
+	}
+
+	close(fd);
+
+	if (size < 8)
+	{
+		log_->Warn("Dropping Torn Header of Log Segment %llu.", (unsigned long long)number);
+		return 1;
+	}
+
+	uint32_t head, version;
+	GetFixed32(buf, &head);
+	GetFixed32(buf + 4, &version);
+	if (head != 0 || version != kLogFormatVersion)
+	{
+		log_->Error("Log Segment %llu Has an Unknown Header.", (unsigned long long)number);
+		return -1;
+	}
+
+	const char* p = buf + 8;
+	const char* limit = buf + size;
+	while (p < limit)
+	{
+		uint32_t left = limit - p;
+		uint32_t masked_crc = 0;
+		uint32_t record_size = 0;
+		if (left >= 8)
+		{
+			GetFixed32(p, &masked_crc);
+			GetFixed32(p + 4, &record_size);
+		}
+
+		if (left < 8 || record_size > left - 8)
+		{
+			log_->Warn("Dropping Torn Record at Offset %d of Log Segment %llu.", (int)(p - buf), (unsigned long long)number);
+			return 1;
+		}
+
+		// Replay stops at a bad record, the ones after it are not trusted.
+		if (Crc32cUnmask(masked_crc) != Crc32cValue(p + 8, record_size))
+		{
+			log_->Error("Dropping Corrupted Record at Offset %d of Log Segment %llu.", (int)(p - buf), (unsigned long long)number);
+			return 1;
+		}
+
+		p += 8;
+		const char* record_limit = p + record_size;
+		while (p < record_limit)
+		{
+			entries.push_back(p);
+			p += EntrySize(p);
+		}
+
+		p = record_limit;
+	}
+
+	return 0;
+}
+
+void WriteAheadLog::Close()
+{
+	std::unique_lock<std::mutex> lock(file_mutex_);
+	stop_sync_ = true;
+	sync_cv_.notify_all();
+	lock.unlock();
+	if (sync_thread_.joinable())
+	{
+		sync_thread_.join();
+	}
+
+	lock.lock();
+	if (fd_ < 0)
+	{
+		return;
+	}
+
+	if (sync_policy_ != SyncNone && fdatasync(fd_) != 0)
+	{
+		log_->Error("Syncing Log Segment %llu Failed: %s", (unsigned long long)segment_number_, strerror(errno));
+	}
+
+	close(fd_);
+	fd_ = -1;
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef WRITE_AHEAD_LOG_H_
+#define WRITE_AHEAD_LOG_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+#include "../type/byte_array.h"
+#include "../structure/memory.h"
+#include "../util/logger.h"
+
+// Write-ahead log of the records applied to the income buffer.
+//
+// The log is split into numbered segment files under Constant::LogFolder.
+// A segment is closed when it grows past segment_size, so the records of one
+// income buffer are spread over several segments that can be replayed in
+// parallel.
+//
+// Concurrent writers are committed in groups: the writer at the head of the
+// queue becomes the leader, appends the records of every queued writer with a
+// single write() and at most one fdatasync(), applies the records of the
+// group in log order, then wakes the followers up.
+//
+// Segment format: fixed32 0 | fixed32 version | record*
+// Record format: fixed32 masked_crc | fixed32 payload_size | payload
+// The payload is one or more entries encoded the same way as in the buffer,
+// the crc is the masked crc32c of the payload.
+class WriteAheadLog
+{
+public:
+	enum SyncPolicy
+	{
+		SyncNone = 0,		// Leave the data in the page cache.
+		SyncInterval = 1,	// fdatasync at most once every sync_interval_ms, and
+							// within about two intervals of the last write.
+		SyncEveryBatch = 2,	// fdatasync every committed group.
+	};
+
+private:
+	struct Writer
+	{
+		ByteArray record_;
+		const std::function<void()>& apply_;
+		bool done_;
+		int status_;
+		std::condition_variable cv_;
+
+		Writer(const ByteArray& record, const std::function<void()>& apply) : record_(record), apply_(apply), done_(false), status_(0) { }
+	};
+
+	// Upper bound of a committed group, the leader's own record is always taken.
+	const uint32_t kMaxBatchSize = 1 << 20;
+
+	// Version of the segments written and read.
+	const uint32_t kLogFormatVersion = 3;
+
+	Logger* log_;
+	SyncPolicy sync_policy_;
+	int sync_interval_ms_;
+	uint32_t segment_size_;
+
+	// Protects writers_.
+	std::mutex mutex_;
+	std::deque<Writer*> writers_;
+	std::string batch_;
+
+	// Serializes the leader's write with segment switching.
+	std::mutex file_mutex_;
+	int fd_ = -1;
+	uint64_t segment_number_ = 0;
+	uint32_t segment_offset_ = 0;
+	std::chrono::steady_clock::time_point last_sync_;
+	// Records written since the last fdatasync.
+	bool unsynced_ = false;
+
+	// SyncInterval only: syncs the tail of a burst once the writers are idle.
+	std::thread sync_thread_;
+	std::condition_variable sync_cv_;
+	bool stop_sync_ = false;
+
+	WriteAheadLog(const WriteAheadLog&) = delete;
+	void operator=(const WriteAheadLog&) = delete;
+
+	// Write batch_ to the current segment and sync it according to the policy.
+	int WriteBatch();
+
+	// Sync the records left unsynced for sync_interval_ms_, until Close().
+	void SyncLoop();
+
+	// Close the current segment and create segment "number".
+	// REQUIRES: file_mutex_ held.
+	int OpenSegment(uint64_t number);
+
+	std::string SegmentPath(uint64_t number);
+
+public:
+	WriteAheadLog(Logger* log, SyncPolicy sync_policy, int sync_interval_ms = 0, uint32_t segment_size = 1 << 20);
+	~WriteAheadLog();
+
+	// Start a new segment after the ones already in the log folder.
+	int Open();
+
+	// Append record to the log, blocking until its group is committed.
+	// apply, if given, is called once the group is written, in the order of
+	// the records, so concurrent writers apply their records in log order.
+	// It is not called if writing fails. Return 0 on success.
+	int AddRecord(const ByteArray& record, const std::function<void()>& apply = nullptr);
+
+	// Switch to a new segment and return its number. Records appended from now
+	// on never share a segment with the ones appended before.
+	uint64_t NewSegment();
+
+	// Delete the segments older than "number".
+	void RemoveSegmentsBefore(uint64_t number);
+
+	// Numbers of the segments in the log folder, in ascending order.
+	std::vector<uint64_t> Segments();
+
+	// Load segment "number" into memory and append its entries in log order.
+	// Return 1 if reading stopped at a torn or corrupted record, whose entries
+	// and the ones after it are dropped, -1 if the segment cannot be read.
+	int ReadSegment(uint64_t number, Memory* memory, std::vector<const char*>& entries);
+
+	uint64_t SegmentNumber()
+	{
+		std::unique_lock<std::mutex> lock(file_mutex_);
+		return segment_number_;
+	}
+
+	// Sync and close the current segment.
+	void Close();
+};
+
+#endif  // WRITE_AHEAD_LOG_H_
@@ -0,0 +1,18 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include "write_batch.h"
+#include "../util/utils.h"
+
+void WriteBatch::Put(const ByteArray& key, const ByteArray& value)
+{
+	AppendEntry(rep_, key, value);
+	++count_;
+}
+
+void WriteBatch::Delete(const ByteArray& key)
+{
+	AppendEntry(rep_, key, ByteArray("", 0), TypeDeletion);
+	++count_;
+}
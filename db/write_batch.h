@@ -0,0 +1,53 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef WRITE_BATCH_H_
+#define WRITE_BATCH_H_
+
+#include <string>
+
+#include <stdint.h>
+
+#include "../type/byte_array.h"
+
+// Put and Delete operations collected to be applied together by
+// DataBase::Write.
+//
+// The operations are kept as entries encoded the same way as in the buffer
+// and the write-ahead log, so the batch is logged as a single record and
+// copied into the buffer with a single allocation. A later operation on a
+// key overrides an earlier one in the same batch.
+class WriteBatch
+{
+private:
+	std::string rep_;
+	uint32_t count_ = 0;
+
+public:
+	WriteBatch() { }
+	~WriteBatch() { }
+
+	void Put(const ByteArray& key, const ByteArray& value);
+
+	void Delete(const ByteArray& key);
+
+	void Clear()
+	{
+		rep_.clear();
+		count_ = 0;
+	}
+
+	uint32_t Count() const
+	{
+		return count_;
+	}
+
+	// The encoded entries.
+	ByteArray Data() const
+	{
+		return ByteArray(rep_.data(), rep_.size());
+	}
+};
+
+#endif  // WRITE_BATCH_H_
@@ -0,0 +1,78 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "write_controller.h"
+
+WriteController::WriteController(StorageBuffer* storage_buffer, StorageEngine* storage_engine, Logger* log, int immutable_slowdown_trigger, int level0_slowdown_trigger, int level0_stop_trigger, int delay_micros)
+	: storage_buffer_(storage_buffer),
+	  storage_engine_(storage_engine),
+	  log_(log),
+	  immutable_slowdown_trigger_(immutable_slowdown_trigger),
+	  level0_slowdown_trigger_(level0_slowdown_trigger),
+	  level0_stop_trigger_(level0_stop_trigger),
+	  delay_micros_(delay_micros),
+	  slowdown_count_(0),
+	  slowdown_micros_(0),
+	  stall_count_(0),
+	  stall_micros_(0)
+{
+}
+
+bool WriteController::NeedStall(int& immutable_buffers, int& level0_files)
+{
+	immutable_buffers = storage_buffer_->ImmutableBuffersNumber();
+	level0_files = storage_engine_->LevelFilesNumber(0);
+	return (immutable_buffers >= storage_buffer_->MaxImmutableBuffers() && storage_buffer_->IncomeBufferFull())
+		|| level0_files >= level0_stop_trigger_;
+}
+
+void WriteController::Throttle()
+{
+	int immutable_buffers, level0_files;
+	if (NeedStall(immutable_buffers, level0_files))
+	{
+		log_->Warn("Write Stall: %d Immutable Buffers, %d Level 0 Files.", immutable_buffers, level0_files);
+		auto start = std::chrono::steady_clock::now();
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (!is_stop_ && NeedStall(immutable_buffers, level0_files))
+		{
+			// Signal() normally wakes us up, the timeout only guards against
+			// a backlog that drained without one.
+			cv_.wait_for(lock, std::chrono::milliseconds(10));
+		}
+
+		lock.unlock();
+
+		auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		stall_count_.fetch_add(1, std::memory_order_relaxed);
+		stall_micros_.fetch_add(cost, std::memory_order_relaxed);
+		return;
+	}
+
+	int over = std::max(immutable_buffers - immutable_slowdown_trigger_ + 1, level0_files - level0_slowdown_trigger_ + 1);
+	if (over > 0)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(delay_micros_ * over));
+		slowdown_count_.fetch_add(1, std::memory_order_relaxed);
+		slowdown_micros_.fetch_add(delay_micros_ * over, std::memory_order_relaxed);
+	}
+}
+
+void WriteController::Signal()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	cv_.notify_all();
+}
+
+void WriteController::Stop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	is_stop_ = true;
+	cv_.notify_all();
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef WRITE_CONTROLLER_H_
+#define WRITE_CONTROLLER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include <stdint.h>
+
+#include "storage_buffer.h"
+#include "storage_engine.h"
+#include "../util/logger.h"
+
+// Holds writers back when flushing or level 0 compaction falls behind.
+//
+// Once the immutable buffers or the level 0 files reach their slowdown
+// trigger, every write is delayed by delay_micros for each buffer or file at
+// or past the trigger, so latency grows gradually with the backlog. A write
+// is stalled until the backlog drains when the immutable buffer queue and
+// the income buffer are both full, or the level 0 files reach their stop
+// trigger. Buffered memory then stays around (max immutable buffers + 1)
+// buffer sizes instead of growing without bound.
+class WriteController
+{
+private:
+	StorageBuffer* storage_buffer_;
+	StorageEngine* storage_engine_;
+	Logger* log_;
+	int immutable_slowdown_trigger_;
+	int level0_slowdown_trigger_;
+	int level0_stop_trigger_;
+	int delay_micros_;
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool is_stop_ = false;
+
+	std::atomic<uint64_t> slowdown_count_;
+	std::atomic<uint64_t> slowdown_micros_;
+	std::atomic<uint64_t> stall_count_;
+	std::atomic<uint64_t> stall_micros_;
+
+	WriteController(const WriteController&) = delete;
+	void operator=(const WriteController&) = delete;
+
+	bool NeedStall(int& immutable_buffers, int& level0_files);
+
+public:
+	WriteController(StorageBuffer* storage_buffer, StorageEngine* storage_engine, Logger* log, int immutable_slowdown_trigger, int level0_slowdown_trigger, int level0_stop_trigger, int delay_micros = 1000);
+
+	// Delay or stall the calling writer according to the backlog, called
+	// before every write.
+	void Throttle();
+
+	// Let the stalled writers check the backlog again, called when a flush or
+	// a compaction ends.
+	void Signal();
+
+	// Release the stalled writers for good.
+	void Stop();
+
+	// Writes delayed, and the time they spent delayed.
+	uint64_t SlowdownCount() { return slowdown_count_.load(std::memory_order_relaxed); }
+	uint64_t SlowdownMicros() { return slowdown_micros_.load(std::memory_order_relaxed); }
+
+	// Writes stalled, and the time they spent stalled.
+	uint64_t StallCount() { return stall_count_.load(std::memory_order_relaxed); }
+	uint64_t StallMicros() { return stall_micros_.load(std::memory_order_relaxed); }
+};
+
+#endif  // WRITE_CONTROLLER_H_
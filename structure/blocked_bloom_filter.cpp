@@ -0,0 +1,164 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLOCKED_BLOOM_HAVE_AVX2 1
+#endif
+
+#include "blocked_bloom_filter.h"
+
+namespace
+{
+
+const uint32_t kSalts[BlockedBloomFilter::kNumProbes] = {
+	0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+	0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+uint32_t LineIndex(uint32_t hash, uint32_t num_lines)
+{
+	return (static_cast<uint64_t>(hash) * num_lines) >> 32;
+}
+
+// The line index consumes the high bits of hash, the probes get a remix.
+uint32_t ProbeHash(uint32_t hash)
+{
+	return ((hash << 16) | (hash >> 16)) * 0x9e3779b1U;
+}
+
+// Return the number of lines, 0 if the filter is not of this kind.
+uint32_t NumLines(const ByteArray& filter)
+{
+	if (filter.Size() < BlockedBloomFilter::kLineBytes + 1 ||
+		static_cast<unsigned char>(filter.Data()[filter.Size() - 1]) != BlockedBloomFilter::kMarker)
+	{
+		return 0;
+	}
+
+	return (filter.Size() - 1) / BlockedBloomFilter::kLineBytes;
+}
+
+bool DetectAvx2()
+{
+#if defined(BLOCKED_BLOOM_HAVE_AVX2)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+const bool kHasAvx2 = DetectAvx2();
+
+}  // namespace
+
+void BlockedBloomFilter::CreateFilter(const std::vector<uint32_t>& hashes, std::string& dst) const
+{
+	uint32_t bits = hashes.size() * bits_per_key_;
+	uint32_t num_lines = (bits + kLineBytes * 8 - 1) / (kLineBytes * 8);
+	if (num_lines == 0)
+	{
+		num_lines = 1;
+	}
+
+	size_t init_size = dst.size();
+	dst.resize(init_size + num_lines * kLineBytes, 0);
+	dst.push_back(static_cast<char>(kMarker));
+	char* array = &dst[init_size];
+	for (auto hash : hashes)
+	{
+		char* line = array + LineIndex(hash, num_lines) * kLineBytes;
+		uint32_t h = ProbeHash(hash);
+		for (int i = 0; i < kNumProbes; ++i)
+		{
+			uint32_t product = h * kSalts[i];
+			uint32_t word_index = 2 * i + ((product >> 26) & 1);
+			uint32_t word;
+			memcpy(&word, line + word_index * 4, 4);
+			word |= 1U << (product >> 27);
+			memcpy(line + word_index * 4, &word, 4);
+		}
+	}
+}
+
+bool BlockedBloomFilter::KeyMayMatch(uint32_t hash, const ByteArray& filter)
+{
+	return kHasAvx2 ? KeyMayMatchAvx2(hash, filter) : KeyMayMatchScalar(hash, filter);
+}
+
+bool BlockedBloomFilter::KeyMayMatchScalar(uint32_t hash, const ByteArray& filter)
+{
+	uint32_t num_lines = NumLines(filter);
+	if (num_lines == 0)
+	{
+		return true;
+	}
+
+	const char* line = filter.Data() + LineIndex(hash, num_lines) * kLineBytes;
+	uint32_t h = ProbeHash(hash);
+
+	// The probes share one line, checking them all without branching is
+	// cheaper than mispredicting an early exit.
+	uint32_t missing = 0;
+	for (int i = 0; i < kNumProbes; ++i)
+	{
+		uint32_t product = h * kSalts[i];
+		uint32_t word_index = 2 * i + ((product >> 26) & 1);
+		uint32_t word;
+		memcpy(&word, line + word_index * 4, 4);
+		missing |= ~word & (1U << (product >> 27));
+	}
+
+	return missing == 0;
+}
+
+bool BlockedBloomFilter::HasAvx2()
+{
+	return kHasAvx2;
+}
+
+#if defined(BLOCKED_BLOOM_HAVE_AVX2)
+
+__attribute__((target("avx2")))
+bool BlockedBloomFilter::KeyMayMatchAvx2(uint32_t hash, const ByteArray& filter)
+{
+	uint32_t num_lines = NumLines(filter);
+	if (num_lines == 0)
+	{
+		return true;
+	}
+
+	const char* line = filter.Data() + LineIndex(hash, num_lines) * kLineBytes;
+
+	// One lane per probe: the product gives the bit and the word of the pair.
+	__m256i products = _mm256_mullo_epi32(_mm256_set1_epi32(ProbeHash(hash)),
+		_mm256_loadu_si256(reinterpret_cast<const __m256i*>(kSalts)));
+	__m256i masks = _mm256_sllv_epi32(_mm256_set1_epi32(1), _mm256_srli_epi32(products, 27));
+	__m256i odd = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_srli_epi32(products, 26), _mm256_set1_epi32(1)),
+		_mm256_set1_epi32(1));
+
+	// Probe i owns words 2i and 2i + 1, deinterleave them into even and odd.
+	__m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line));
+	__m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + 32));
+	__m256i even_words = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(
+		_mm256_castsi256_ps(lo), _mm256_castsi256_ps(hi), _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0));
+	__m256i odd_words = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(
+		_mm256_castsi256_ps(lo), _mm256_castsi256_ps(hi), _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0));
+	__m256i words = _mm256_blendv_epi8(even_words, odd_words, odd);
+
+	// Every probed bit must be set: masks & ~words == 0.
+	return _mm256_testc_si256(words, masks) != 0;
+}
+
+#else
+
+bool BlockedBloomFilter::KeyMayMatchAvx2(uint32_t hash, const ByteArray& filter)
+{
+	return KeyMayMatchScalar(hash, filter);
+}
+
+#endif
@@ -0,0 +1,54 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef BLOCKED_BLOOM_FILTER_H_
+#define BLOCKED_BLOOM_FILTER_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "../type/byte_array.h"
+
+// Bloom filter whose probes for a key all land in one 64-byte cache line, so a
+// lookup costs a single cache miss whatever the number of probes.
+//
+// Filter format: line[num_lines] | uint8 kMarker
+//
+// A line is 16 32-bit words. The line is chosen by the key hash, then each of
+// the kNumProbes probes multiplies a remix of the hash by its own odd salt:
+// the top 5 bits of the product pick the bit and the next one picks the word
+// out of the pair 2 * probe, 2 * probe + 1. The eight probes are independent,
+// so the AVX2 kernel computes and checks them in one pass over the line.
+class BlockedBloomFilter
+{
+private:
+	int bits_per_key_;
+
+public:
+	enum { kLineBytes = 64 };
+	enum { kLineWords = kLineBytes / 4 };
+	enum { kNumProbes = 8 };
+	// Last byte of the filter, distinguishes it from other encodings.
+	enum { kMarker = 0x80 | kNumProbes };
+
+	explicit BlockedBloomFilter(int bits_per_key) : bits_per_key_(bits_per_key) { }
+
+	// Append the filter of the keys with the given hashes to dst.
+	void CreateFilter(const std::vector<uint32_t>& hashes, std::string& dst) const;
+
+	// Return false only if the key with the given hash was not in the filter.
+	// Uses the AVX2 kernel when the CPU has it.
+	static bool KeyMayMatch(uint32_t hash, const ByteArray& filter);
+
+	// The kernels behind KeyMayMatch(), exposed for benchmarks and tests.
+	static bool KeyMayMatchScalar(uint32_t hash, const ByteArray& filter);
+	static bool KeyMayMatchAvx2(uint32_t hash, const ByteArray& filter);
+
+	// True if KeyMayMatch() runs the AVX2 kernel.
+	static bool HasAvx2();
+};
+
+#endif  // BLOCKED_BLOOM_FILTER_H_
@@ -0,0 +1,113 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef BLOOM_FILTER_H_
+#define BLOOM_FILTER_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "../type/byte_array.h"
+#include "../util/hash.h"
+
+// Bloom filter built once over the keys of a table file and stored in its
+// filter block.
+//
+// Filter format: bit array | uint8 num_probes
+//
+// The probes of a key are derived from a single hash by double hashing, and
+// num_probes is kept with the bits so filters built with other settings stay
+// readable.
+class BloomFilter
+{
+private:
+	int bits_per_key_;
+	int num_probes_;
+
+public:
+	explicit BloomFilter(int bits_per_key) : bits_per_key_(bits_per_key)
+	{
+		// bits_per_key * ln(2) minimizes the false positive rate.
+		num_probes_ = static_cast<int>(bits_per_key * 0.69);
+		if (num_probes_ < 1)
+		{
+			num_probes_ = 1;
+		}
+
+		if (num_probes_ > 30)
+		{
+			num_probes_ = 30;
+		}
+	}
+
+	static uint32_t KeyHash(const ByteArray& key)
+	{
+		return Hash(key.Data(), key.Size(), 0xbc9f1d34);
+	}
+
+	// Append the filter of the keys with the given hashes to dst.
+	void CreateFilter(const std::vector<uint32_t>& hashes, std::string& dst) const
+	{
+		// Tiny filters have a high false positive rate, use 64 bits at least.
+		uint32_t bits = hashes.size() * bits_per_key_;
+		if (bits < 64)
+		{
+			bits = 64;
+		}
+
+		uint32_t bytes = (bits + 7) / 8;
+		bits = bytes * 8;
+
+		size_t init_size = dst.size();
+		dst.resize(init_size + bytes, 0);
+		dst.push_back(static_cast<char>(num_probes_));
+		char* array = &dst[init_size];
+		for (auto hash : hashes)
+		{
+			uint32_t delta = (hash >> 17) | (hash << 15);
+			for (int j = 0; j < num_probes_; ++j)
+			{
+				uint32_t bitpos = hash % bits;
+				array[bitpos / 8] |= (1 << (bitpos % 8));
+				hash += delta;
+			}
+		}
+	}
+
+	// Return false only if the key with the given hash was not in the filter.
+	static bool KeyMayMatch(uint32_t hash, const ByteArray& filter)
+	{
+		if (filter.Size() < 2)
+		{
+			return true;
+		}
+
+		const char* array = filter.Data();
+		uint32_t bits = (filter.Size() - 1) * 8;
+		int num_probes = static_cast<unsigned char>(array[filter.Size() - 1]);
+		if (num_probes > 30)
+		{
+			// Reserved for other filter encodings, consider it a match.
+			return true;
+		}
+
+		uint32_t delta = (hash >> 17) | (hash << 15);
+		for (int j = 0; j < num_probes; ++j)
+		{
+			uint32_t bitpos = hash % bits;
+			if ((array[bitpos / 8] & (1 << (bitpos % 8))) == 0)
+			{
+				return false;
+			}
+
+			hash += delta;
+		}
+
+		return true;
+	}
+};
+
+#endif  // BLOOM_FILTER_H_
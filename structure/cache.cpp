@@ -40,9 +40,9 @@ void LRUCache::Clear()
 	tail->prev = head;
 }
 
-uint32_t LRUCache::Get(int key, std::string& key_str, bool& if_exists)
+uint64_t LRUCache::Get(int key, std::string& key_str, bool& if_exists)
 {
-	uint32_t offset = 0;
+	uint64_t offset = 0;
 	if_exists = false;
 	mutex_.lock();
 	if(m.find(key) != m.end())
@@ -61,7 +61,7 @@ uint32_t LRUCache::Get(int key, std::string& key_str, bool& if_exists)
 	return offset;
 }
 
-void LRUCache::Set(int key, std::unordered_map<std::string, uint32_t>& value)
+void LRUCache::Set(int key, std::unordered_map<std::string, uint64_t>& value)
 {
 	mutex_.lock();
 	if(m.find(key) == m.end())
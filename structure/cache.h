@@ -15,7 +15,7 @@
 struct LRUCacheNode
 {
 	int key;
-	std::unordered_map<std::string, uint32_t> value;
+	std::unordered_map<std::string, uint64_t> value;
 	LRUCacheNode* prev;
 	LRUCacheNode* next;
 	LRUCacheNode() : key(0), prev(nullptr), next(nullptr) { }
@@ -38,8 +38,8 @@ private:
 public:
 	LRUCache(int capacity);
 	~LRUCache();
-	uint32_t Get(int key, std::string& key_str, bool& if_exists);
-	void Set(int key, std::unordered_map<std::string, uint32_t>& value);
+	uint64_t Get(int key, std::string& key_str, bool& if_exists);
+	void Set(int key, std::unordered_map<std::string, uint64_t>& value);
 	void Clear();	
 
 private:
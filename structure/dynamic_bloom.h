@@ -0,0 +1,100 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef DYNAMIC_BLOOM_H_
+#define DYNAMIC_BLOOM_H_
+
+#include <atomic>
+#include <new>
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+// Bloom filter that keys can be added to concurrently while it is queried,
+// sized up front since the number of keys is not known in advance.
+//
+// All the probes of a key fall in the same cache line, so a lookup costs a
+// single cache miss. The line is chosen by the high bits of the hash and the
+// bits inside it by double hashing on the low bits.
+class DynamicBloom
+{
+private:
+	enum { kLineBits = 512 };
+	enum { kLineWords = kLineBits / 64 };
+
+	uint32_t num_lines_;
+	int num_probes_;
+	std::atomic<uint64_t>* data_;
+
+	DynamicBloom(const DynamicBloom&) = delete;
+	void operator=(const DynamicBloom&) = delete;
+
+	std::atomic<uint64_t>* Line(uint32_t hash) const
+	{
+		return data_ + ((static_cast<uint64_t>(hash) * num_lines_) >> 32) * kLineWords;
+	}
+
+public:
+	// The filter lives in memory and is released with it.
+	DynamicBloom(Memory* memory, uint32_t total_bits, int num_probes = 6)
+		: num_lines_((total_bits + kLineBits - 1) / kLineBits),
+		  num_probes_(num_probes)
+	{
+		if (num_lines_ == 0)
+		{
+			num_lines_ = 1;
+		}
+
+		char* raw = memory->AllocateAligned(num_lines_ * kLineBits / 8, kLineBits / 8);
+		data_ = reinterpret_cast<std::atomic<uint64_t>*>(raw);
+		for (uint32_t i = 0; i < num_lines_ * kLineWords; ++i)
+		{
+			new (&data_[i]) std::atomic<uint64_t>(0);
+		}
+	}
+
+	// Thread safe.
+	void Add(uint32_t hash)
+	{
+		std::atomic<uint64_t>* line = Line(hash);
+		uint32_t h = hash;
+		const uint32_t delta = (h >> 17) | (h << 15);
+		for (int i = 0; i < num_probes_; ++i)
+		{
+			const uint32_t bit = h % kLineBits;
+			const uint64_t mask = static_cast<uint64_t>(1) << (bit % 64);
+			// Skip the atomic read-modify-write when the bit is already set.
+			if ((line[bit / 64].load(std::memory_order_relaxed) & mask) == 0)
+			{
+				line[bit / 64].fetch_or(mask, std::memory_order_relaxed);
+			}
+
+			h += delta;
+		}
+	}
+
+	// False positives are possible, false negatives are not.
+	bool MayContain(uint32_t hash) const
+	{
+		const std::atomic<uint64_t>* line = Line(hash);
+		uint32_t h = hash;
+		const uint32_t delta = (h >> 17) | (h << 15);
+		for (int i = 0; i < num_probes_; ++i)
+		{
+			const uint32_t bit = h % kLineBits;
+			if ((line[bit / 64].load(std::memory_order_relaxed) & (static_cast<uint64_t>(1) << (bit % 64))) == 0)
+			{
+				return false;
+			}
+
+			h += delta;
+		}
+
+		return true;
+	}
+};
+
+#endif  // DYNAMIC_BLOOM_H_
@@ -16,15 +16,21 @@
 char* Memory::Allocate(int bytes)
 {
 	assert(bytes > 0);
+	char* result;
+	lock_.Lock();
 	if (bytes <= alloc_bytes_remaining_)
 	{
-		char* result = alloc_ptr_;
+		result = alloc_ptr_;
 		alloc_ptr_ += bytes;
 		alloc_bytes_remaining_ -= bytes;
-		return result;
+	}
+	else
+	{
+		result = AllocateFallback(bytes);
 	}
 
-	return AllocateFallback(bytes);
+	lock_.Unlock();
+	return result;
 }
 
 char* Memory::AllocateFallback(int bytes)
@@ -45,15 +51,15 @@ char* Memory::AllocateFallback(int bytes)
 char* Memory::AllocateNewBlock(int block_bytes)
 {
 	char* result = new char[block_bytes];
-	blocks_memory_ += block_bytes;
+	blocks_memory_.fetch_add(block_bytes + sizeof(char*), std::memory_order_relaxed);
 	blocks_.push_back(result);
 	return result;
 }
 
-char* Memory::AllocateAligned(int bytes) 
+char* Memory::AllocateAligned(int bytes, int align)
 {
-	const int align = sizeof(void*);
 	assert((align & (align - 1)) == 0);
+	lock_.Lock();
 	int current_mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (align - 1);
 	int slop = (current_mod == 0 ? 0 : align - current_mod);
 	int needed = bytes + slop;
@@ -66,9 +72,13 @@ char* Memory::AllocateAligned(int bytes)
 	}
 	else
 	{
-		result = AllocateFallback(bytes);
+		// Blocks are only aligned to what new guarantees, leave room to round up.
+		result = AllocateFallback(bytes + align - 1);
+		result = reinterpret_cast<char*>(
+			(reinterpret_cast<uintptr_t>(result) + align - 1) & ~static_cast<uintptr_t>(align - 1));
 	}
 
+	lock_.Unlock();
 	assert((reinterpret_cast<uintptr_t>(result) & (align - 1)) == 0);
 	return result;
 }
@@ -12,10 +12,13 @@
 #ifndef MEMORY_H_
 #define MEMORY_H_
 
+#include <atomic>
 #include <vector>
 
 #include <stdint.h>
 
+#include "spin_lock.h"
+
 class Memory
 {
 private:
@@ -25,7 +28,11 @@ private:
 	int alloc_bytes_remaining_;
 
 	std::vector<char*> blocks_;
-	int blocks_memory_;
+	std::atomic<int> blocks_memory_;
+
+	// Allocation is safe to call from several threads, the critical section
+	// is just a pointer bump in the common case.
+	SpinLock lock_;
 
 	Memory(const Memory&) = delete;
 	void operator=(const Memory&) = delete;
@@ -37,12 +44,14 @@ public:
 	Memory();
 	~Memory();
 
+	// Thread safe.
 	char* Allocate(int bytes);
-	char* AllocateAligned(int bytes);
+	// Thread safe. align must be a power of two.
+	char* AllocateAligned(int bytes, int align = sizeof(void*));
 	
 	int MemoryUsage() const
 	{
-		return blocks_memory_ + blocks_.capacity() * sizeof(char*);
+		return blocks_memory_.load(std::memory_order_relaxed);
 	}
 };
 
@@ -0,0 +1,73 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef RCU_H_
+#define RCU_H_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Read-copy-update guard for objects that are read far more often than they
+// are replaced. Readers enter and leave a read-side section with two atomic
+// operations and never block. A writer unpublishes an object, calls
+// Synchronize() to wait for every reader that may still see it, and then
+// frees it.
+class Rcu
+{
+private:
+	std::atomic<int> epoch_;
+	std::atomic<int> readers_[2];
+
+	// Serializes writers.
+	std::mutex mutex_;
+
+	Rcu(const Rcu&) = delete;
+	void operator=(const Rcu&) = delete;
+
+public:
+	Rcu() : epoch_(0)
+	{
+		readers_[0] = 0;
+		readers_[1] = 0;
+	}
+
+	// Return the epoch to hand back to ReadUnlock.
+	int ReadLock()
+	{
+		while (true)
+		{
+			int epoch = epoch_.load();
+			readers_[epoch].fetch_add(1);
+			if (epoch_.load() == epoch)
+			{
+				return epoch;
+			}
+
+			// A writer flipped the epoch in between, join the new one.
+			readers_[epoch].fetch_sub(1);
+		}
+	}
+
+	void ReadUnlock(int epoch)
+	{
+		readers_[epoch].fetch_sub(1);
+	}
+
+	// Wait until all the readers entered before this call have left. Readers
+	// entering from now on count against the other epoch, so this never
+	// waits for them.
+	void Synchronize()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		int epoch = epoch_.load();
+		epoch_.store(1 - epoch);
+		while (readers_[epoch].load() != 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+};
+
+#endif  // RCU_H_
@@ -12,6 +12,30 @@
 #ifndef SKIP_LIST_H_
 #define SKIP_LIST_H_
 
+// Thread safety
+// -------------
+//
+// Insert can be called from several threads at once, nodes are linked level
+// by level with a compare-and-swap on the predecessor's next pointer. Readers
+// need no synchronization at all, they may only miss the nodes that are being
+// linked concurrently. Nodes are never deleted until the SkipList is.
+//
+// Node layout
+// -----------
+//
+// Every node keeps the first 8 bytes of its key, normalized so that integer
+// order is bytewise order, and the key size right before its next_ tower.
+// Comparisons are settled on these fields whenever the prefixes differ, or
+// when both keys fit in the prefix, without touching the entry itself. The
+// comparator provides the prefix through
+//   uint64_t Prefix(const Key& key, uint32_t* size) const;
+// and can turn the shortcut off by returning 0 with a size above 8.
+// Nodes are cache line aligned, so a search step loads a single line.
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
 #include <assert.h>
 
 #include "random.h"
@@ -23,52 +47,81 @@ class SkipList
 private:
 	struct Node;
 	
-	enum { kMaxHeight = 12 };
+	enum { kMaxHeightLimit = 32 };
+	enum { kCacheLineSize = 64 };
+
+	// Search key with its prefix, computed once per search.
+	struct SearchKey
+	{
+		Key key_;
+		uint64_t prefix_;
+		uint32_t size_;
+	};
 
 	Comparator const compare_;
 
+	// Height of the tallest node and the inverse probability of growing one
+	// level higher.
+	const int height_limit_;
+	const int branching_;
+
 	Memory* const memory_;
 
 	Node* const head_;
 
-	Random rand_;
+	// Height of the entire list, only ever grows.
+	std::atomic<int> max_height_;
 
-	int max_height_ = 1;
-
-	Node* NewNode(const Key& key, int height);
+	Node* NewNode(const SearchKey& key, int height);
 	int RandomHeight();
-	bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
+
+	SearchKey MakeSearchKey(const Key& key) const
+	{
+		SearchKey search_key;
+		search_key.key_ = key;
+		search_key.prefix_ = compare_.Prefix(key, &search_key.size_);
+		return search_key;
+	}
+
+	// Compare the key of "n" with key, on the inline prefix when it is enough.
+	int CompareNode(Node* n, const SearchKey& key) const;
 	
 	// Return true if key is greater than the data stored in "n"	
-	bool KeyIsAfterNode(const Key& key, Node* n) const;
+	bool KeyIsAfterNode(const SearchKey& key, Node* n) const;
 	
 	// Return the earliest node that comes at or after key.
 	// Return nullptr if there is no such node.
 	//
 	// If prev is non-null, fills prev[level] with pointer to previous
 	// node at "level" for every level in [0..max_height - 1].
-	Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
+	Node* FindGreaterOrEqual(const SearchKey& key, Node** prev) const;
 
-	Node* FindLessThan(const Key& key) const;
+	Node* FindLessThan(const SearchKey& key) const;
 
 	Node* FindLast() const;
 
+	// Starting from "before", find the nodes surrounding key on "level".
+	void FindSpliceForLevel(const SearchKey& key, Node* before, int level, Node** out_prev, Node** out_next) const;
+
 	SkipList(const SkipList&);
 	void operator=(const SkipList&);
 
 	inline int GetMaxHeight() const 
 	{
-		return max_height_;
+		return max_height_.load(std::memory_order_relaxed);
 	}
 
 public:
 	// Create a new SkipList object that will use "cmp" for comparing keys,
 	// and will allocate memory using "memory". Objects allocated in the memory
 	// must remain allocated for the lifetime of the skiplist object.
-	SkipList(Comparator cmp, Memory* memory);
+	//
+	// Large tables want a higher max_height, or a larger branching to trade
+	// search steps for memory.
+	SkipList(Comparator cmp, Memory* memory, int max_height = 12, int branching = 4);
 
-	// Insert key into the list
-	// REQUIRES: nothing that compares equal to key is currently in the list.
+	// Insert key into the list, replacing the entry that compares equal to it.
+	// Safe to call concurrently with other Insert calls and with readers.
 	void Insert(const Key& key);
 
 	// Returns true if an entry that compares equal to key is in the list.
@@ -81,7 +134,7 @@ public:
 
 		bool Valid() const;
 
-		const Key& key() const;
+		Key key() const;
 
 		void Next();
 
@@ -100,13 +153,16 @@ public:
 };
 
 template<typename Key, class Comparator>
-SkipList<Key,Comparator>::SkipList(Comparator cmp, Memory* memory)
-    : head_(NewNode("00000", kMaxHeight)),
-	  compare_(cmp),
+SkipList<Key,Comparator>::SkipList(Comparator cmp, Memory* memory, int max_height, int branching)
+    : compare_(cmp),
+      height_limit_(max_height),
+      branching_(branching),
 	  memory_(memory),
-      max_height_(1),
-      rand_(0xdeadbeef) {
-  for (int i = 0; i < kMaxHeight; i++) {
+      head_(NewNode(SearchKey{Key(), 0, 0}, max_height)),
+      max_height_(1) {
+  assert(max_height > 0 && max_height <= kMaxHeightLimit);
+  assert(branching > 1);
+  for (int i = 0; i < height_limit_; i++) {
     head_->SetNext(i, nullptr);
   }
 }
@@ -123,9 +179,9 @@ inline bool SkipList<Key,Comparator>::Iterator::Valid() const {
 }
 
 template<typename Key, class Comparator>
-inline const Key& SkipList<Key,Comparator>::Iterator::key() const {
+inline Key SkipList<Key,Comparator>::Iterator::key() const {
   assert(Valid());
-  return node_->key;
+  return node_->GetKey();
 }
 
 template<typename Key, class Comparator>
@@ -139,7 +195,7 @@ inline void SkipList<Key,Comparator>::Iterator::Prev() {
   // Instead of using explicit "prev" links, we just search for the
   // last node that falls before key.
   assert(Valid());
-  node_ = list_->FindLessThan(node_->key);
+  node_ = list_->FindLessThan(list_->MakeSearchKey(node_->GetKey()));
   if (node_ == list_->head_) {
     node_ = nullptr;
   }
@@ -147,8 +203,9 @@ inline void SkipList<Key,Comparator>::Iterator::Prev() {
 
 template<typename Key, class Comparator>
 inline void SkipList<Key,Comparator>::Iterator::Seek(const Key& target) {
-  node_ = list_->FindGreaterOrEqual(target, nullptr);
-  if (node_ != nullptr && !list_->Equal(node_->key, target)) {
+  SearchKey key = list_->MakeSearchKey(target);
+  node_ = list_->FindGreaterOrEqual(key, nullptr);
+  if (node_ != nullptr && list_->CompareNode(node_, key) != 0) {
 	node_ = nullptr;
   }
 }
@@ -169,57 +226,106 @@ inline void SkipList<Key,Comparator>::Iterator::SeekToLast() {
 template<typename Key, class Comparator>
 struct SkipList<Key, Comparator>::Node
 {
-	explicit Node(const Key& k) : key(k) { }
+	Node(const SearchKey& k) : key_(k.key_), prefix_(k.prefix_), size_(k.size_) { }
 
-	Key key;
+	Key GetKey() const
+	{
+		return key_.load(std::memory_order_acquire);
+	}
 
+	// Replace the entry of a linked node by one comparing equal to it.
+	void SetKey(const Key& k)
+	{
+		key_.store(k, std::memory_order_release);
+	}
+
+	// Acquire load, so the fields of the returned node are fully initialized.
 	Node* Next(int n)
 	{
 		assert(n >= 0);
-		return reinterpret_cast<Node*>(next_[n]);
+		return next_[n].load(std::memory_order_acquire);
 	}
 
+	// Release store, publishing the node to the readers.
 	void SetNext(int n, Node* x)
 	{
 		assert(n >= 0);
-		next_[n] = x;
+		next_[n].store(x, std::memory_order_release);
+	}
+
+	// Only safe before the node is linked at level n.
+	void NoBarrierSetNext(int n, Node* x)
+	{
+		assert(n >= 0);
+		next_[n].store(x, std::memory_order_relaxed);
+	}
+
+	bool CASNext(int n, Node* expected, Node* x)
+	{
+		assert(n >= 0);
+		return next_[n].compare_exchange_strong(expected, x);
 	}
 
 private:
-	void* next_[1];
+	std::atomic<Key> key_;
+
+public:
+	const uint64_t prefix_;
+	const uint32_t size_;
+
+private:
+	// Array of length equal to the node height. next_[0] is lowest level link.
+	std::atomic<Node*> next_[1];
 };
 
 template<typename Key, class Comparator>
-typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(const Key& key, int height)
+typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(const SearchKey& key, int height)
 {
 	char* mem = memory_->AllocateAligned(
-		sizeof(Node) + sizeof(void*) * (height - 1));
+		sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1), kCacheLineSize);
 	return new (mem) Node(key);
 }
 
 template<typename Key, class Comparator>
 int SkipList<Key, Comparator>::RandomHeight()
 {
-	static const unsigned int kBranching = 4;
+	static thread_local Random rand(0xdeadbeef ^ std::hash<std::thread::id>()(std::this_thread::get_id()));
 	int height = 1;
-	while (height < kMaxHeight && ((rand_.Next() % kBranching) == 0))
+	while (height < height_limit_ && ((rand.Next() % branching_) == 0))
 	{
 		height++;
 	}
 
 	assert(height > 0);
-	assert(height <= kMaxHeight);
+	assert(height <= height_limit_);
 	return height;
 }
 
 template<typename Key, class Comparator>
-bool SkipList<Key, Comparator>::KeyIsAfterNode(const Key& key, Node* n) const
+int SkipList<Key, Comparator>::CompareNode(Node* n, const SearchKey& key) const
 {
-	return (n != nullptr) && (compare_(n->key, key) < 0);
+	if (n->prefix_ != key.prefix_)
+	{
+		return n->prefix_ < key.prefix_ ? -1 : 1;
+	}
+
+	if (n->size_ <= 8 && key.size_ <= 8)
+	{
+		// Both keys are entirely in the prefixes, padded with zeros.
+		return n->size_ < key.size_ ? -1 : (n->size_ == key.size_ ? 0 : 1);
+	}
+
+	return compare_(n->GetKey(), key.key_);
 }
 
 template<typename Key, class Comparator>
-typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindGreaterOrEqual(const Key& key, Node** prev) const
+bool SkipList<Key, Comparator>::KeyIsAfterNode(const SearchKey& key, Node* n) const
+{
+	return (n != nullptr) && (CompareNode(n, key) < 0);
+}
+
+template<typename Key, class Comparator>
+typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindGreaterOrEqual(const SearchKey& key, Node** prev) const
 {
 	Node* x = head_;
 	int level = GetMaxHeight() - 1;
@@ -251,15 +357,15 @@ typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindGreater
 }
 
 template<typename Key, class Comparator>
-typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLessThan(const Key& key) const
+typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLessThan(const SearchKey& key) const
 {
 	Node* x = head_;
 	int level = GetMaxHeight() - 1;
 	while (true)
 	{
-		assert(x == head_ || compare_(x->key, key) < 0);
+		assert(x == head_ || CompareNode(x, key) < 0);
 		Node* next = x->Next(level);
-		if (next == nullptr || compare_(next->key, key) >= 0)
+		if (next == nullptr || CompareNode(next, key) >= 0)
 		{
 			if (level == 0)
 			{
@@ -304,41 +410,88 @@ typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLast()
 }
 
 template<typename Key, class Comparator>
-void SkipList<Key, Comparator>::Insert(const Key& key)
+void SkipList<Key, Comparator>::FindSpliceForLevel(const SearchKey& key, Node* before, int level, Node** out_prev, Node** out_next) const
 {
-	Node* prev[kMaxHeight];
-	Node* x = FindGreaterOrEqual(key, prev);
-
-	if (x != nullptr && Equal(x->key, key))
+	Node* x = before;
+	while (true)
 	{
-		x->key = key;
-		return;
+		Node* next = x->Next(level);
+		if (KeyIsAfterNode(key, next))
+		{
+			x = next;
+		}
+		else
+		{
+			*out_prev = x;
+			*out_next = next;
+			return;
+		}
 	}
+}
 
+template<typename Key, class Comparator>
+void SkipList<Key, Comparator>::Insert(const Key& key)
+{
 	int height = RandomHeight();
-	if (height > GetMaxHeight())
+	int max_height = GetMaxHeight();
+	while (height > max_height)
 	{
-		for (int i = GetMaxHeight(); i < height; ++i)
+		// Readers seeing the new height before the node is linked just find
+		// nullptr in head_ at those levels, which is fine.
+		if (max_height_.compare_exchange_weak(max_height, height))
 		{
-			prev[i] = head_;
+			max_height = height;
+			break;
 		}
+	}
 
-		max_height_ = height;
+	SearchKey search_key = MakeSearchKey(key);
+	Node* prev[kMaxHeightLimit];
+	Node* next[kMaxHeightLimit];
+	Node* before = head_;
+	for (int i = max_height - 1; i >= 0; --i)
+	{
+		FindSpliceForLevel(search_key, before, i, &prev[i], &next[i]);
+		before = prev[i];
+	}
+
+	if (next[0] != nullptr && CompareNode(next[0], search_key) == 0)
+	{
+		next[0]->SetKey(key);
+		return;
 	}
 
-	x = NewNode(key, height);
-	for (int i = 0;i < height; ++i)
+	Node* x = NewNode(search_key, height);
+	for (int i = 0; i < height; ++i)
 	{
-		x->SetNext(i, prev[i]->Next(i));
-		prev[i]->SetNext(i, x);
+		while (true)
+		{
+			x->NoBarrierSetNext(i, next[i]);
+			if (prev[i]->CASNext(i, next[i], x))
+			{
+				break;
+			}
+
+			// Another node was linked right after prev[i], search again from there.
+			FindSpliceForLevel(search_key, prev[i], i, &prev[i], &next[i]);
+
+			// The same key was inserted concurrently, the node linked first
+			// takes the entry and x is left unused in the memory.
+			if (i == 0 && next[0] != nullptr && CompareNode(next[0], search_key) == 0)
+			{
+				next[0]->SetKey(key);
+				return;
+			}
+		}
 	}
 }
 
 template<typename Key, class Comparator>
 bool SkipList<Key, Comparator>::Contains(const Key& key) const
 {
-	Node* x = FindGreaterOrEqual(key, nullptr);
-	if (x != nullptr && Equal(key, x->key))
+	SearchKey search_key = MakeSearchKey(key);
+	Node* x = FindGreaterOrEqual(search_key, nullptr);
+	if (x != nullptr && CompareNode(x, search_key) == 0)
 	{
 		return true;
 	}
@@ -0,0 +1,41 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef SPIN_LOCK_H_
+#define SPIN_LOCK_H_
+
+#include <atomic>
+#include <thread>
+
+// Lock for critical sections of a few instructions, where putting the thread
+// to sleep costs more than the wait itself.
+class SpinLock
+{
+private:
+	std::atomic<bool> locked_;
+
+	SpinLock(const SpinLock&) = delete;
+	void operator=(const SpinLock&) = delete;
+
+public:
+	SpinLock() : locked_(false) { }
+
+	void Lock()
+	{
+		while (locked_.exchange(true, std::memory_order_acquire))
+		{
+			while (locked_.load(std::memory_order_relaxed))
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void Unlock()
+	{
+		locked_.store(false, std::memory_order_release);
+	}
+};
+
+#endif  // SPIN_LOCK_H_
@@ -0,0 +1,169 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+
+#include "xor_filter.h"
+#include "../util/coding.h"
+
+namespace
+{
+
+const int kMaxAttempts = 64;
+
+uint64_t Mix(uint32_t hash, uint32_t seed)
+{
+	// murmur3 finalizer over the key hash and the seed.
+	uint64_t h = (static_cast<uint64_t>(seed) << 32) | hash;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+uint32_t Slot(uint64_t h, int index, uint32_t segment_length)
+{
+	uint32_t r = static_cast<uint32_t>(index == 0 ? h : (h << (21 * index)) | (h >> (64 - 21 * index)));
+	return ((static_cast<uint64_t>(r) * segment_length) >> 32) + index * segment_length;
+}
+
+uint8_t Fingerprint(uint64_t h)
+{
+	return static_cast<uint8_t>(h ^ (h >> 32));
+}
+
+struct SlotSet
+{
+	uint64_t xor_mask_;
+	uint32_t count_;
+};
+
+// Peel the keys off one at a time, order gets the keys and the slots they
+// were peeled from. Return false if some keys could not be peeled.
+bool Peel(const std::vector<uint32_t>& keys, uint32_t seed, uint32_t segment_length,
+	std::vector<std::pair<uint32_t, uint64_t>>& order)
+{
+	uint32_t capacity = 3 * segment_length;
+	std::vector<SlotSet> sets(capacity, SlotSet{0, 0});
+	for (auto key : keys)
+	{
+		uint64_t h = Mix(key, seed);
+		for (int i = 0; i < 3; ++i)
+		{
+			SlotSet& set = sets[Slot(h, i, segment_length)];
+			set.xor_mask_ ^= h;
+			set.count_++;
+		}
+	}
+
+	std::vector<uint32_t> queue;
+	for (uint32_t i = 0; i < capacity; ++i)
+	{
+		if (sets[i].count_ == 1)
+		{
+			queue.push_back(i);
+		}
+	}
+
+	order.clear();
+	while (!queue.empty())
+	{
+		uint32_t index = queue.back();
+		queue.pop_back();
+		if (sets[index].count_ != 1)
+		{
+			continue;
+		}
+
+		// The only key left in this slot.
+		uint64_t h = sets[index].xor_mask_;
+		order.push_back(std::make_pair(index, h));
+		for (int i = 0; i < 3; ++i)
+		{
+			uint32_t slot = Slot(h, i, segment_length);
+			sets[slot].xor_mask_ ^= h;
+			if (--sets[slot].count_ == 1)
+			{
+				queue.push_back(slot);
+			}
+		}
+	}
+
+	return order.size() == keys.size();
+}
+
+}  // namespace
+
+bool XorFilter::CreateFilter(const std::vector<uint32_t>& hashes, std::string& dst)
+{
+	// Equal keys can never be peeled apart, and equal hashes are the same key
+	// as far as the filter goes.
+	std::vector<uint32_t> keys(hashes);
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	uint32_t segment_length = (32 + 1.23 * keys.size()) / 3;
+	std::vector<std::pair<uint32_t, uint64_t>> order;
+	for (uint32_t seed = 1; seed <= kMaxAttempts; ++seed)
+	{
+		if (!Peel(keys, seed, segment_length, order))
+		{
+			continue;
+		}
+
+		// Assign in the reverse order of peeling, each slot is the last free
+		// one of its key when the key comes up.
+		std::string fingerprints(3 * segment_length, 0);
+		for (auto it = order.rbegin(); it != order.rend(); ++it)
+		{
+			uint64_t h = it->second;
+			uint8_t f = Fingerprint(h);
+			for (int i = 0; i < 3; ++i)
+			{
+				f ^= static_cast<uint8_t>(fingerprints[Slot(h, i, segment_length)]);
+			}
+
+			// The slot itself is still 0, so it drops out of the xor above.
+			fingerprints[it->first] = static_cast<char>(f);
+		}
+
+		char buf[4];
+		EncodeFixed32(buf, seed);
+		dst.append(buf, 4);
+		EncodeFixed32(buf, segment_length);
+		dst.append(buf, 4);
+		dst.append(fingerprints);
+		return true;
+	}
+
+	return false;
+}
+
+bool XorFilter::KeyMayMatch(uint32_t hash, const ByteArray& filter)
+{
+	if (filter.Size() < 8)
+	{
+		return true;
+	}
+
+	uint32_t seed, segment_length;
+	GetFixed32(filter.Data(), &seed);
+	GetFixed32(filter.Data() + 4, &segment_length);
+	if (segment_length == 0 || static_cast<uint64_t>(segment_length) * 3 != filter.Size() - 8)
+	{
+		return true;
+	}
+
+	const char* fingerprints = filter.Data() + 8;
+	uint64_t h = Mix(hash, seed);
+	uint8_t f = Fingerprint(h);
+	for (int i = 0; i < 3; ++i)
+	{
+		f ^= static_cast<uint8_t>(fingerprints[Slot(h, i, segment_length)]);
+	}
+
+	return f == 0;
+}
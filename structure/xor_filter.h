@@ -0,0 +1,38 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef XOR_FILTER_H_
+#define XOR_FILTER_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "../type/byte_array.h"
+
+// Static xor filter with 8-bit fingerprints (Graf and Lemire, "Xor Filters:
+// Faster and Smaller Than Bloom and Cuckoo Filters").
+//
+// Every key maps to one slot in each third of the filter, and the slots are
+// filled so that the xor of the three is the fingerprint of the key. The
+// filter takes about 1.23 * 8 = 9.84 bits per key for a false positive rate
+// of 1/256, a bloom filter needs 1.44 * 8 = 11.5 bits per key for the same.
+// Building it costs a few passes over the keys and may have to retry with
+// another seed.
+//
+// Filter format: fixed32 seed | fixed32 segment_length |
+//                uint8 fingerprints[3 * segment_length]
+class XorFilter
+{
+public:
+	// Append the filter of the keys with the given hashes to dst. Return
+	// false and leave dst alone if no filter could be built.
+	static bool CreateFilter(const std::vector<uint32_t>& hashes, std::string& dst);
+
+	// Return false only if the key with the given hash was not in the filter.
+	static bool KeyMayMatch(uint32_t hash, const ByteArray& filter);
+};
+
+#endif  // XOR_FILTER_H_
@@ -6,3 +6,5 @@
 
 const std::string Constant::TombValue = "###TOMB_VALUE###";
 const std::string Constant::DataFolder = "./data";
+const std::string Constant::LogFolder = "./wal";
+const std::string Constant::ValueLogFolder = "./value_log";
@@ -12,6 +12,8 @@ class Constant
 public:
 	const static std::string TombValue;
 	const static std::string DataFolder;
+	const static std::string LogFolder;
+	const static std::string ValueLogFolder;
 };
 
 #endif  // CONSTANT_H_
@@ -0,0 +1,20 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef VALUE_TYPE_H_
+#define VALUE_TYPE_H_
+
+// What the value of an entry holds, stored with the entry in the buffers, the
+// write-ahead log and the table files.
+enum ValueType
+{
+	TypeValue = 0,
+	TypeValuePointer = 1,	// A ValuePointer to the value log, see db/value_log.h.
+	TypeDeletion = 2,	// The key was deleted, the value is empty.
+	TypeRangeDeletion = 3,	// Keys from the key up to the value, excluded, were
+							// deleted. Only in the write-ahead log, the buffers
+							// and the table files keep them apart from the keys.
+};
+
+#endif  // VALUE_TYPE_H_
@@ -0,0 +1,79 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "../structure/bloom_filter.h"
+#include "../structure/blocked_bloom_filter.h"
+#include "../structure/test_harness.h"
+
+class BlockedBloomFilterTest { };
+
+std::vector<uint32_t> Hashes(int begin, int end)
+{
+	std::vector<uint32_t> hashes;
+	for (int i = begin; i < end; ++i)
+	{
+		std::string key = "key" + std::to_string(i);
+		hashes.push_back(BloomFilter::KeyHash(ByteArray(key.data(), key.size())));
+	}
+
+	return hashes;
+}
+
+TEST(BlockedBloomFilterTest, NoFalseNegatives)
+{
+	for (int num = 1; num <= 100000; num *= 10)
+	{
+		std::vector<uint32_t> hashes = Hashes(0, num);
+		std::string filter;
+		BlockedBloomFilter(10).CreateFilter(hashes, filter);
+		ASSERT_EQ(filter.size() % BlockedBloomFilter::kLineBytes, 1);
+
+		ByteArray contents(filter.data(), filter.size());
+		for (auto hash : hashes)
+		{
+			ASSERT_TRUE(BlockedBloomFilter::KeyMayMatchScalar(hash, contents));
+			ASSERT_TRUE(BlockedBloomFilter::KeyMayMatchAvx2(hash, contents));
+		}
+	}
+}
+
+TEST(BlockedBloomFilterTest, KernelsAgree)
+{
+	std::string filter;
+	BlockedBloomFilter(10).CreateFilter(Hashes(0, 10000), filter);
+	ByteArray contents(filter.data(), filter.size());
+
+	int false_positives = 0;
+	std::vector<uint32_t> absent = Hashes(10000, 110000);
+	for (auto hash : absent)
+	{
+		bool scalar = BlockedBloomFilter::KeyMayMatchScalar(hash, contents);
+		ASSERT_EQ(scalar, BlockedBloomFilter::KeyMayMatchAvx2(hash, contents));
+		ASSERT_EQ(scalar, BlockedBloomFilter::KeyMayMatch(hash, contents));
+		false_positives += scalar;
+	}
+
+	// About 1% expected at 10 bits per key.
+	ASSERT_TRUE(false_positives < 2000);
+}
+
+TEST(BlockedBloomFilterTest, OtherEncodings)
+{
+	// A plain bloom filter is not mistaken for a blocked one.
+	std::string filter;
+	BloomFilter(10).CreateFilter(Hashes(0, 100), filter);
+	ByteArray contents(filter.data(), filter.size());
+	for (auto hash : Hashes(100, 200))
+	{
+		ASSERT_TRUE(BlockedBloomFilter::KeyMayMatch(hash, contents));
+	}
+}
+
+int main()
+{
+	return RunAllTests();
+}
@@ -11,7 +11,7 @@ TEST(CacheTest, Get)
 {
 	LRUCache cache(5);
 	std::string key_str = "hope";
-	std::unordered_map<std::string, uint32_t> test_map;
+	std::unordered_map<std::string, uint64_t> test_map;
 	test_map[key_str] = 1;
 	for (int i = 0; i < 6; i++)
 	{
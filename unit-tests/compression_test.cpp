@@ -0,0 +1,116 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string>
+
+#include <stdlib.h>
+
+#include "../util/compression.h"
+#include "../util/sequence_generator.h"
+#include "../structure/test_harness.h"
+
+class CompressionTest { };
+
+std::string RepetitiveString(size_t len)
+{
+	std::string s;
+	while (s.size() < len)
+	{
+		s += "{\"name\":\"" + RandomString(3) + "\",\"state\":\"active\"},";
+	}
+
+	return s;
+}
+
+TEST(CompressionTest, RoundTrip)
+{
+	srand(301);
+	CompressionType types[] = { LzCompression, LzHighCompression };
+	for (auto type : types)
+	{
+		const Compressor* compressor = GetCompressor(type);
+		ASSERT_TRUE(compressor != nullptr);
+		ASSERT_EQ(compressor->Type(), type);
+
+		for (int len = 0; len < 70000; len = len * 2 + 1)
+		{
+			std::string inputs[] = { RepetitiveString(len), RandomString(len), std::string(len, 'a') };
+			for (auto& input : inputs)
+			{
+				std::string compressed, output;
+				ASSERT_TRUE(compressor->Compress(input.data(), input.size(), compressed));
+				ASSERT_TRUE(compressor->Uncompress(compressed.data(), compressed.size(), output));
+				ASSERT_EQ(output, input);
+			}
+		}
+
+		std::string input = RepetitiveString(4096);
+		std::string compressed;
+		compressor->Compress(input.data(), input.size(), compressed);
+		ASSERT_TRUE(compressed.size() * 2 < input.size());
+	}
+
+	std::string input = RepetitiveString(4096);
+	std::string fast, high;
+	GetCompressor(LzCompression)->Compress(input.data(), input.size(), fast);
+	GetCompressor(LzHighCompression)->Compress(input.data(), input.size(), high);
+	ASSERT_TRUE(high.size() <= fast.size());
+}
+
+TEST(CompressionTest, Corrupted)
+{
+	const Compressor* compressor = GetCompressor(LzCompression);
+	std::string input = RepetitiveString(4096);
+	std::string compressed, output;
+	compressor->Compress(input.data(), input.size(), compressed);
+
+	ASSERT_TRUE(!compressor->Uncompress(compressed.data(), compressed.size() / 2, output));
+	ASSERT_TRUE(!compressor->Uncompress(compressed.data(), 0, output));
+
+	// A match reaching before the start of the output.
+	std::string bad = compressed.substr(0, 2);
+	bad.append("\x0f\x00\x10", 3);
+	ASSERT_TRUE(!compressor->Uncompress(bad.data(), bad.size(), output));
+}
+
+class ReverseCompressor : public Compressor
+{
+public:
+	CompressionType Type() const override
+	{
+		return static_cast<CompressionType>(100);
+	}
+
+	const char* Name() const override
+	{
+		return "reverse";
+	}
+
+	bool Compress(const char* input, size_t size, std::string& output) const override
+	{
+		output.assign(input, size);
+		output.assign(output.rbegin(), output.rend());
+		return true;
+	}
+
+	bool Uncompress(const char* input, size_t size, std::string& output) const override
+	{
+		return Compress(input, size, output);
+	}
+};
+
+TEST(CompressionTest, Register)
+{
+	ASSERT_TRUE(GetCompressor(NoCompression) == nullptr);
+	ASSERT_TRUE(GetCompressor(100) == nullptr);
+
+	ReverseCompressor reverse;
+	RegisterCompressor(&reverse);
+	ASSERT_TRUE(GetCompressor(100) == &reverse);
+}
+
+int main()
+{
+	return RunAllTests();
+}
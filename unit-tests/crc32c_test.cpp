@@ -0,0 +1,65 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string>
+
+#include <stdlib.h>
+
+#include "../util/crc32c.h"
+#include "../util/sequence_generator.h"
+#include "../structure/test_harness.h"
+
+class Crc32cTest { };
+
+TEST(Crc32cTest, StandardResults)
+{
+	// From rfc3720 section B.4.
+	std::string zeros(32, 0);
+	ASSERT_EQ(Crc32cValue(zeros.data(), zeros.size()), 0x8a9136aau);
+
+	std::string ones(32, '\xff');
+	ASSERT_EQ(Crc32cValue(ones.data(), ones.size()), 0x62a8ab43u);
+
+	std::string ascending;
+	for (int i = 0; i < 32; ++i)
+	{
+		ascending.push_back(static_cast<char>(i));
+	}
+
+	ASSERT_EQ(Crc32cValue(ascending.data(), ascending.size()), 0x46dd794eu);
+	ASSERT_EQ(Crc32cValue("123456789", 9), 0xe3069283u);
+}
+
+TEST(Crc32cTest, Implementations)
+{
+	srand(17);
+	std::string data = RandomString(1000);
+	for (int offset = 0; offset < 8; ++offset)
+	{
+		for (size_t size = 0; size + offset <= data.size(); size = size * 2 + 1)
+		{
+			const char* p = data.data() + offset;
+			uint32_t crc = Crc32cExtendPortable(0, p, size);
+			ASSERT_EQ(Crc32cExtendSse42(0, p, size), crc);
+			ASSERT_EQ(Crc32cValue(p, size), crc);
+
+			// Extending in two steps gives the crc of the whole.
+			ASSERT_EQ(Crc32cExtend(Crc32cValue(p, size / 3), p + size / 3, size - size / 3), crc);
+		}
+	}
+}
+
+TEST(Crc32cTest, Mask)
+{
+	uint32_t crc = Crc32cValue("foo", 3);
+	ASSERT_TRUE(crc != Crc32cMask(crc));
+	ASSERT_TRUE(crc != Crc32cMask(Crc32cMask(crc)));
+	ASSERT_EQ(Crc32cUnmask(Crc32cMask(crc)), crc);
+	ASSERT_EQ(Crc32cUnmask(Crc32cUnmask(Crc32cMask(Crc32cMask(crc)))), crc);
+}
+
+int main()
+{
+	return RunAllTests();
+}
@@ -6,9 +6,13 @@
 #include <utility>
 #include <unordered_map>
 
+#include <stdio.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "../db/data_base.h"
+#include "../type/constant.h"
 #include "../util/file_logger.h"
 #include "../util/sequence_generator.h"
 #include "../structure/test_harness.h"
@@ -64,6 +68,472 @@ TEST(DataBaseTest, PutAndGet)
 	data_base.ShutDown();
 }
 
+TEST(DataBaseTest, RecoverFromLog)
+{
+	srand(102001);
+	std::unordered_map<std::string, std::string> kv;
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::string key = RandomString(50);
+		std::string value(key.rbegin(), key.rend());
+		kv[key] = value;
+	}
+
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+
+	{
+		// The buffer is never flushed, the records only live in the log.
+		EventManager event_manager;
+		StorageBuffer storage_buffer(64 << 20, &file_logger, &event_manager);
+		LRUCache cache(2);
+		StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+		WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+		DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+		data_base.Start();
+
+		for (auto& item : kv)
+		{
+			std::string key(item.first);
+			std::string value(item.second);
+			data_base.Add(Put, key, value);
+		}
+
+		data_base.ShutDown();
+	}
+
+	EventManager event_manager;
+	StorageBuffer storage_buffer(64 << 20, &file_logger, &event_manager);
+	LRUCache cache(2);
+	StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+	WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+	data_base.Start();
+
+	for (auto& item : kv)
+	{
+		std::string key(item.first);
+		std::string value_out;
+		ASSERT_EQ(data_base.Get(key, value_out), 0);
+		ASSERT_EQ(item.second, value_out);
+	}
+
+	data_base.ShutDown();
+}
+
+TEST(DataBaseTest, KeepUnreadableLog)
+{
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	std::string key = "unreadable_key";
+	std::string value = "unreadable_value";
+	size_t segments_num;
+
+	{
+		EventManager event_manager;
+		StorageBuffer storage_buffer(64 << 20, &file_logger, &event_manager);
+		LRUCache cache(2);
+		StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+		WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+		DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+		ASSERT_EQ(data_base.Start(), 0);
+		ASSERT_EQ(data_base.Add(Put, key, value), 0);
+		data_base.ShutDown();
+		segments_num = write_ahead_log.Segments().size();
+	}
+
+	// A segment that cannot be read fails the start and no segment is removed.
+	std::string unreadable = Constant::LogFolder + "/" + LogFileName(99999999);
+	mkdir(unreadable.c_str(), 0777);
+	{
+		EventManager event_manager;
+		StorageBuffer storage_buffer(64 << 20, &file_logger, &event_manager);
+		LRUCache cache(2);
+		StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+		WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+		DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+		ASSERT_EQ(data_base.Start(), -1);
+		data_base.ShutDown();
+		ASSERT_EQ(write_ahead_log.Segments().size(), segments_num + 1);
+	}
+
+	rmdir(unreadable.c_str());
+	EventManager event_manager;
+	StorageBuffer storage_buffer(64 << 20, &file_logger, &event_manager);
+	LRUCache cache(2);
+	StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+	WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+	ASSERT_EQ(data_base.Start(), 0);
+	std::string value_out;
+	ASSERT_EQ(data_base.Get(key, value_out), 0);
+	ASSERT_EQ(value_out, value);
+	data_base.ShutDown();
+}
+
+TEST(DataBaseTest, ParallelFlush)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(4096, &file_logger, &event_manager, 8);
+	LRUCache cache(100);
+	StorageEngine storage_engine(&file_logger, 1000, &event_manager, &storage_buffer);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, nullptr, nullptr, 4);
+	data_base.Start();
+
+	// Every round overwrites all the keys, the files of later buffers must
+	// shadow the ones of earlier buffers whichever worker finishes first.
+	for (int round = 0; round < 10; ++round)
+	{
+		for (int i = 0; i < 500; ++i)
+		{
+			std::string key = "key" + std::to_string(i);
+			std::string value = key + "_" + std::to_string(round);
+			data_base.Add(Put, key, value);
+		}
+	}
+
+	while (storage_buffer.ImmutableBuffersNumber() > 0)
+	{
+		usleep(1000);
+	}
+
+	ASSERT_TRUE(storage_engine.LevelFilesNumber(0) > 1);
+	for (int i = 0; i < 500; ++i)
+	{
+		std::string key = "key" + std::to_string(i);
+		std::string value_out;
+		ASSERT_EQ(data_base.Get(key, value_out), 0);
+		ASSERT_EQ(key + "_9", value_out);
+	}
+
+	data_base.ShutDown();
+}
+
+TEST(DataBaseTest, ValueLog)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(65536, &file_logger, &event_manager);
+	LRUCache cache(100);
+	TableOptions table_options;
+	table_options.value_log_threshold = 512;
+	ValueLog value_log(&file_logger, 65536);
+	StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer, table_options, &value_log);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, nullptr, nullptr, 1, &value_log);
+	data_base.Start();
+
+	// Large values go to the value log, small ones stay in the tables.
+	uint64_t written = 0;
+	for (int round = 0; round < 10; ++round)
+	{
+		for (int i = 0; i < 300; ++i)
+		{
+			std::string key = "key" + std::to_string(i);
+			std::string value = key + "_" + std::to_string(round);
+			if (i % 3 != 0)
+			{
+				value.append(600, 'v');
+				written += value.size();
+			}
+
+			data_base.Add(Put, key, value);
+		}
+	}
+
+	while (storage_buffer.ImmutableBuffersNumber() > 0)
+	{
+		usleep(1000);
+	}
+
+	for (int i = 0; i < 300; ++i)
+	{
+		std::string key = "key" + std::to_string(i);
+		std::string value = key + "_9";
+		if (i % 3 != 0)
+		{
+			value.append(600, 'v');
+		}
+
+		std::string value_out;
+		ASSERT_EQ(data_base.Get(key, value_out), 0);
+		ASSERT_EQ(value, value_out);
+	}
+
+	data_base.ShutDown();
+
+	// Overwritten values are collected once compaction drops their pointers.
+	ASSERT_TRUE(value_log.TotalSize() < written / 2);
+}
+
+TEST(DataBaseTest, Delete)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(16384, &file_logger, &event_manager);
+	LRUCache cache(100);
+	StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache);
+	data_base.Start();
+
+	// The tomb value of the older format is an ordinary value now.
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::string key = "key" + std::to_string(i);
+		std::string value = i % 10 == 0 ? Constant::TombValue : key;
+		data_base.Add(Put, key, value);
+	}
+
+	for (int i = 0; i < 1000; i += 3)
+	{
+		std::string key = "key" + std::to_string(i);
+		std::string value;
+		data_base.Add(Delete, key, value);
+	}
+
+	// Deletions in the buffers first, then in the files over the older values.
+	for (int round = 0; round < 2; ++round)
+	{
+		for (int i = 0; i < 1000; ++i)
+		{
+			std::string key = "key" + std::to_string(i);
+			std::string value_out;
+			if (i % 3 == 0)
+			{
+				ASSERT_EQ(data_base.Get(key, value_out), -1);
+			}
+			else
+			{
+				ASSERT_EQ(data_base.Get(key, value_out), 0);
+				ASSERT_EQ(value_out, i % 10 == 0 ? Constant::TombValue : key);
+			}
+		}
+
+		for (int i = 0; i < 1000; ++i)
+		{
+			std::string key = "other" + std::to_string(i);
+			std::string value(100, 'x');
+			data_base.Add(Put, key, value);
+		}
+
+		while (storage_buffer.ImmutableBuffersNumber() > 0)
+		{
+			usleep(1000);
+		}
+	}
+
+	data_base.ShutDown();
+}
+
+std::string RangeKey(int i)
+{
+	char buf[16];
+	snprintf(buf, sizeof(buf), "range%05d", i);
+	return buf;
+}
+
+// The keys from 500 up to 2500 are deleted and 1500 is put again, the keys
+// from 2600 up to 2700 are deleted and 2650 is put again.
+void CheckRangeKeys(DataBase& data_base, bool second_range)
+{
+	for (int i = 0; i < 3000; ++i)
+	{
+		std::string key = RangeKey(i);
+		std::string value_out;
+		if (i == 1500 || (second_range && i == 2650))
+		{
+			ASSERT_EQ(data_base.Get(key, value_out), 0);
+			ASSERT_EQ(value_out, "again");
+		}
+		else if ((i >= 500 && i < 2500) || (second_range && i >= 2600 && i < 2700))
+		{
+			ASSERT_EQ(data_base.Get(key, value_out), -1);
+		}
+		else
+		{
+			ASSERT_EQ(data_base.Get(key, value_out), 0);
+			ASSERT_EQ(value_out, key);
+		}
+	}
+}
+
+TEST(DataBaseTest, DeleteRange)
+{
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+
+	{
+		EventManager event_manager;
+		StorageBuffer storage_buffer(16384, &file_logger, &event_manager);
+		LRUCache cache(100);
+		StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+		WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+		DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+		data_base.Start();
+
+		for (int i = 0; i < 3000; ++i)
+		{
+			std::string key = RangeKey(i);
+			std::string value = key;
+			data_base.Add(Put, key, value);
+		}
+
+		// Whole files of the first puts are deleted.
+		std::string begin = RangeKey(500);
+		std::string end = RangeKey(2500);
+		data_base.DeleteRange(begin, end);
+
+		// An empty range deletes nothing.
+		data_base.DeleteRange(end, begin);
+
+		std::string key = RangeKey(1500);
+		std::string value = "again";
+		data_base.Add(Put, key, value);
+
+		// Tombstones in the buffers first, then in the files over the deleted
+		// keys, then compacted with them.
+		for (int round = 0; round < 3; ++round)
+		{
+			CheckRangeKeys(data_base, false);
+
+			for (int i = 0; i < 1000; ++i)
+			{
+				std::string key = "range_other" + std::to_string(round * 1000 + i);
+				std::string value(100, 'x');
+				data_base.Add(Put, key, value);
+			}
+
+			while (storage_buffer.ImmutableBuffersNumber() > 0)
+			{
+				usleep(1000);
+			}
+		}
+
+		// Left in the log.
+		begin = RangeKey(2600);
+		end = RangeKey(2700);
+		data_base.DeleteRange(begin, end);
+		key = RangeKey(2650);
+		data_base.Add(Put, key, value);
+		CheckRangeKeys(data_base, true);
+
+		data_base.ShutDown();
+	}
+
+	EventManager event_manager;
+	StorageBuffer storage_buffer(16384, &file_logger, &event_manager);
+	LRUCache cache(100);
+	StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+	WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+	data_base.Start();
+	CheckRangeKeys(data_base, true);
+	data_base.ShutDown();
+}
+
+TEST(DataBaseTest, PutAfterDeleteRangeInSegment)
+{
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+
+	// The database swaps the segment on a range deletion, the records are
+	// written straight into one segment to keep them together.
+	{
+		WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+		ASSERT_EQ(write_ahead_log.Open(), 0);
+
+		std::vector<std::string> records(4);
+		AppendEntry(records[0], ByteArray("segment_a", 9), ByteArray("old", 3));
+		AppendEntry(records[1], ByteArray("segment_b", 9), ByteArray("old", 3));
+		AppendEntry(records[2], ByteArray("segment_a", 9), ByteArray("segment_z", 9), TypeRangeDeletion);
+		AppendEntry(records[3], ByteArray("segment_a", 9), ByteArray("new", 3));
+		for (auto& record : records)
+		{
+			ASSERT_EQ(write_ahead_log.AddRecord(ByteArray(record.data(), record.size())), 0);
+		}
+
+		write_ahead_log.Close();
+	}
+
+	for (int round = 0; round < 2; ++round)
+	{
+		EventManager event_manager;
+		StorageBuffer storage_buffer(16384, &file_logger, &event_manager);
+		LRUCache cache(100);
+		StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+		WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+		DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+		ASSERT_EQ(data_base.Start(), 0);
+
+		std::string key = "segment_a";
+		std::string value_out;
+		ASSERT_EQ(data_base.Get(key, value_out), 0);
+		ASSERT_EQ(value_out, "new");
+
+		key = "segment_b";
+		ASSERT_EQ(data_base.Get(key, value_out), -1);
+
+		if (round == 0)
+		{
+			// Put after a range deletion through the database.
+			std::string begin = "segment_a";
+			std::string end = "segment_z";
+			data_base.DeleteRange(begin, end);
+			key = "segment_a";
+			std::string value = "new";
+			data_base.Add(Put, key, value);
+		}
+
+		data_base.ShutDown();
+	}
+}
+
+TEST(DataBaseTest, StopAtCorruptedLogRecord)
+{
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+
+	std::vector<std::string> records(3);
+	for (int i = 0; i < 3; ++i)
+	{
+		std::string key = "corrupted" + std::to_string(i);
+		AppendEntry(records[i], ByteArray(key.data(), key.size()), ByteArray("value", 5));
+	}
+
+	uint64_t number;
+	{
+		WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+		ASSERT_EQ(write_ahead_log.Open(), 0);
+		number = write_ahead_log.SegmentNumber();
+		ASSERT_EQ(write_ahead_log.AddRecord(ByteArray(records[0].data(), records[0].size())), 0);
+		ASSERT_EQ(write_ahead_log.AddRecord(ByteArray(records[1].data(), records[1].size())), 0);
+		write_ahead_log.NewSegment();
+		ASSERT_EQ(write_ahead_log.AddRecord(ByteArray(records[2].data(), records[2].size())), 0);
+		write_ahead_log.Close();
+	}
+
+	// Flip the last byte of the second record, the third one follows it in
+	// the log and is dropped as well.
+	FILE* stream = fopen((Constant::LogFolder + "/" + LogFileName(number)).c_str(), "r+");
+	fseek(stream, -1, SEEK_END);
+	int c = fgetc(stream);
+	fseek(stream, -1, SEEK_END);
+	fputc(c ^ 0x01, stream);
+	fclose(stream);
+
+	EventManager event_manager;
+	StorageBuffer storage_buffer(16384, &file_logger, &event_manager);
+	LRUCache cache(100);
+	StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+	WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone, 0, 4096);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+	ASSERT_EQ(data_base.Start(), 0);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		std::string key = "corrupted" + std::to_string(i);
+		std::string value_out;
+		ASSERT_EQ(data_base.Get(key, value_out), i == 0 ? 0 : -1);
+	}
+
+	data_base.ShutDown();
+}
+
 int main()
 {
 	return RunAllTests();
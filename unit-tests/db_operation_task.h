@@ -12,7 +12,6 @@
 
 #include "../db/data_base.h"
 #include "../type/order_type.h"
-#include "../type/constant.h"
 #include "../structure/task.h"
 #include "../structure/concurrent_queue.h"
 
@@ -25,7 +24,6 @@ private:
 	std::string key_;
 	std::string value_;
 	std::string value_out_ = "";
-	std::string tomb_value_;
 
 public:
 	DBOperationTask(DataBase* data_base, ConcurrentQueue<std::pair<std::string, std::string>>* result_queue, OrderType order_type, std::string key, std::string value = "")
@@ -35,7 +33,6 @@ public:
 		  key_(key),
 		  value_(value)
 	{
-		tomb_value_ = Constant::TombValue;
 	}
 	
 	void RunInLock(std::thread::id tid) override { }
@@ -48,7 +45,7 @@ public:
 				break;
 
 			case Delete:
-				data_base_->Add(Put, key_, tomb_value_);
+				data_base_->Add(Delete, key_, value_);
 				break;
 
 			case Get:
@@ -0,0 +1,98 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../db/event_manager.h"
+#include "../db/storage_buffer.h"
+#include "../util/file_logger.h"
+#include "../util/hash.h"
+#include "../structure/dynamic_bloom.h"
+#include "../structure/test_harness.h"
+
+#define THREAD_NUM 4
+#define KEY_NUM 40000
+
+class DynamicBloomTest { };
+
+uint32_t KeyHash(const std::string& key)
+{
+	return Hash(key.data(), key.size(), 0x9747b28c);
+}
+
+TEST(DynamicBloomTest, ConcurrentAddAndFalsePositiveRate)
+{
+	Memory memory;
+	DynamicBloom bloom(&memory, KEY_NUM * 10);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < THREAD_NUM; ++t)
+	{
+		threads.push_back(std::thread([&bloom, t]() {
+			for (int i = t; i < KEY_NUM; i += THREAD_NUM)
+			{
+				bloom.Add(KeyHash("key" + std::to_string(i)));
+			}
+		}));
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	for (int i = 0; i < KEY_NUM; ++i)
+	{
+		ASSERT_TRUE(bloom.MayContain(KeyHash("key" + std::to_string(i))));
+	}
+
+	int false_positives = 0;
+	for (int i = 0; i < KEY_NUM; ++i)
+	{
+		false_positives += bloom.MayContain(KeyHash("absent" + std::to_string(i)));
+	}
+
+	// About 1% at 10 bits per key, cache line blocking costs a little.
+	ASSERT_TRUE(false_positives < KEY_NUM * 3 / 100);
+}
+
+TEST(DynamicBloomTest, StorageBufferCounters)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(1 << 20, &file_logger, &event_manager);
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::string key = "key" + std::to_string(i);
+		storage_buffer.Add(Put, ByteArray(key.data(), key.size()), ByteArray(key.data(), key.size()));
+	}
+
+	std::string value_out;
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::string key = "key" + std::to_string(i);
+		ASSERT_EQ(storage_buffer.Get(key, value_out), 0);
+		ASSERT_EQ(key, value_out);
+	}
+
+	ASSERT_EQ(storage_buffer.BloomHitCount(), 0);
+	ASSERT_EQ(storage_buffer.BloomFalsePositiveCount(), 0);
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::string key = "absent" + std::to_string(i);
+		ASSERT_TRUE(storage_buffer.Get(key, value_out) != 0);
+	}
+
+	ASSERT_EQ(storage_buffer.BloomHitCount() + storage_buffer.BloomFalsePositiveCount(), 1000);
+	ASSERT_TRUE(storage_buffer.BloomHitCount() > 990);
+}
+
+int main()
+{
+	return RunAllTests();
+}
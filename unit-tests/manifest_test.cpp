@@ -0,0 +1,314 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../db/event_manager.h"
+#include "../db/manifest.h"
+#include "../db/storage_buffer.h"
+#include "../db/storage_engine.h"
+#include "../db/table_builder.h"
+#include "../util/file_logger.h"
+#include "../util/utils.h"
+#include "../structure/test_harness.h"
+
+class ManifestTest { };
+
+const std::string kFolder = "./manifest_test";
+
+FileMeta TestFile(int level_id, int file_id)
+{
+	FileMeta meta;
+	meta.file_name_ = FileName(level_id, file_id);
+	meta.level_id_ = level_id;
+	meta.file_id_ = file_id;
+	meta.file_size_ = 1000 + file_id;
+	meta.lower_bound_ = "a" + std::to_string(file_id);
+	meta.upper_bound_ = "b" + std::to_string(file_id);
+	meta.num_entries_ = 10 * file_id;
+	meta.num_deletions_ = file_id;
+	return meta;
+}
+
+void CheckFiles(Manifest& manifest, const std::vector<int>& file_ids, int level_id)
+{
+	std::vector<FileMeta> files = manifest.Files();
+	ASSERT_EQ(files.size(), file_ids.size());
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		FileMeta expected = TestFile(level_id, file_ids[i]);
+		expected.level_id_ = files[i].level_id_;
+		ASSERT_TRUE(files[i].file_name_ == expected.file_name_);
+		ASSERT_EQ(files[i].file_id_, file_ids[i]);
+		ASSERT_EQ(files[i].file_size_, expected.file_size_);
+		ASSERT_TRUE(files[i].lower_bound_ == expected.lower_bound_);
+		ASSERT_TRUE(files[i].upper_bound_ == expected.upper_bound_);
+		ASSERT_EQ(files[i].num_entries_, expected.num_entries_);
+		ASSERT_EQ(files[i].num_deletions_, expected.num_deletions_);
+	}
+}
+
+void ClearFolder()
+{
+	system(("rm -rf " + kFolder).c_str());
+	mkdir(kFolder.c_str(), 0777);
+}
+
+TEST(ManifestTest, EditRoundTrip)
+{
+	VersionEdit edit;
+	edit.added_files_.push_back(TestFile(0, 3));
+	edit.added_files_.push_back(TestFile(2, 300));
+	edit.deleted_files_.push_back(1);
+	edit.deleted_files_.push_back(200);
+	edit.last_file_id_ = 300;
+
+	std::string encoded;
+	edit.EncodeTo(encoded);
+	VersionEdit decoded;
+	ASSERT_TRUE(decoded.DecodeFrom(ByteArray(encoded.data(), encoded.size())));
+	ASSERT_EQ(decoded.last_file_id_, 300);
+	ASSERT_EQ(decoded.deleted_files_.size(), 2);
+	ASSERT_EQ(decoded.deleted_files_[1], 200);
+	ASSERT_EQ(decoded.added_files_.size(), 2);
+	ASSERT_TRUE(decoded.added_files_[1].file_name_ == "2_00000300");
+	ASSERT_EQ(decoded.added_files_[1].level_id_, 2);
+	ASSERT_TRUE(decoded.added_files_[1].upper_bound_ == "b300");
+	ASSERT_EQ(decoded.added_files_[1].num_entries_, 3000);
+
+	ASSERT_TRUE(!decoded.DecodeFrom(ByteArray(encoded.data(), encoded.size() - 1)));
+	encoded.push_back('x');
+	ASSERT_TRUE(!decoded.DecodeFrom(ByteArray(encoded.data(), encoded.size())));
+
+	// No file id handed out yet.
+	VersionEdit empty;
+	encoded.clear();
+	empty.EncodeTo(encoded);
+	ASSERT_TRUE(decoded.DecodeFrom(ByteArray(encoded.data(), encoded.size())));
+	ASSERT_EQ(decoded.last_file_id_, -1);
+	ASSERT_TRUE(decoded.added_files_.empty());
+}
+
+TEST(ManifestTest, RecoverAndSnapshot)
+{
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	ClearFolder();
+
+	{
+		Manifest manifest(kFolder, &file_logger, 4);
+		ASSERT_EQ(manifest.Recover(), -1);
+
+		VersionEdit edit;
+		edit.added_files_.push_back(TestFile(0, 1));
+		ASSERT_EQ(manifest.Open(edit), 0);
+		ASSERT_EQ(manifest.ManifestNumber(), 1);
+
+		// The third edit fills the manifest, the next one is started with
+		// a snapshot and the first one removed.
+		for (int i = 2; i <= 4; ++i)
+		{
+			VersionEdit add;
+			add.added_files_.push_back(TestFile(0, i));
+			add.last_file_id_ = i + 10;
+			ASSERT_EQ(manifest.LogAndApply(add), 0);
+		}
+
+		VersionEdit move;
+		move.deleted_files_.push_back(2);
+		move.added_files_.push_back(TestFile(0, 2));
+		move.added_files_.back().level_id_ = 1;
+		ASSERT_EQ(manifest.LogAndApply(move), 0);
+		ASSERT_EQ(manifest.ManifestNumber(), 2);
+		ASSERT_TRUE(access((kFolder + "/MANIFEST-000001").c_str(), 0) != 0);
+
+		VersionEdit compact;
+		compact.deleted_files_.push_back(1);
+		compact.deleted_files_.push_back(3);
+		ASSERT_EQ(manifest.LogAndApply(compact), 0);
+		ASSERT_EQ(manifest.LastFileId(), 14);
+	}
+
+	Manifest manifest(kFolder, &file_logger, 4);
+	ASSERT_EQ(manifest.Recover(), 0);
+	ASSERT_EQ(manifest.ManifestNumber(), 2);
+	ASSERT_EQ(manifest.LastFileId(), 14);
+	CheckFiles(manifest, { 2, 4 }, 0);
+	ASSERT_EQ(manifest.Files()[0].level_id_, 1);
+	ASSERT_EQ(manifest.Files()[1].level_id_, 0);
+
+	// Reopening starts a new manifest holding the same files.
+	ASSERT_EQ(manifest.Open(), 0);
+	ASSERT_EQ(manifest.ManifestNumber(), 3);
+	ASSERT_TRUE(access((kFolder + "/MANIFEST-000002").c_str(), 0) != 0);
+
+	Manifest reopened(kFolder, &file_logger, 4);
+	ASSERT_EQ(reopened.Recover(), 0);
+	CheckFiles(reopened, { 2, 4 }, 0);
+	system(("rm -rf " + kFolder).c_str());
+}
+
+TEST(ManifestTest, TornTail)
+{
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	ClearFolder();
+
+	{
+		Manifest manifest(kFolder, &file_logger);
+		ASSERT_EQ(manifest.Recover(), -1);
+		ASSERT_EQ(manifest.Open(), 0);
+
+		VersionEdit add;
+		add.added_files_.push_back(TestFile(0, 1));
+		ASSERT_EQ(manifest.LogAndApply(add), 0);
+	}
+
+	// A record cut short by a crash, then a whole one with a bad checksum.
+	std::string path = kFolder + "/MANIFEST-000001";
+	struct stat statbuff;
+	ASSERT_EQ(stat(path.c_str(), &statbuff), 0);
+	for (int round = 0; round < 2; ++round)
+	{
+		VersionEdit add;
+		add.added_files_.push_back(TestFile(0, 2));
+		std::string record(8, '\0');
+		add.EncodeTo(record);
+		record[4] = static_cast<char>(record.size() - 8);
+		if (round == 0)
+		{
+			record.resize(6);
+		}
+
+		ASSERT_EQ(truncate(path.c_str(), statbuff.st_size), 0);
+		FILE* stream = fopen(path.c_str(), "a");
+		fwrite(record.data(), 1, record.size(), stream);
+		fclose(stream);
+
+		Manifest manifest(kFolder, &file_logger);
+		ASSERT_EQ(manifest.Recover(), 0);
+		CheckFiles(manifest, { 1 }, 0);
+	}
+
+	// A bad record followed by others is no crash, the edits after it would
+	// be lost.
+	{
+		ASSERT_EQ(truncate(path.c_str(), statbuff.st_size), 0);
+		FILE* stream = fopen(path.c_str(), "r+");
+		fseek(stream, 8, SEEK_SET);
+		int c = fgetc(stream);
+		fseek(stream, 8, SEEK_SET);
+		fputc(c ^ 1, stream);
+		fclose(stream);
+
+		Manifest manifest(kFolder, &file_logger);
+		ASSERT_EQ(manifest.Recover(), -2);
+		ASSERT_TRUE(manifest.Files().empty());
+	}
+
+	// CURRENT naming a manifest that is gone.
+	remove(path.c_str());
+	Manifest manifest(kFolder, &file_logger);
+	ASSERT_EQ(manifest.Recover(), -2);
+	system(("rm -rf " + kFolder).c_str());
+}
+
+TEST(ManifestTest, FailedEditNotApplied)
+{
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	ClearFolder();
+
+	// Never opened, there is no manifest to log the edit to.
+	Manifest manifest(kFolder, &file_logger);
+	ASSERT_EQ(manifest.Recover(), -1);
+	VersionEdit add;
+	add.added_files_.push_back(TestFile(0, 1));
+	add.last_file_id_ = 5;
+	ASSERT_EQ(manifest.LogAndApply(add), -1);
+	ASSERT_TRUE(manifest.Files().empty());
+	ASSERT_EQ(manifest.LastFileId(), -1);
+	system(("rm -rf " + kFolder).c_str());
+}
+
+TEST(ManifestTest, StorageEngineRestart)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(1024, &file_logger, &event_manager, 2);
+	system(("rm -rf " + Constant::DataFolder).c_str());
+
+	// Two level 0 files apart from each other, the first one is moved down
+	// by the compaction without being renamed.
+	std::string file_names[2];
+	{
+		StorageEngine storage_engine(&file_logger, 1, &event_manager, &storage_buffer);
+		for (int f = 0; f < 2; ++f)
+		{
+			int file_id;
+			TableBuilder* builder = storage_engine.NewTableBuilder(storage_engine.NewWritableFile(file_id, file_names[f]));
+			for (int i = 0; i < 100; ++i)
+			{
+				std::string key = "key" + std::to_string(1000 * (f + 1) + i);
+				builder->Add(ByteArray(key.data(), key.size()), ByteArray("value", 5));
+			}
+
+			ASSERT_EQ(builder->Finish(), 0);
+			delete builder;
+			ASSERT_EQ(storage_engine.AddFile(file_names[f]), 0);
+		}
+
+		storage_engine.Compact(0);
+		ASSERT_EQ(storage_engine.LevelFilesNumber(0), 1);
+		ASSERT_EQ(storage_engine.LevelFilesNumber(1), 1);
+	}
+
+	// Left by a flush that never got into the manifest.
+	std::string orphan_path = Constant::DataFolder + "/" + FileName(0, 7);
+	WritableFile* orphan = WritableFile::Open(orphan_path);
+	orphan->Append("x", 1);
+	delete orphan;
+
+	StorageEngine storage_engine(&file_logger, 1, &event_manager, &storage_buffer);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(0), 1);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(1), 1);
+	ASSERT_TRUE(access((Constant::DataFolder + "/" + file_names[0]).c_str(), 0) == 0);
+	ASSERT_TRUE(access(orphan_path.c_str(), 0) != 0);
+
+	std::string key = "key1050";
+	std::vector<std::vector<File*>> contains_files;
+	Version* version = storage_engine.CurrentVersion();
+	version->GetContainsFiles(key, contains_files);
+	version->Unref();
+	ASSERT_EQ(contains_files.back().size(), 1);
+	std::string value_out;
+	ASSERT_EQ(contains_files.back()[0]->Reader()->Get(ByteArray(key.data(), key.size()), value_out), 0);
+	ASSERT_TRUE(value_out == "value");
+
+	// File ids go on from the last one the manifest has seen.
+	int file_id;
+	std::string new_file_name;
+	delete storage_engine.NewWritableFile(file_id, new_file_name);
+	remove((Constant::DataFolder + "/" + new_file_name).c_str());
+	ASSERT_EQ(file_id, 2);
+
+	// CURRENT naming a manifest that is gone: the levels are unknown, no
+	// file is opened or removed.
+	FILE* stream = fopen((Constant::DataFolder + "/CURRENT").c_str(), "w");
+	fputs("MANIFEST-999999\n", stream);
+	fclose(stream);
+	StorageEngine broken_engine(&file_logger, 1, &event_manager, &storage_buffer);
+	ASSERT_TRUE(broken_engine.HasError());
+	ASSERT_EQ(broken_engine.LevelFilesNumber(0), 0);
+	ASSERT_EQ(broken_engine.LevelFilesNumber(1), 0);
+	ASSERT_TRUE(access((Constant::DataFolder + "/" + file_names[0]).c_str(), 0) == 0);
+	ASSERT_TRUE(access((Constant::DataFolder + "/" + file_names[1]).c_str(), 0) == 0);
+}
+
+int main()
+{
+	return RunAllTests();
+}
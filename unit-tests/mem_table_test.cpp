@@ -0,0 +1,86 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../db/mem_table.h"
+#include "../util/utils.h"
+#include "../structure/test_harness.h"
+
+#define THREAD_NUM 8
+#define KEY_NUM_PER_THREAD 5000
+
+class MemTableTest { };
+
+std::string EncodedKey(const std::string& key)
+{
+	std::string encoded;
+	AppendEntry(encoded, ByteArray(key.data(), key.size()), ByteArray("", 0));
+	return encoded;
+}
+
+TEST(MemTableTest, ShardedAddGetAndIterate)
+{
+	MemTable mem_table(4);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < THREAD_NUM; ++t)
+	{
+		threads.push_back(std::thread([&mem_table, t]() {
+			for (int i = t; i < THREAD_NUM * KEY_NUM_PER_THREAD; i += THREAD_NUM)
+			{
+				std::string key = "key" + std::to_string(i);
+				mem_table.Add(ByteArray(key.data(), key.size()), ByteArray(key.data(), key.size()));
+			}
+		}));
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	// Overwrites land in the shard holding the key.
+	std::map<std::string, std::string> expected;
+	for (int i = 0; i < THREAD_NUM * KEY_NUM_PER_THREAD; ++i)
+	{
+		std::string key = "key" + std::to_string(i);
+		expected[key] = key;
+		if (i % 7 == 0)
+		{
+			expected[key] = "new";
+			mem_table.Add(ByteArray(key.data(), key.size()), ByteArray("new", 3));
+		}
+	}
+
+	for (auto& item : expected)
+	{
+		std::string value_out;
+		ASSERT_EQ(mem_table.Get(EncodedKey(item.first).data(), value_out), 0);
+		ASSERT_EQ(item.second, value_out);
+	}
+
+	std::string value_out;
+	ASSERT_TRUE(mem_table.Get(EncodedKey("missing").data(), value_out) != 0);
+
+	MemTable::Iterator it(&mem_table);
+	auto expected_it = expected.begin();
+	for (it.SeekToFirst(); it.Valid(); it.Next(), ++expected_it)
+	{
+		ASSERT_TRUE(expected_it != expected.end());
+		ByteArray key(ExtractUserKey(it.key()));
+		ByteArray value(ExtractUserValue(it.key()));
+		ASSERT_EQ(expected_it->first, std::string(key.Data(), key.Size()));
+		ASSERT_EQ(expected_it->second, std::string(value.Data(), value.Size()));
+	}
+
+	ASSERT_TRUE(expected_it == expected.end());
+}
+
+int main()
+{
+	return RunAllTests();
+}
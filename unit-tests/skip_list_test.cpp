@@ -2,14 +2,20 @@
 // Use of this source code is governed by the BSD 3-Clause License,
 // that can be found in the LICENSE file.
 
+#include <algorithm>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "../type/byte_array.h"
 #include "../util/comparator.h"
 #include "../structure/test_harness.h"
 #include "../structure/skip_list.h"
 
-typedef SkipList<ByteArray, Comparator> Table;
+#define THREAD_NUM 8
+#define KEY_NUM_PER_THREAD 20000
+
+typedef SkipList<const char*, Comparator> Table;
 
 class SkipListTest { };
 
@@ -22,29 +28,42 @@ std::string strs[5] =
 	"World Cup is ongoing"
 };
 
-void Insert(Table& skip_list)
+const char* EncodeKey(Memory& memory, const std::string& key)
+{
+	ByteArray wrapped(WrapUserKey(ByteArray(key.c_str(), key.size())));
+	char* buf = memory.Allocate(wrapped.Size());
+	memcpy(buf, wrapped.Data(), wrapped.Size());
+	delete[] wrapped.Data();
+	return buf;
+}
+
+void Insert(Table& skip_list, Memory& memory)
 {
 	for (int i = 0; i < 5; i++)
 	{
-		skip_list.Insert(WrapUserKey(ByteArray(strs[i].c_str(), strs[i].size())));
+		skip_list.Insert(EncodeKey(memory, strs[i]));
 	}
 }
 
 TEST(SkipListTest, Insert)
 {
-	Table skip_list;
-	Insert(skip_list);
+	Comparator cmp;
+	Memory memory;
+	Table skip_list(cmp, &memory);
+	Insert(skip_list, memory);
 
 	for (int i = 0; i < 5; i++)
 	{
-		ASSERT_TRUE(skip_list.Contains(WrapUserKey(ByteArray(strs[i].c_str(), strs[i].size()))));
+		ASSERT_TRUE(skip_list.Contains(EncodeKey(memory, strs[i])));
 	}
 }
 
 TEST(SkipListTest, Iterate)
 {
-	Table skip_list;
-	Insert(skip_list);
+	Comparator cmp;
+	Memory memory;
+	Table skip_list(cmp, &memory);
+	Insert(skip_list, memory);
 
 	int alphabetic_order[5] = { 3, 1, 0, 2, 4 };
 	Table::Iterator it(&skip_list);
@@ -57,6 +76,97 @@ TEST(SkipListTest, Iterate)
 	}
 }
 
+TEST(SkipListTest, InlinePrefix)
+{
+	// Keys shorter than, equal to and longer than the inline prefix, with
+	// trailing zeros that only the key size tells apart.
+	std::vector<std::string> keys = { "", std::string("\0", 1), std::string("a\0", 2), "a", "ab",
+		"abcdefgh", std::string("abcdefgh\0", 9), "abcdefghi", "abcdefgg", "b", "\xff" };
+
+	Comparator cmp;
+	Memory memory;
+	Table skip_list(cmp, &memory, 20, 2);
+	for (auto& key : keys)
+	{
+		skip_list.Insert(EncodeKey(memory, key));
+	}
+
+	std::sort(keys.begin(), keys.end());
+	Table::Iterator it(&skip_list);
+	int i = 0;
+	for (it.SeekToFirst(); it.Valid(); ++i, it.Next())
+	{
+		ByteArray key(ExtractUserKey(it.key()));
+		ASSERT_EQ(keys[i], std::string(key.Data(), key.Size()));
+		ASSERT_TRUE(skip_list.Contains(EncodeKey(memory, keys[i])));
+	}
+
+	ASSERT_EQ(i, (int)keys.size());
+	ASSERT_TRUE(!skip_list.Contains(EncodeKey(memory, "abcdefg")));
+}
+
+std::string ThreadKey(int thread_id, int i)
+{
+	// Interleave the keys of all threads, so they fight for the same splices.
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%08d_%02d", i, thread_id);
+	return std::string(buf);
+}
+
+TEST(SkipListTest, ConcurrentInsertAndLookup)
+{
+	Comparator cmp;
+	Memory memory;
+	Table skip_list(cmp, &memory);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < THREAD_NUM; ++t)
+	{
+		threads.push_back(std::thread([&skip_list, &memory, t]() {
+			for (int i = 0; i < KEY_NUM_PER_THREAD; ++i)
+			{
+				skip_list.Insert(EncodeKey(memory, ThreadKey(t, i)));
+
+				// Every thread also inserts a key shared by all of them.
+				skip_list.Insert(EncodeKey(memory, ThreadKey(THREAD_NUM, i)));
+
+				// Own keys must be visible right after they are inserted.
+				ASSERT_TRUE(skip_list.Contains(EncodeKey(memory, ThreadKey(t, i))));
+				if (i > 0)
+				{
+					ASSERT_TRUE(skip_list.Contains(EncodeKey(memory, ThreadKey(t, i - 1))));
+				}
+			}
+		}));
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	int count = 0;
+	std::string prev;
+	Table::Iterator it(&skip_list);
+	for (it.SeekToFirst(); it.Valid(); it.Next(), ++count)
+	{
+		ByteArray key(ExtractUserKey(it.key()));
+		std::string key_str(key.Data(), key.Size());
+		ASSERT_LT(prev, key_str);
+		prev = key_str;
+	}
+
+	ASSERT_EQ(count, (THREAD_NUM + 1) * KEY_NUM_PER_THREAD);
+
+	for (int t = 0; t <= THREAD_NUM; ++t)
+	{
+		for (int i = 0; i < KEY_NUM_PER_THREAD; ++i)
+		{
+			ASSERT_TRUE(skip_list.Contains(EncodeKey(memory, ThreadKey(t, i))));
+		}
+	}
+}
+
 int main()
 {
 	return RunAllTests();
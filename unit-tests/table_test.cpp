@@ -0,0 +1,820 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../db/data_base.h"
+#include "../db/file.h"
+#include "../db/table_builder.h"
+#include "../db/table_reader.h"
+#include "../util/coding.h"
+#include "../util/crc32c.h"
+#include "../util/utils.h"
+#include "../util/file_logger.h"
+#include "../structure/test_harness.h"
+
+class TableTest
+{
+public:
+	// The tables are written before any storage engine creates the folder.
+	TableTest()
+	{
+		mkdir(Constant::DataFolder.c_str(), 0777);
+	}
+};
+
+std::string TestKey(int i)
+{
+	char buf[16];
+	snprintf(buf, sizeof(buf), "key%06d", i);
+	return buf;
+}
+
+// Write the put entries of content, sorted by key, to a new file in the
+// legacy format, see format.h.
+void WriteLegacyFile(const std::string& file_path, std::vector<ByteArray>& content)
+{
+	WritableFile* file = WritableFile::Open(file_path);
+
+	// Lower and upper bound, each "key_size | key".
+	uint32_t offset = 0;
+	uint32_t key_size;
+	for (auto& bound : { content.front(), content.back() })
+	{
+		int len = GetVarint32(bound.Data(), 5, &key_size);
+		file->Append(bound.Data(), len + key_size);
+		offset += len + key_size;
+	}
+
+	// Entries are laid out "key_size | key | value_size | value" first, the
+	// header points past them to the "key_size | key | offset" index.
+	std::string entries;
+	std::string index;
+	uint32_t data_offset = offset + 4;
+	char encoded[10];
+	for (auto& entry : content)
+	{
+		ByteArray key(ExtractUserKey(entry));
+		int len = VarintLength(key.Size()) + key.Size();
+		index.append(entry.Data(), len);
+		index.append(encoded, EncodeVarint32(encoded, data_offset + entries.size()) - encoded);
+
+		// Skip the type.
+		entries.append(entry.Data(), len);
+		entries.append(entry.Data() + len + 1, entry.Size() - len - 1);
+	}
+
+	EncodeFixed32(encoded, data_offset + entries.size());
+	file->Append(encoded, 4);
+	file->Append(entries.data(), entries.size());
+	file->Append(index.data(), index.size());
+	file->Close();
+	delete file;
+}
+
+TEST(TableTest, BuildAndGet)
+{
+	TableOptions options;
+	options.block_size = 256;
+
+	std::string file_name = FileName(0, 1);
+	TableBuilder builder(options, WritableFile::Open(Constant::DataFolder + "/" + file_name));
+	for (int i = 0; i < 2000; i += 2)
+	{
+		std::string key = TestKey(i);
+		std::string value(i % 100, 'v');
+		builder.Add(ByteArray(key.data(), key.size()), ByteArray(value.data(), value.size()));
+	}
+
+	ASSERT_EQ(builder.Finish(), 0);
+	ASSERT_EQ(builder.NumEntries(), 1000);
+
+	File file(file_name);
+	ASSERT_TRUE(file.Reader() != nullptr);
+	ASSERT_EQ(file.Reader()->Version(), (int)kTableFormatVersion);
+	ASSERT_EQ(file.LowerBound(), TestKey(0));
+	ASSERT_EQ(file.UpperBound(), TestKey(1998));
+
+	for (int i = 0; i < 2000; ++i)
+	{
+		std::string key = TestKey(i);
+		std::string value_out;
+		int status = file.Reader()->Get(ByteArray(key.data(), key.size()), value_out);
+		if (i % 2 == 0)
+		{
+			ASSERT_EQ(status, 0);
+			ASSERT_EQ(value_out, std::string(i % 100, 'v'));
+		}
+		else
+		{
+			ASSERT_EQ(status, -1);
+		}
+	}
+
+	std::string value_out;
+	ASSERT_EQ(file.Reader()->Get(ByteArray("a", 1), value_out), -1);
+	ASSERT_EQ(file.Reader()->Get(ByteArray("z", 1), value_out), -1);
+
+	TableIterator* it = file.NewIterator();
+	int i = 0;
+	for (it->SeekToFirst(); it->Valid(); it->Next(), i += 2)
+	{
+		ASSERT_EQ(std::string(it->key().Data(), it->key().Size()), TestKey(i));
+	}
+
+	ASSERT_EQ(i, 2000);
+	delete it;
+	file.Delete();
+}
+
+TEST(TableTest, PrefixCompression)
+{
+	// Keys sharing a long tenant and table prefix.
+	std::string prefix = "tenant-000042/table-000007/";
+	uint64_t file_size[3];
+	int restart_intervals[] = { 1, 4, 16 };
+	for (int r = 0; r < 3; ++r)
+	{
+		TableOptions options;
+		options.block_restart_interval = restart_intervals[r];
+
+		std::string file_name = FileName(0, 1);
+		TableBuilder builder(options, WritableFile::Open(Constant::DataFolder + "/" + file_name));
+		for (int i = 0; i < 5000; ++i)
+		{
+			std::string key = prefix + TestKey(i);
+			builder.Add(ByteArray(key.data(), key.size()), ByteArray("v", 1));
+		}
+
+		ASSERT_EQ(builder.Finish(), 0);
+
+		File file(file_name);
+		file_size[r] = file.FileSize();
+		ASSERT_EQ(file.LowerBound(), prefix + TestKey(0));
+		ASSERT_EQ(file.UpperBound(), prefix + TestKey(4999));
+
+		for (int i = 0; i < 5000; ++i)
+		{
+			std::string key = prefix + TestKey(i);
+			std::string value_out;
+			ASSERT_EQ(file.Reader()->Get(ByteArray(key.data(), key.size()), value_out), 0);
+			ASSERT_EQ(value_out, "v");
+
+			// Sorts between two keys, or after the last one.
+			key.push_back('0');
+			ASSERT_EQ(file.Reader()->Get(ByteArray(key.data(), key.size()), value_out), -1);
+		}
+
+		TableIterator* it = file.NewIterator();
+		int i = 0;
+		for (it->SeekToFirst(); it->Valid(); it->Next(), ++i)
+		{
+			ASSERT_EQ(std::string(it->key().Data(), it->key().Size()), prefix + TestKey(i));
+		}
+
+		ASSERT_EQ(i, 5000);
+		delete it;
+		file.Delete();
+	}
+
+	ASSERT_TRUE(file_size[1] < file_size[0]);
+	ASSERT_TRUE(file_size[2] < file_size[1]);
+	ASSERT_TRUE(file_size[2] * 2 < file_size[0]);
+}
+
+TEST(TableTest, Compression)
+{
+	CompressionType types[] = { NoCompression, LzCompression, LzHighCompression };
+	for (auto type : types)
+	{
+		TableOptions options;
+		options.compression = type;
+
+		std::string file_name = FileName(0, 1);
+		TableBuilder builder(options, WritableFile::Open(Constant::DataFolder + "/" + file_name));
+		for (int i = 0; i < 2000; ++i)
+		{
+			std::string key = TestKey(i);
+			std::string value = "{\"id\":" + std::to_string(i) + ",\"state\":\"active\",\"owner\":\"alice\"}";
+			builder.Add(ByteArray(key.data(), key.size()), ByteArray(value.data(), value.size()));
+		}
+
+		ASSERT_EQ(builder.Finish(), 0);
+		if (type == NoCompression)
+		{
+			// Only the block trailers are added.
+			ASSERT_TRUE(builder.DataSize() > builder.RawDataSize());
+			ASSERT_TRUE(builder.DataSize() <= builder.RawDataSize() + (builder.RawDataSize() / options.block_size + 1) * kBlockTrailerSize);
+		}
+		else
+		{
+			ASSERT_TRUE(builder.DataSize() * 2 < builder.RawDataSize());
+		}
+
+		File file(file_name);
+		ASSERT_EQ(file.Reader()->Version(), (int)kTableFormatVersion);
+		ASSERT_EQ(file.UpperBound(), TestKey(1999));
+		for (int i = 0; i < 2000; ++i)
+		{
+			std::string key = TestKey(i);
+			std::string value_out;
+			ASSERT_EQ(file.Reader()->Get(ByteArray(key.data(), key.size()), value_out), 0);
+			ASSERT_EQ(value_out, "{\"id\":" + std::to_string(i) + ",\"state\":\"active\",\"owner\":\"alice\"}");
+		}
+
+		TableIterator* it = file.NewIterator();
+		int i = 0;
+		for (it->SeekToFirst(); it->Valid(); it->Next(), ++i)
+		{
+			ASSERT_EQ(std::string(it->key().Data(), it->key().Size()), TestKey(i));
+		}
+
+		ASSERT_EQ(i, 2000);
+		delete it;
+		file.Delete();
+	}
+}
+
+TEST(TableTest, Checksums)
+{
+	std::string file_name = FileName(0, 1);
+	TableBuilder builder(TableOptions(), WritableFile::Open(Constant::DataFolder + "/" + file_name));
+	for (int i = 0; i < 2000; ++i)
+	{
+		std::string key = TestKey(i);
+		builder.Add(ByteArray(key.data(), key.size()), ByteArray(key.data(), key.size()));
+	}
+
+	ASSERT_EQ(builder.Finish(), 0);
+
+	File file(file_name);
+	std::string contents(file.MMap(), file.FileSize());
+	file.Delete();
+
+	// Flip a bit in the first data block.
+	std::string data_corrupted = contents;
+	data_corrupted[100] ^= 1;
+	TableReader* table = TableReader::Open(data_corrupted.data(), data_corrupted.size());
+	ASSERT_TRUE(table != nullptr);
+	std::string first_key = TestKey(0), last_key = TestKey(1999), value_out;
+	ASSERT_EQ(table->Get(ByteArray(first_key.data(), first_key.size()), value_out), -2);
+	ASSERT_TRUE(table->Get(ByteArray(first_key.data(), first_key.size()), value_out, false) != -2);
+	ASSERT_EQ(table->Get(ByteArray(last_key.data(), last_key.size()), value_out), 0);
+	ASSERT_EQ(value_out, last_key);
+
+	TableIterator* it = table->NewIterator();
+	for (it->SeekToFirst(); it->Valid(); it->Next())
+	{
+	}
+
+	ASSERT_EQ(it->status(), -1);
+	delete it;
+	delete table;
+
+	// Flip a bit in the last byte of the index block, before its trailer.
+	std::string index_corrupted = contents;
+	index_corrupted[index_corrupted.size() - Footer::EncodedLength(kTableFormatVersion) - kBlockTrailerSize - 1] ^= 1;
+	table = TableReader::Open(index_corrupted.data(), index_corrupted.size());
+	ASSERT_TRUE(table != nullptr);
+	ASSERT_EQ(table->Get(ByteArray(last_key.data(), last_key.size()), value_out, false), -2);
+
+	it = table->NewIterator();
+	it->SeekToFirst();
+	ASSERT_TRUE(!it->Valid());
+	ASSERT_EQ(it->status(), -1);
+	delete it;
+	delete table;
+
+	table = TableReader::Open(contents.data(), contents.size());
+	it = table->NewIterator();
+	int n = 0;
+	for (it->SeekToFirst(); it->Valid(); it->Next())
+	{
+		n++;
+	}
+
+	ASSERT_EQ(n, 2000);
+	ASSERT_EQ(it->status(), 0);
+	delete it;
+	delete table;
+}
+
+TEST(TableTest, RangeDeletions)
+{
+	std::string file_name = FileName(0, 1);
+	TableBuilder builder(TableOptions(), WritableFile::Open(Constant::DataFolder + "/" + file_name));
+	for (int i = 100; i < 200; ++i)
+	{
+		std::string key = TestKey(i);
+		builder.Add(ByteArray(key.data(), key.size()), ByteArray(key.data(), key.size()));
+	}
+
+	std::string begin = TestKey(50), end = TestKey(150);
+	builder.AddRangeDeletion(RangeTombstone(ByteArray(begin.data(), begin.size()), ByteArray(end.data(), end.size())));
+	begin = TestKey(300);
+	end = TestKey(400);
+	builder.AddRangeDeletion(RangeTombstone(ByteArray(begin.data(), begin.size()), ByteArray(end.data(), end.size())));
+	ASSERT_EQ(builder.Finish(), 0);
+
+	// The bounds take the tombstones in, the entries are still read.
+	File file(file_name);
+	ASSERT_TRUE(!file.Reader()->Empty());
+	ASSERT_EQ(file.Reader()->RangeDeletions().size(), 2);
+	ASSERT_EQ(file.LowerBound(), TestKey(50));
+	ASSERT_EQ(file.UpperBound(), TestKey(400));
+	for (int i = 0; i < 500; ++i)
+	{
+		std::string key = TestKey(i);
+		std::string value_out;
+		ASSERT_EQ(file.Reader()->RangeDeleted(ByteArray(key.data(), key.size())), (i >= 50 && i < 150) || (i >= 300 && i < 400));
+		ASSERT_EQ(file.Reader()->Get(ByteArray(key.data(), key.size()), value_out), i >= 100 && i < 200 ? 0 : -1);
+	}
+
+	// A corrupted tombstone fails the lookups rather than being ignored.
+	std::string contents(file.MMap(), file.FileSize());
+	file.Delete();
+	contents[contents.find(TestKey(300))] ^= 1;
+	TableReader* table = TableReader::Open(contents.data(), contents.size());
+	ASSERT_TRUE(table != nullptr);
+	std::string key = TestKey(150), value_out;
+	ASSERT_EQ(table->Get(ByteArray(key.data(), key.size()), value_out), -2);
+	delete table;
+
+	// A file may hold nothing but tombstones.
+	file_name = FileName(0, 2);
+	TableBuilder tombstones_builder(TableOptions(), WritableFile::Open(Constant::DataFolder + "/" + file_name));
+	tombstones_builder.AddRangeDeletion(RangeTombstone(ByteArray(begin.data(), begin.size()), ByteArray(end.data(), end.size())));
+	ASSERT_EQ(tombstones_builder.Finish(), 0);
+
+	File tombstones_file(file_name);
+	ASSERT_TRUE(tombstones_file.Reader()->Empty());
+	ASSERT_EQ(tombstones_file.LowerBound(), TestKey(300));
+	ASSERT_EQ(tombstones_file.UpperBound(), TestKey(400));
+	key = TestKey(350);
+	ASSERT_TRUE(tombstones_file.Reader()->RangeDeleted(ByteArray(key.data(), key.size())));
+	ASSERT_EQ(tombstones_file.Reader()->Get(ByteArray(key.data(), key.size()), value_out), -1);
+	tombstones_file.Delete();
+}
+
+// Append the block and its trailer to a file being written at offset.
+void AppendBlock(FILE* stream, uint64_t& offset, BlockBuilder& block, BlockHandle& handle)
+{
+	ByteArray contents = block.Finish();
+	char trailer[kBlockTrailerSize];
+	trailer[0] = static_cast<char>(NoCompression);
+	EncodeFixed32(trailer + 1, Crc32cMask(Crc32cExtend(Crc32cValue(contents.Data(), contents.Size()), trailer, 1)));
+
+	handle.offset_ = offset;
+	handle.size_ = contents.Size();
+	fwrite(contents.Data(), 1, contents.Size(), stream);
+	fwrite(trailer, 1, kBlockTrailerSize, stream);
+	offset += contents.Size() + kBlockTrailerSize;
+}
+
+TEST(TableTest, LargeFile)
+{
+	BlockHandle handle, decoded;
+	handle.offset_ = 5ull << 32;
+	handle.size_ = 4096;
+	std::string encoded;
+	handle.EncodeTo(encoded);
+	ASSERT_TRUE(decoded.DecodeFrom(encoded.data(), encoded.data() + encoded.size()) == encoded.data() + encoded.size());
+	ASSERT_TRUE(decoded.offset_ == handle.offset_ && decoded.size_ == handle.size_);
+	ASSERT_TRUE(decoded.DecodeFrom(encoded.data(), encoded.data() + encoded.size() - 1) == nullptr);
+
+	// The data starts past 4GB, behind a hole of the sparse file.
+	std::string file_name = FileName(0, 1);
+	FILE* stream = fopen((Constant::DataFolder + "/" + file_name).c_str(), "w");
+	uint64_t offset = (4ull << 30) + 12345;
+	ASSERT_EQ(fseeko(stream, offset, SEEK_SET), 0);
+
+	BlockBuilder data_block(16);
+	for (int i = 0; i < 100; ++i)
+	{
+		std::string key = TestKey(i);
+		std::string value(1, static_cast<char>(TypeValue));
+		value.append(key);
+		data_block.Add(ByteArray(key.data(), key.size()), ByteArray(value.data(), value.size()));
+	}
+
+	Footer footer;
+	BlockHandle data_handle;
+	AppendBlock(stream, offset, data_block, data_handle);
+
+	BlockBuilder metaindex_block;
+	AppendBlock(stream, offset, metaindex_block, footer.metaindex_handle_);
+
+	BlockBuilder index_block;
+	std::string encoded_handle;
+	data_handle.EncodeTo(encoded_handle);
+	std::string last_key = TestKey(99);
+	index_block.Add(ByteArray(last_key.data(), last_key.size()), ByteArray(encoded_handle.data(), encoded_handle.size()));
+	AppendBlock(stream, offset, index_block, footer.index_handle_);
+
+	std::string encoded_footer;
+	footer.EncodeTo(encoded_footer);
+	ASSERT_EQ(encoded_footer.size(), Footer::EncodedLength(kTableFormatVersion));
+	fwrite(encoded_footer.data(), 1, encoded_footer.size(), stream);
+	fclose(stream);
+
+	File file(file_name);
+	ASSERT_TRUE(file.FileSize() > (4ull << 30));
+	ASSERT_TRUE(file.Reader() != nullptr);
+	ASSERT_EQ(file.LowerBound(), TestKey(0));
+	ASSERT_EQ(file.UpperBound(), TestKey(99));
+	for (int i = 0; i < 100; ++i)
+	{
+		std::string key = TestKey(i);
+		std::string value_out;
+		ASSERT_EQ(file.Reader()->Get(ByteArray(key.data(), key.size()), value_out), 0);
+		ASSERT_EQ(value_out, key);
+	}
+
+	file.Delete();
+}
+
+TEST(TableTest, ReadVersion1)
+{
+	// Version 1 blocks have no trailer.
+	std::string contents;
+	BlockBuilder data_block(16);
+	for (int i = 0; i < 100; ++i)
+	{
+		std::string key = TestKey(i);
+		data_block.Add(ByteArray(key.data(), key.size()), ByteArray("v1", 2));
+	}
+
+	Footer footer;
+	footer.version_ = 1;
+	BlockHandle data_handle;
+	ByteArray block = data_block.Finish();
+	data_handle.size_ = block.Size();
+	contents.append(block.Data(), block.Size());
+
+	BlockBuilder metaindex_block;
+	block = metaindex_block.Finish();
+	footer.metaindex_handle_.offset_ = contents.size();
+	footer.metaindex_handle_.size_ = block.Size();
+	contents.append(block.Data(), block.Size());
+
+	BlockBuilder index_block;
+	std::string encoded_handle;
+	data_handle.EncodeTo(encoded_handle, 1);
+	std::string last_key = TestKey(99);
+	index_block.Add(ByteArray(last_key.data(), last_key.size()), ByteArray(encoded_handle.data(), encoded_handle.size()));
+	block = index_block.Finish();
+	footer.index_handle_.offset_ = contents.size();
+	footer.index_handle_.size_ = block.Size();
+	contents.append(block.Data(), block.Size());
+	footer.EncodeTo(contents);
+
+	TableReader* table = TableReader::Open(contents.data(), contents.size());
+	ASSERT_TRUE(table != nullptr);
+	ASSERT_EQ(table->Version(), 1);
+	ASSERT_EQ(table->LastKey(), TestKey(99));
+	for (int i = 0; i < 100; ++i)
+	{
+		std::string key = TestKey(i);
+		std::string value_out;
+		ASSERT_EQ(table->Get(ByteArray(key.data(), key.size()), value_out), 0);
+		ASSERT_EQ(value_out, "v1");
+	}
+
+	delete table;
+}
+
+TEST(TableTest, BloomFilter)
+{
+	FilterType filter_types[] = { FilterNone, FilterBloom, FilterBlockedBloom, FilterXor };
+	for (auto filter_type : filter_types)
+	{
+		TableOptions options;
+		options.filter_type = filter_type;
+
+		std::string file_name = FileName(0, 1);
+		TableBuilder builder(options, WritableFile::Open(Constant::DataFolder + "/" + file_name));
+		for (int i = 0; i < 10000; i += 2)
+		{
+			std::string key = TestKey(i);
+			builder.Add(ByteArray(key.data(), key.size()), ByteArray("v", 1));
+		}
+
+		ASSERT_EQ(builder.Finish(), 0);
+
+		File file(file_name);
+		ASSERT_EQ(file.Reader()->GetFilterType(), filter_type);
+		ASSERT_EQ(file.Reader()->FilterSize(), builder.FilterSize());
+
+		int false_positives = 0;
+		for (int i = 0; i < 10000; ++i)
+		{
+			std::string key = TestKey(i);
+			bool may_match = file.Reader()->KeyMayMatch(ByteArray(key.data(), key.size()));
+			if (i % 2 == 0)
+			{
+				ASSERT_TRUE(may_match);
+			}
+			else if (may_match)
+			{
+				false_positives++;
+			}
+		}
+
+		if (filter_type == FilterNone)
+		{
+			ASSERT_EQ(file.Reader()->FilterSize(), 0);
+			ASSERT_EQ(false_positives, 5000);
+		}
+		else
+		{
+			// About 1% expected at 10 bits per key, 0.4% for the xor filter.
+			ASSERT_TRUE(file.Reader()->FilterSize() * 8 < 5000 * 11);
+			ASSERT_TRUE(false_positives < 100);
+		}
+
+		file.Delete();
+	}
+}
+
+TEST(TableTest, CorruptedFiles)
+{
+	std::string file_name = FileName(0, 1);
+	TableBuilder builder(TableOptions(), WritableFile::Open(Constant::DataFolder + "/" + file_name));
+	for (int i = 0; i < 100; ++i)
+	{
+		std::string key = TestKey(i);
+		builder.Add(ByteArray(key.data(), key.size()), ByteArray(key.data(), key.size()));
+	}
+
+	ASSERT_EQ(builder.Finish(), 0);
+
+	std::string contents;
+	{
+		File file(file_name);
+		ASSERT_TRUE(!file.Corrupted());
+		contents.assign(file.MMap(), file.FileSize());
+		file.Delete();
+	}
+
+	// A table whose magic is broken is not read as a legacy file.
+	contents[contents.size() - 1] ^= 1;
+	ASSERT_TRUE(!IsLegacyTable(contents.data(), contents.size()));
+	WritableFile* writable_file = WritableFile::Open(Constant::DataFolder + "/" + file_name);
+	writable_file->Append(contents.data(), contents.size());
+	writable_file->Close();
+	delete writable_file;
+
+	{
+		File file(file_name);
+		ASSERT_TRUE(file.Corrupted());
+		ASSERT_TRUE(file.Reader() == nullptr);
+		TableIterator* it = file.NewIterator();
+		it->SeekToFirst();
+		ASSERT_TRUE(!it->Valid());
+		ASSERT_EQ(it->status(), -1);
+		delete it;
+	}
+
+	// Neither is a legacy file cut in its index.
+	std::vector<std::string> entries(10);
+	std::vector<ByteArray> content;
+	for (int i = 0; i < 10; ++i)
+	{
+		AppendEntry(entries[i], ByteArray(TestKey(i).data(), 9), ByteArray("old", 3));
+		content.push_back(ByteArray(entries[i].data(), entries[i].size()));
+	}
+
+	std::string legacy_name = FileName(1, 2);
+	WriteLegacyFile(Constant::DataFolder + "/" + legacy_name, content);
+	{
+		File file(legacy_name);
+		ASSERT_TRUE(!file.Corrupted());
+		ASSERT_TRUE(IsLegacyTable(file.MMap(), file.FileSize()));
+		ASSERT_TRUE(!IsLegacyTable(file.MMap(), file.FileSize() - 1));
+	}
+
+	// A folder without a manifest holding a corrupted file is not opened.
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(1 << 20, &file_logger, &event_manager);
+	remove((Constant::DataFolder + "/CURRENT").c_str());
+	{
+		StorageEngine storage_engine(&file_logger, 1, &event_manager, &storage_buffer);
+		ASSERT_TRUE(storage_engine.HasError());
+	}
+
+	ASSERT_EQ(access((Constant::DataFolder + "/" + file_name).c_str(), 0), 0);
+	remove((Constant::DataFolder + "/" + file_name).c_str());
+	remove((Constant::DataFolder + "/" + legacy_name).c_str());
+}
+
+TEST(TableTest, LegacyAndTableFiles)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(1 << 20, &file_logger, &event_manager);
+
+	// Level 1 file written by the old flush: every key of [0, 300).
+	std::vector<std::string> legacy_entries;
+	std::vector<ByteArray> content;
+	for (int i = 0; i < 300; ++i)
+	{
+		std::string entry;
+		AppendEntry(entry, ByteArray(TestKey(i).data(), 9), ByteArray("old", 3));
+		legacy_entries.push_back(entry);
+	}
+
+	for (auto& entry : legacy_entries)
+	{
+		content.push_back(ByteArray(entry.data(), entry.size()));
+	}
+
+	WriteLegacyFile(Constant::DataFolder + "/" + FileName(1, 1), content);
+
+	// Two newer level 0 tables overwriting the even keys of [0, 200) and [100, 300).
+	for (int f = 0; f < 2; ++f)
+	{
+		TableBuilder builder(TableOptions(), WritableFile::Open(Constant::DataFolder + "/" + FileName(0, 2 + f)));
+		for (int i = f * 100; i < f * 100 + 200; i += 2)
+		{
+			std::string key = TestKey(i);
+			std::string value = "new" + std::to_string(f);
+			builder.Add(ByteArray(key.data(), key.size()), ByteArray(value.data(), value.size()));
+		}
+
+		ASSERT_EQ(builder.Finish(), 0);
+	}
+
+	// The files written above are adopted as in a folder without a manifest.
+	remove((Constant::DataFolder + "/CURRENT").c_str());
+	StorageEngine storage_engine(&file_logger, 1, &event_manager, &storage_buffer);
+	LRUCache cache(2);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache);
+
+	auto check = [&data_base]() {
+		for (int i = 0; i < 300; ++i)
+		{
+			std::string key = TestKey(i);
+			std::string value_out;
+			ASSERT_EQ(data_base.Get(key, value_out), 0);
+			if (i % 2 == 1)
+			{
+				ASSERT_EQ(value_out, "old");
+			}
+			else
+			{
+				ASSERT_EQ(value_out, i >= 100 ? "new1" : "new0");
+			}
+		}
+	};
+
+	check();
+
+	// Both formats are merged into table files of level 1.
+	storage_engine.Compact(0);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(0), 0);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(1), 1);
+	data_base.ClearCache();
+	check();
+
+	std::vector<std::vector<File*>> contains_files;
+	std::string key = TestKey(0);
+	Version* version = storage_engine.CurrentVersion();
+	version->GetContainsFiles(key, contains_files);
+	version->Unref();
+	ASSERT_EQ(contains_files[1].size(), 1);
+	ASSERT_TRUE(contains_files[1][0]->Reader() != nullptr);
+	// Level 1 is the last level, so the output got the xor filter.
+	ASSERT_EQ(contains_files[1][0]->Reader()->GetFilterType(), FilterXor);
+	contains_files[1][0]->Delete();
+}
+
+TEST(TableTest, DeletionCompaction)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(1 << 20, &file_logger, &event_manager);
+
+	// Level 1 deletes [0, 50) of level 3, level 2 holds unrelated keys.
+	TableBuilder deletions_builder(TableOptions(), WritableFile::Open(Constant::DataFolder + "/" + FileName(1, 3)));
+	for (int i = 0; i < 60; ++i)
+	{
+		std::string key = TestKey(i);
+		deletions_builder.Add(ByteArray(key.data(), key.size()), ByteArray("new", i < 50 ? 0 : 3), i < 50 ? TypeDeletion : TypeValue);
+	}
+
+	ASSERT_EQ(deletions_builder.Finish(), 0);
+	ASSERT_EQ(deletions_builder.NumDeletions(), 50);
+
+	for (int level = 2; level <= 3; ++level)
+	{
+		TableBuilder builder(TableOptions(), WritableFile::Open(Constant::DataFolder + "/" + FileName(level, 4 - level)));
+		for (int i = level == 2 ? 200 : 0; i < (level == 2 ? 300 : 100); ++i)
+		{
+			std::string key = TestKey(i);
+			builder.Add(ByteArray(key.data(), key.size()), ByteArray("old", 3));
+		}
+
+		ASSERT_EQ(builder.Finish(), 0);
+	}
+
+	// The files written above are adopted as in a folder without a manifest.
+	remove((Constant::DataFolder + "/CURRENT").c_str());
+	StorageEngine storage_engine(&file_logger, 1, &event_manager, &storage_buffer);
+	LRUCache cache(2);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache);
+
+	// No level is full, the deletions alone get the file compacted. They are
+	// kept while level 3 holds the keys, then dropped with what they delete.
+	storage_engine.Compact(1);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(1), 0);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(2), 1);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(3), 1);
+
+	for (int i = 0; i < 300; ++i)
+	{
+		std::string key = TestKey(i);
+		std::string value_out;
+		if (i < 50 || (i >= 100 && i < 200))
+		{
+			ASSERT_EQ(data_base.Get(key, value_out), -1);
+		}
+		else
+		{
+			ASSERT_EQ(data_base.Get(key, value_out), 0);
+			ASSERT_EQ(value_out, i < 60 ? "new" : "old");
+		}
+	}
+
+	std::vector<std::vector<File*>> contains_files;
+	std::string key = TestKey(50);
+	Version* version = storage_engine.CurrentVersion();
+	version->GetContainsFiles(key, contains_files);
+	File* file = contains_files.back()[0];
+	ASSERT_EQ(file->LevelId(), 3);
+	ASSERT_EQ(file->LowerBound(), TestKey(50));
+	ASSERT_EQ(file->Reader()->Properties().num_entries_, 50);
+	ASSERT_EQ(file->Reader()->Properties().num_deletions_, 0);
+	file->Delete();
+
+	key = TestKey(250);
+	contains_files.clear();
+	version->GetContainsFiles(key, contains_files);
+	version->Unref();
+	for (auto& files : contains_files)
+	{
+		for (auto& file : files)
+		{
+			file->Delete();
+		}
+	}
+}
+
+TEST(TableTest, BottommostDeletionCompaction)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(1 << 20, &file_logger, &event_manager);
+
+	// Level 1 is the last level and mostly deletions.
+	TableBuilder builder(TableOptions(), WritableFile::Open(Constant::DataFolder + "/" + FileName(1, 1)));
+	for (int i = 0; i < 60; ++i)
+	{
+		std::string key = TestKey(i);
+		builder.Add(ByteArray(key.data(), key.size()), ByteArray("new", i < 50 ? 0 : 3), i < 50 ? TypeDeletion : TypeValue);
+	}
+
+	ASSERT_EQ(builder.Finish(), 0);
+
+	remove((Constant::DataFolder + "/CURRENT").c_str());
+	StorageEngine storage_engine(&file_logger, 1, &event_manager, &storage_buffer);
+
+	// Rewritten without its deletions, and not pushed down a level.
+	storage_engine.Compact(1);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(1), 1);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(2), 0);
+
+	std::vector<std::vector<File*>> contains_files;
+	std::string key = TestKey(55);
+	Version* version = storage_engine.CurrentVersion();
+	version->GetContainsFiles(key, contains_files);
+	version->Unref();
+	ASSERT_EQ(contains_files.back().size(), 1);
+	File* file = contains_files.back()[0];
+	ASSERT_EQ(file->LevelId(), 1);
+	ASSERT_TRUE(file->FileName() != FileName(1, 1));
+	ASSERT_EQ(file->Reader()->Properties().num_entries_, 10);
+	ASSERT_EQ(file->Reader()->Properties().num_deletions_, 0);
+	file->Delete();
+}
+
+int main()
+{
+	return RunAllTests();
+}
@@ -0,0 +1,159 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../db/value_log.h"
+#include "../type/constant.h"
+#include "../util/file_logger.h"
+#include "../util/sequence_generator.h"
+#include "../structure/test_harness.h"
+
+class ValueLogTest { };
+
+TEST(ValueLogTest, AddAndGet)
+{
+	srand(190);
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	std::vector<std::string> values;
+	std::vector<ValuePointer> pointers;
+
+	{
+		ValueLog value_log(&file_logger, 16 << 10);
+		ASSERT_EQ(value_log.Open(), 0);
+		for (int i = 0; i < 200; ++i)
+		{
+			std::string key = "key" + std::to_string(i);
+			values.push_back(RandomString(500 + rand() % 1000));
+			ValuePointer pointer;
+			ASSERT_EQ(value_log.Add(ByteArray(key.data(), key.size()), ByteArray(values[i].data(), values[i].size()), pointer), 0);
+			pointers.push_back(pointer);
+		}
+
+		ASSERT_EQ(value_log.Sync(), 0);
+		ASSERT_TRUE(value_log.FilesNumber() > 1);
+		for (int i = 0; i < 200; ++i)
+		{
+			std::string encoded;
+			pointers[i].EncodeTo(encoded);
+			ValuePointer decoded;
+			ASSERT_TRUE(decoded.DecodeFrom(ByteArray(encoded.data(), encoded.size())));
+			ASSERT_TRUE(decoded == pointers[i]);
+
+			std::string value_out;
+			ASSERT_EQ(value_log.Get(decoded, value_out), 0);
+			ASSERT_EQ(value_out, values[i]);
+		}
+
+		// Every file but the head one can be read back whole.
+		std::string buf;
+		std::vector<ValueLog::Record> records;
+		ASSERT_EQ(value_log.ReadFile(pointers[0].file_number_, buf, records), 0);
+		ASSERT_TRUE(records.size() > 1);
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			ASSERT_TRUE(records[i].pointer_ == pointers[i]);
+			ASSERT_EQ(std::string(records[i].key_.Data(), records[i].key_.Size()), "key" + std::to_string(i));
+			ASSERT_EQ(std::string(records[i].value_.Data(), records[i].value_.Size()), values[i]);
+		}
+
+		ValuePointer missing = pointers[199];
+		missing.offset_ += 1;
+		std::string value_out;
+		ASSERT_EQ(value_log.Get(missing, value_out), -1);
+	}
+
+	// Reopened, the values are still there and appends go to a new file.
+	ValueLog value_log(&file_logger, 16 << 10);
+	ASSERT_EQ(value_log.Open(), 0);
+	for (int i = 0; i < 200; ++i)
+	{
+		std::string value_out;
+		ASSERT_EQ(value_log.Get(pointers[i], value_out), 0);
+		ASSERT_EQ(value_out, values[i]);
+	}
+
+	ValuePointer pointer;
+	ASSERT_EQ(value_log.Add(ByteArray("key", 3), ByteArray("value", 5), pointer), 0);
+	ASSERT_TRUE(pointer.file_number_ > pointers[199].file_number_);
+	ASSERT_EQ(pointer.offset_, 0);
+}
+
+TEST(ValueLogTest, Garbage)
+{
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	ValueLog value_log(&file_logger, 16 << 10, 0.5);
+	ASSERT_EQ(value_log.Open(), 0);
+
+	std::vector<ValuePointer> pointers;
+	std::string value(1000, 'v');
+	while (pointers.empty() || pointers.back().file_number_ == pointers.front().file_number_)
+	{
+		ValuePointer pointer;
+		ASSERT_EQ(value_log.Add(ByteArray("key", 3), ByteArray(value.data(), value.size()), pointer), 0);
+		pointers.push_back(pointer);
+	}
+
+	ASSERT_EQ(value_log.Sync(), 0);
+	ASSERT_EQ(value_log.PickGarbageFile(), 0);
+
+	// The head file is never collected.
+	value_log.Discard(pointers.back());
+	ASSERT_EQ(value_log.PickGarbageFile(), 0);
+
+	uint64_t number = pointers.front().file_number_;
+	uint64_t file_size = 0;
+	for (size_t i = 0; i + 1 < pointers.size(); ++i)
+	{
+		file_size += pointers[i].size_;
+	}
+
+	// Just below half of the file.
+	int i = 0;
+	uint64_t discarded = 0;
+	while ((discarded + pointers[i].size_) * 2 < file_size)
+	{
+		value_log.Discard(pointers[i]);
+		discarded += pointers[i++].size_;
+	}
+
+	ASSERT_EQ(value_log.PickGarbageFile(), 0);
+	value_log.Discard(pointers[i]);
+	ASSERT_EQ(value_log.PickGarbageFile(), number);
+
+	value_log.RemoveFile(number);
+	ASSERT_EQ(value_log.PickGarbageFile(), 0);
+	std::string value_out;
+	ASSERT_EQ(value_log.Get(pointers.front(), value_out), -1);
+}
+
+TEST(ValueLogTest, UnreadableFile)
+{
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	std::string path = Constant::ValueLogFolder + "/999999.vlog";
+
+	// Its values exist nowhere else, the log is not opened without them.
+	{
+		ValueLog value_log(&file_logger);
+		ASSERT_EQ(value_log.Open(), 0);
+	}
+
+	ASSERT_EQ(symlink("missing.vlog", path.c_str()), 0);
+	{
+		ValueLog value_log(&file_logger);
+		ASSERT_EQ(value_log.Open(), -1);
+	}
+
+	remove(path.c_str());
+}
+
+int main()
+{
+	return RunAllTests();
+}
@@ -0,0 +1,154 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../db/data_base.h"
+#include "../db/event_manager.h"
+#include "../db/storage_buffer.h"
+#include "../db/storage_engine.h"
+#include "../db/version.h"
+#include "../structure/cache.h"
+#include "../util/file_logger.h"
+#include "../structure/test_harness.h"
+
+class VersionTest { };
+
+std::string VersionKey(int i)
+{
+	char buf[16];
+	snprintf(buf, sizeof(buf), "version%05d", i);
+	return buf;
+}
+
+// Write keys [begin, end) with value to a new level 0 file.
+std::string AddLevel0File(StorageEngine& storage_engine, int begin, int end, const std::string& value)
+{
+	int file_id;
+	std::string file_name;
+	TableBuilder* builder = storage_engine.NewTableBuilder(storage_engine.NewWritableFile(file_id, file_name));
+	for (int i = begin; i < end; ++i)
+	{
+		std::string key = VersionKey(i);
+		builder->Add(ByteArray(key.data(), key.size()), ByteArray(value.data(), value.size()));
+	}
+
+	builder->Finish();
+	delete builder;
+	storage_engine.AddFile(file_name);
+	return file_name;
+}
+
+TEST(VersionTest, PinnedFilesOutliveCompaction)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(1 << 20, &file_logger, &event_manager);
+	system(("rm -rf " + Constant::DataFolder).c_str());
+	StorageEngine storage_engine(&file_logger, 1, &event_manager, &storage_buffer);
+
+	std::string old_files[2];
+	old_files[0] = AddLevel0File(storage_engine, 0, 100, "a");
+	old_files[1] = AddLevel0File(storage_engine, 50, 150, "b");
+
+	Version* version = storage_engine.CurrentVersion();
+	ASSERT_EQ(version->LevelFilesNumber(0), 2);
+
+	// The inputs are merged into one level 1 file, but stay for the version.
+	storage_engine.Compact(0);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(0), 0);
+	ASSERT_EQ(storage_engine.LevelFilesNumber(1), 1);
+	ASSERT_EQ(version->LevelFilesNumber(0), 2);
+	ASSERT_EQ(version->LevelFilesNumber(1), 0);
+
+	std::string key = VersionKey(60);
+	std::vector<std::vector<File*>> contains_files;
+	version->GetContainsFiles(key, contains_files);
+	ASSERT_EQ(contains_files[0].size(), 2);
+	std::string value_out;
+	ASSERT_EQ(contains_files[0][0]->Reader()->Get(ByteArray(key.data(), key.size()), value_out), 0);
+	ASSERT_TRUE(value_out == "b");
+	for (auto& file_name : old_files)
+	{
+		ASSERT_TRUE(access((Constant::DataFolder + "/" + file_name).c_str(), 0) == 0);
+	}
+
+	// Removed with the last reference.
+	version->Unref();
+	for (auto& file_name : old_files)
+	{
+		ASSERT_TRUE(access((Constant::DataFolder + "/" + file_name).c_str(), 0) != 0);
+	}
+
+	version = storage_engine.CurrentVersion();
+	contains_files.clear();
+	version->GetContainsFiles(key, contains_files);
+	ASSERT_EQ(contains_files[1].size(), 1);
+	ASSERT_EQ(contains_files[1][0]->Reader()->Get(ByteArray(key.data(), key.size()), value_out), 0);
+	ASSERT_TRUE(value_out == "b");
+	version->Unref();
+}
+
+TEST(VersionTest, ReadsDuringCompaction)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(1 << 20, &file_logger, &event_manager);
+	system(("rm -rf " + Constant::DataFolder).c_str());
+	StorageEngine storage_engine(&file_logger, 1, &event_manager, &storage_buffer);
+	LRUCache cache(2);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache);
+
+	AddLevel0File(storage_engine, 0, 1000, "round0");
+
+	// Every key is found in some version while files are flushed and
+	// compacted away under the readers.
+	std::atomic<bool> stop(false);
+	std::atomic<int> bad(0);
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 4; ++t)
+	{
+		readers.push_back(std::thread([&data_base, &stop, &bad, t]()
+		{
+			for (int i = t; !stop.load(); i = (i + 7) % 1000)
+			{
+				std::string key = VersionKey(i);
+				std::string value_out;
+				if (data_base.Get(key, value_out) != 0 || value_out.compare(0, 5, "round") != 0)
+				{
+					bad.fetch_add(1);
+				}
+			}
+		}));
+	}
+
+	for (int round = 1; round <= 20; ++round)
+	{
+		AddLevel0File(storage_engine, (round * 100) % 1000, (round * 100) % 1000 + 300, "round" + std::to_string(round));
+		storage_engine.Compact(0);
+	}
+
+	stop.store(true);
+	for (auto& reader : readers)
+	{
+		reader.join();
+	}
+
+	ASSERT_EQ(bad.load(), 0);
+	std::string key = VersionKey(1200 % 1000);
+	std::string value_out;
+	ASSERT_EQ(data_base.Get(key, value_out), 0);
+	ASSERT_TRUE(value_out == "round20");
+}
+
+int main()
+{
+	return RunAllTests();
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "../db/writable_file.h"
+#include "../structure/test_harness.h"
+
+class WritableFileTest { };
+
+std::string ReadFile(const std::string& path)
+{
+	std::string contents;
+	FILE* stream = fopen(path.c_str(), "r");
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), stream)) > 0)
+	{
+		contents.append(buf, n);
+	}
+
+	fclose(stream);
+	return contents;
+}
+
+TEST(WritableFileTest, Append)
+{
+	std::string path = "./writable_file_test";
+
+	// Small pieces are gathered, pieces past the buffer go straight through,
+	// also right after a partly filled buffer.
+	std::string expected;
+	for (int i = 0; i < 10000; ++i)
+	{
+		expected.append(std::to_string(i));
+	}
+
+	expected.append(WritableFile::kBufferSize + 7, 'a');
+	expected.append("b");
+	expected.append(3 * WritableFile::kBufferSize, 'c');
+
+	for (int round = 0; round < 2; ++round)
+	{
+		WritableFile* file = WritableFile::Open(path, 16 << 20, round == 0 ? 0 : 1 << 16);
+		ASSERT_TRUE(file != nullptr);
+
+		size_t offset = 0;
+		size_t sizes[] = { 1, 10, 1000, WritableFile::kBufferSize + 5, 3 };
+		for (int i = 0; offset < expected.size(); ++i)
+		{
+			size_t size = std::min(sizes[i % 5], expected.size() - offset);
+			ASSERT_EQ(file->Append(expected.data() + offset, size), 0);
+			offset += size;
+			ASSERT_EQ(file->Size(), offset);
+		}
+
+		ASSERT_EQ(file->Sync(), 0);
+		ASSERT_EQ(file->Close(), 0);
+		delete file;
+
+		// Nothing reserved is left past the end.
+		struct stat statbuff;
+		ASSERT_EQ(stat(path.c_str(), &statbuff), 0);
+		ASSERT_EQ(static_cast<size_t>(statbuff.st_size), expected.size());
+		ASSERT_TRUE(ReadFile(path) == expected);
+	}
+
+	// The destructor closes a file that was not closed.
+	WritableFile* file = WritableFile::Open(path, 1 << 20);
+	ASSERT_EQ(file->Append("abc", 3), 0);
+	delete file;
+	ASSERT_TRUE(ReadFile(path) == "abc");
+
+	remove(path.c_str());
+	ASSERT_TRUE(WritableFile::Open("./no_such_folder/file") == nullptr);
+}
+
+int main()
+{
+	return RunAllTests();
+}
@@ -0,0 +1,156 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../db/write_ahead_log.h"
+#include "../type/constant.h"
+#include "../util/utils.h"
+#include "../util/file_logger.h"
+#include "../util/sequence_generator.h"
+#include "../structure/test_harness.h"
+
+#define THREAD_NUM 8
+#define RECORD_NUM 1000
+
+class WriteAheadLogTest { };
+
+uint64_t SegmentSize(uint64_t number)
+{
+	struct stat statbuff;
+	std::string path = Constant::LogFolder + "/" + LogFileName(number);
+	if (stat(path.c_str(), &statbuff) < 0)
+	{
+		return 0;
+	}
+
+	return statbuff.st_size;
+}
+
+TEST(WriteAheadLogTest, GroupCommit)
+{
+	FileLogger logger("./log.txt", LogLevelTrace, true, true);
+	WriteAheadLog wal(&logger, WriteAheadLog::SyncEveryBatch);
+	ASSERT_EQ(wal.Open(), 0);
+	uint64_t first = wal.SegmentNumber();
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREAD_NUM; ++i)
+	{
+		threads.push_back(std::thread([&wal]() {
+			std::string record(100, 'x');
+			for (int j = 0; j < RECORD_NUM; ++j)
+			{
+				ASSERT_EQ(wal.AddRecord(ByteArray(record.data(), record.size())), 0);
+			}
+		}));
+	}
+
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+
+	uint64_t second = wal.NewSegment();
+	ASSERT_EQ(second, first + 1);
+	ASSERT_EQ(SegmentSize(first), 8 + (uint64_t)THREAD_NUM * RECORD_NUM * (8 + 100));
+
+	wal.RemoveSegmentsBefore(second);
+	std::vector<uint64_t> segments = wal.Segments();
+	ASSERT_EQ(segments.size(), 1);
+	ASSERT_EQ(segments[0], second);
+	wal.Close();
+}
+
+TEST(WriteAheadLogTest, ApplyInLogOrder)
+{
+	FileLogger logger("./log.txt", LogLevelTrace, true, true);
+	WriteAheadLog wal(&logger, WriteAheadLog::SyncNone);
+	ASSERT_EQ(wal.Open(), 0);
+	uint64_t number = wal.NewSegment();
+
+	// Only the leaders apply, one group after the other.
+	std::vector<std::string> applied;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREAD_NUM; ++i)
+	{
+		threads.push_back(std::thread([&wal, &applied, i]() {
+			for (int j = 0; j < RECORD_NUM; ++j)
+			{
+				std::string key = std::to_string(i) + "_" + std::to_string(j);
+				std::string record;
+				AppendEntry(record, ByteArray(key.data(), key.size()), ByteArray("", 0));
+				std::function<void()> apply = [&applied, &key]() { applied.push_back(key); };
+				ASSERT_EQ(wal.AddRecord(ByteArray(record.data(), record.size()), apply), 0);
+			}
+		}));
+	}
+
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+
+	wal.NewSegment();
+	Memory memory;
+	std::vector<const char*> entries;
+	ASSERT_EQ(wal.ReadSegment(number, &memory, entries), 0);
+	ASSERT_EQ(entries.size(), applied.size());
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		ByteArray key = ExtractUserKey(entries[i]);
+		ASSERT_EQ(std::string(key.Data(), key.Size()), applied[i]);
+	}
+
+	wal.Close();
+}
+
+TEST(WriteAheadLogTest, CorruptedRecord)
+{
+	FileLogger logger("./log.txt", LogLevelTrace, true, true);
+	WriteAheadLog wal(&logger, WriteAheadLog::SyncNone);
+	ASSERT_EQ(wal.Open(), 0);
+	uint64_t number = wal.NewSegment();
+
+	std::string record;
+	AppendEntry(record, ByteArray("a", 1), ByteArray("1", 1));
+	for (int i = 0; i < 3; ++i)
+	{
+		ASSERT_EQ(wal.AddRecord(ByteArray(record.data(), record.size())), 0);
+	}
+
+	wal.Close();
+
+	// Flip a byte of the second payload, reading stops before it.
+	FILE* stream = fopen((Constant::LogFolder + "/" + LogFileName(number)).c_str(), "r+");
+	fseek(stream, 8 + (8 + record.size()) + 8, SEEK_SET);
+	int c = fgetc(stream);
+	fseek(stream, -1, SEEK_CUR);
+	fputc(c ^ 0x01, stream);
+	fclose(stream);
+
+	Memory memory;
+	std::vector<const char*> entries;
+	ASSERT_EQ(wal.ReadSegment(number, &memory, entries), 1);
+	ASSERT_EQ(entries.size(), 1);
+
+	// A torn tail stops reading as well.
+	truncate((Constant::LogFolder + "/" + LogFileName(number)).c_str(), 8 + (8 + record.size()) + 4);
+	Memory torn_memory;
+	entries.clear();
+	ASSERT_EQ(wal.ReadSegment(number, &torn_memory, entries), 1);
+	ASSERT_EQ(entries.size(), 1);
+}
+
+int main()
+{
+	return RunAllTests();
+}
@@ -0,0 +1,157 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../db/data_base.h"
+#include "../db/write_batch.h"
+#include "../type/constant.h"
+#include "../util/file_logger.h"
+#include "../structure/test_harness.h"
+
+class WriteBatchTest { };
+
+ByteArray Bytes(const std::string& str)
+{
+	return ByteArray(str.data(), str.size());
+}
+
+TEST(WriteBatchTest, WriteAndRecover)
+{
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+
+	{
+		EventManager event_manager;
+		StorageBuffer storage_buffer(64 << 20, &file_logger, &event_manager, 2, 4);
+		LRUCache cache(2);
+		StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+		WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone);
+		DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+		data_base.Start();
+
+		WriteBatch batch;
+		for (int i = 0; i < 1000; ++i)
+		{
+			std::string key = "key" + std::to_string(i);
+			batch.Put(Bytes(key), Bytes(key));
+		}
+
+		// Later operations on a key win.
+		batch.Put(Bytes("key1"), Bytes("new"));
+		batch.Delete(Bytes("key2"));
+		ASSERT_EQ(batch.Count(), 1002);
+		ASSERT_EQ(data_base.Write(batch), 0);
+
+		batch.Clear();
+		ASSERT_EQ(batch.Count(), 0);
+		ASSERT_EQ(data_base.Write(batch), 0);
+
+		data_base.ShutDown();
+	}
+
+	// The batch only lives in the log, it is replayed as a whole.
+	EventManager event_manager;
+	StorageBuffer storage_buffer(64 << 20, &file_logger, &event_manager);
+	LRUCache cache(2);
+	StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+	WriteAheadLog write_ahead_log(&file_logger, WriteAheadLog::SyncNone);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache, &write_ahead_log);
+	data_base.Start();
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::string key = "key" + std::to_string(i);
+		std::string value_out;
+		if (i == 2)
+		{
+			ASSERT_EQ(data_base.Get(key, value_out), -1);
+			continue;
+		}
+
+		ASSERT_EQ(data_base.Get(key, value_out), 0);
+		if (i == 1)
+		{
+			ASSERT_EQ(value_out, "new");
+		}
+		else
+		{
+			ASSERT_EQ(value_out, key);
+		}
+	}
+
+	data_base.ShutDown();
+}
+
+TEST(WriteBatchTest, ConcurrentReadersSeeWholeBatches)
+{
+	FileLogger file_logger("./log.txt", LogLevelWarn, true, true);
+	EventManager event_manager;
+	StorageBuffer storage_buffer(64 << 20, &file_logger, &event_manager, 2, 4);
+	LRUCache cache(2);
+	StorageEngine storage_engine(&file_logger, 2, &event_manager, &storage_buffer);
+	DataBase data_base(&event_manager, &storage_buffer, &storage_engine, &file_logger, &cache);
+	data_base.Start();
+
+	// Every batch writes its round to all the keys, in key order.
+	const int keys_num = 100;
+	const int rounds = 2000;
+	std::atomic<bool> done(false);
+	std::atomic<int> partial_batches(0);
+
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 2; ++t)
+	{
+		readers.push_back(std::thread([&]()
+		{
+			while (!done)
+			{
+				// A key read later was written later by the same batch, it
+				// cannot hold an older round than a key read before it.
+				int last_round = -1;
+				for (int i = 0; i < keys_num; ++i)
+				{
+					std::string key = "atomic" + std::to_string(i);
+					std::string value_out;
+					int round = data_base.Get(key, value_out) == 0 ? std::stoi(value_out) : -1;
+					if (round < last_round)
+					{
+						++partial_batches;
+					}
+
+					last_round = round;
+				}
+			}
+		}));
+	}
+
+	for (int round = 0; round < rounds; ++round)
+	{
+		WriteBatch batch;
+		std::string value = std::to_string(round);
+		for (int i = 0; i < keys_num; ++i)
+		{
+			std::string key = "atomic" + std::to_string(i);
+			batch.Put(Bytes(key), Bytes(value));
+		}
+
+		ASSERT_EQ(data_base.Write(batch), 0);
+	}
+
+	done = true;
+	for (auto& reader : readers)
+	{
+		reader.join();
+	}
+
+	ASSERT_EQ(partial_batches.load(), 0);
+	data_base.ShutDown();
+}
+
+int main()
+{
+	return RunAllTests();
+}
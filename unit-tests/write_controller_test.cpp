@@ -0,0 +1,78 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "../db/event_manager.h"
+#include "../db/storage_buffer.h"
+#include "../db/storage_engine.h"
+#include "../db/write_controller.h"
+#include "../util/file_logger.h"
+#include "../structure/test_harness.h"
+
+class WriteControllerTest { };
+
+TEST(WriteControllerTest, SlowdownAndStall)
+{
+	EventManager event_manager;
+	FileLogger file_logger("./log.txt", LogLevelTrace, true, true);
+	StorageBuffer storage_buffer(1024, &file_logger, &event_manager, 2);
+	StorageEngine storage_engine(&file_logger, 4, &event_manager, &storage_buffer);
+	WriteController write_controller(&storage_buffer, &storage_engine, &file_logger, 1, 8, 12, 100);
+
+	// Nothing is flushed, so the income buffer is switched twice and then
+	// grows past the buffer size.
+	int i = 0;
+	while (storage_buffer.ImmutableBuffersNumber() < 2 || !storage_buffer.IncomeBufferFull())
+	{
+		std::string key = "key" + std::to_string(i++);
+		storage_buffer.Add(Put, ByteArray(key.data(), key.size()), ByteArray(key.data(), key.size()));
+	}
+
+	for (int j = 0; j < i; ++j)
+	{
+		std::string key = "key" + std::to_string(j);
+		std::string value_out;
+		ASSERT_EQ(storage_buffer.Get(key, value_out), 0);
+		ASSERT_EQ(key, value_out);
+	}
+
+	std::atomic<bool> done(false);
+	std::thread writer([&write_controller, &done]() {
+		write_controller.Throttle();
+		done = true;
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_TRUE(!done);
+
+	int file_id;
+	std::string file_name;
+	MemTable* flush_buffer = storage_buffer.PickFlushBuffer();
+	TableBuilder* builder = storage_engine.NewTableBuilder(storage_engine.NewWritableFile(file_id, file_name));
+	ASSERT_EQ(storage_buffer.FlushBuffer(flush_buffer, builder), 0);
+	delete builder;
+	storage_engine.AddFile(file_name);
+	storage_buffer.ClearFlushBuffer(flush_buffer);
+	write_controller.Signal();
+
+	writer.join();
+	ASSERT_TRUE(done);
+	ASSERT_EQ(write_controller.StallCount(), 1);
+	ASSERT_EQ(write_controller.SlowdownCount(), 0);
+
+	// The full income buffer took the free slot, one buffer past the trigger.
+	ASSERT_EQ(storage_buffer.ImmutableBuffersNumber(), 2);
+	write_controller.Throttle();
+	ASSERT_EQ(write_controller.SlowdownCount(), 1);
+	ASSERT_EQ(write_controller.SlowdownMicros(), 200);
+}
+
+int main()
+{
+	return RunAllTests();
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "../structure/bloom_filter.h"
+#include "../structure/xor_filter.h"
+#include "../structure/test_harness.h"
+
+class XorFilterTest { };
+
+std::vector<uint32_t> Hashes(int begin, int end)
+{
+	std::vector<uint32_t> hashes;
+	for (int i = begin; i < end; ++i)
+	{
+		std::string key = "key" + std::to_string(i);
+		hashes.push_back(BloomFilter::KeyHash(ByteArray(key.data(), key.size())));
+	}
+
+	return hashes;
+}
+
+TEST(XorFilterTest, NoFalseNegatives)
+{
+	for (int num = 0; num <= 100000; num = (num == 0 ? 1 : num * 10))
+	{
+		std::vector<uint32_t> hashes = Hashes(0, num);
+		std::string filter;
+		ASSERT_TRUE(XorFilter::CreateFilter(hashes, filter));
+
+		ByteArray contents(filter.data(), filter.size());
+		for (auto hash : hashes)
+		{
+			ASSERT_TRUE(XorFilter::KeyMayMatch(hash, contents));
+		}
+	}
+}
+
+TEST(XorFilterTest, DuplicateKeys)
+{
+	std::vector<uint32_t> hashes = Hashes(0, 1000);
+	std::vector<uint32_t> twice(hashes);
+	twice.insert(twice.end(), hashes.begin(), hashes.end());
+
+	std::string filter;
+	ASSERT_TRUE(XorFilter::CreateFilter(twice, filter));
+	ByteArray contents(filter.data(), filter.size());
+	for (auto hash : hashes)
+	{
+		ASSERT_TRUE(XorFilter::KeyMayMatch(hash, contents));
+	}
+}
+
+TEST(XorFilterTest, FalsePositiveRate)
+{
+	std::string filter;
+	ASSERT_TRUE(XorFilter::CreateFilter(Hashes(0, 100000), filter));
+	ByteArray contents(filter.data(), filter.size());
+
+	// 1.23 slots of 8 bits per key.
+	ASSERT_TRUE(filter.size() * 8.0 / 100000 < 10.0);
+
+	int false_positives = 0;
+	for (auto hash : Hashes(100000, 200000))
+	{
+		false_positives += XorFilter::KeyMayMatch(hash, contents);
+	}
+
+	// About 1/256 expected.
+	ASSERT_TRUE(false_positives < 700);
+}
+
+int main()
+{
+	return RunAllTests();
+}
@@ -5,24 +5,109 @@
 #ifndef COMPARATOR_H_
 #define COMPARATOR_H_
 
+#include <string.h>
+
 #include "utils.h"
 #include "../type/byte_array.h"
 
-class Comparator
+// Key formats KeyComparator can be specialized for. Each one knows where the
+// user key starts in an encoded entry "key_size | key | type | value_size |
+// value" and how to order two user keys bytewise, without copying them.
+
+// First 8 bytes of a user key as an integer ordered like the bytes, padded with
+// zeros when the key is shorter.
+inline uint64_t KeyPrefix(const char* key, uint32_t size)
+{
+	uint64_t prefix = 0;
+	memcpy(&prefix, key, size < 8 ? size : 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	prefix = __builtin_bswap64(prefix);
+#endif
+	return prefix;
+}
+
+// Arbitrary byte strings, ordered by memcmp with the shorter key first on ties.
+struct VariableLengthKey
+{
+	static const char* Key(const char* entry, uint32_t* size)
+	{
+		if ((static_cast<unsigned char>(*entry) & 128) == 0)
+		{
+			*size = static_cast<unsigned char>(*entry);
+			return entry + 1;
+		}
+
+		return GetVarint32Ptr(entry, entry + 5, size);
+	}
+
+	static int Compare(const char* a, uint32_t asize, const char* b, uint32_t bsize)
+	{
+		return CompareBytes(a, asize, b, bsize);
+	}
+};
+
+// Keys of exactly N bytes, the size header and the tie break are skipped.
+template<uint32_t N>
+struct FixedLengthKey
+{
+	static const char* Key(const char* entry, uint32_t* size)
+	{
+		*size = N;
+		return entry + (N < 128 ? 1 : (N < (1 << 14) ? 2 : (N < (1 << 21) ? 3 : (N < (1 << 28) ? 4 : 5))));
+	}
+
+	static int Compare(const char* a, uint32_t, const char* b, uint32_t)
+	{
+		return memcmp(a, b, N);
+	}
+};
+
+// Unsigned 64-bit integers stored big-endian, compared as one machine word.
+struct Uint64Key
+{
+	static const char* Key(const char* entry, uint32_t* size)
+	{
+		*size = 8;
+		return entry + 1;
+	}
+
+	static int Compare(const char* a, uint32_t, const char* b, uint32_t)
+	{
+		uint64_t x, y;
+		memcpy(&x, a, 8);
+		memcpy(&y, b, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		x = __builtin_bswap64(x);
+		y = __builtin_bswap64(y);
+#endif
+		return x < y ? -1 : (x == y ? 0 : 1);
+	}
+};
+
+// Compare two encoded entries by their user keys in place.
+template<class KeyFormat>
+class KeyComparator
 {
 public:
-	~Comparator() { }
-	Comparator() { }
+	~KeyComparator() { }
+	KeyComparator() { }
 
 	int operator()(const char* a, const char* b) const
 	{
-		// TODO: Use a new data structure to avoid repetitive decoding process in comparison.
-		ByteArray akey(ExtractUserKey(a));
-		ByteArray bkey(ExtractUserKey(b));
-		std::string astr_key(akey.Data(), akey.Size());
-		std::string bstr_key(bkey.Data(), bkey.Size());
-		return astr_key < bstr_key ? -1 : (astr_key == bstr_key ? 0 : 1);
+		uint32_t asize, bsize;
+		const char* akey = KeyFormat::Key(a, &asize);
+		const char* bkey = KeyFormat::Key(b, &bsize);
+		return KeyFormat::Compare(akey, asize, bkey, bsize);
+	}
+
+	// Normalized key prefix the skip list keeps inline in its nodes.
+	uint64_t Prefix(const char* entry, uint32_t* size) const
+	{
+		const char* key = KeyFormat::Key(entry, size);
+		return KeyPrefix(key, *size);
 	}
 };
 
+typedef KeyComparator<VariableLengthKey> Comparator;
+
 #endif  // COMPARATOR_H_
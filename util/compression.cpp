@@ -0,0 +1,348 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <vector>
+
+#include <string.h>
+
+#include "compression.h"
+#include "coding.h"
+
+// LZ format
+// ---------
+//
+//   varint32 uncompressed_size | sequence...
+//
+// Sequence: token | [literal length bytes] | literals |
+//           fixed16 offset | [match length bytes]
+//
+// The high 4 bits of the token are the number of literals and the low 4 bits
+// the match length minus kMinMatch. A nibble of 15 is followed by bytes
+// adding up to the rest of the length, every 255 meaning another byte
+// follows. The last sequence has literals only and ends the input.
+
+namespace
+{
+
+const int kMinMatch = 4;
+const int kMaxOffset = 65535;
+const int kMaxHashBits = 14;
+// Candidates the high compression codec looks at per position.
+const int kMaxChainDepth = 32;
+
+uint32_t Load32(const char* p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+uint32_t HashSequence(uint32_t v, int hash_bits)
+{
+	return (v * 2654435761U) >> (32 - hash_bits);
+}
+
+// Small blocks get a small hash table, it is cleared for every block.
+int HashBits(size_t size)
+{
+	int hash_bits = 8;
+	while (hash_bits < kMaxHashBits && (static_cast<size_t>(1) << hash_bits) < size)
+	{
+		hash_bits++;
+	}
+
+	return hash_bits;
+}
+
+void AppendLength(std::string& output, size_t length)
+{
+	while (length >= 255)
+	{
+		output.push_back(static_cast<char>(255));
+		length -= 255;
+	}
+
+	output.push_back(static_cast<char>(length));
+}
+
+void AppendSequence(std::string& output, const char* literals, size_t literal_size, uint32_t offset, size_t match_size)
+{
+	size_t match_code = match_size == 0 ? 0 : match_size - kMinMatch;
+	uint8_t token = ((literal_size < 15 ? literal_size : 15) << 4) | (match_code < 15 ? match_code : 15);
+	output.push_back(static_cast<char>(token));
+	if (literal_size >= 15)
+	{
+		AppendLength(output, literal_size - 15);
+	}
+
+	output.append(literals, literal_size);
+	if (match_size == 0)
+	{
+		return;
+	}
+
+	output.push_back(static_cast<char>(offset & 0xff));
+	output.push_back(static_cast<char>(offset >> 8));
+	if (match_code >= 15)
+	{
+		AppendLength(output, match_code - 15);
+	}
+}
+
+size_t MatchLength(const char* input, size_t size, size_t pos, size_t candidate)
+{
+	size_t length = 0;
+	while (pos + length < size && input[candidate + length] == input[pos + length])
+	{
+		length++;
+	}
+
+	return length;
+}
+
+void StartOutput(std::string& output, size_t size)
+{
+	char buf[5];
+	output.assign(buf, EncodeVarint32(buf, size) - buf);
+}
+
+class LzCompressor : public Compressor
+{
+public:
+	CompressionType Type() const override
+	{
+		return LzCompression;
+	}
+
+	const char* Name() const override
+	{
+		return "lz";
+	}
+
+	bool Compress(const char* input, size_t size, std::string& output) const override
+	{
+		StartOutput(output, size);
+		int hash_bits = HashBits(size);
+		std::vector<int32_t> table(1 << hash_bits, -1);
+		size_t anchor = 0;
+		size_t pos = 0;
+		while (pos + kMinMatch <= size)
+		{
+			uint32_t v = Load32(input + pos);
+			uint32_t h = HashSequence(v, hash_bits);
+			int32_t candidate = table[h];
+			table[h] = pos;
+			if (candidate < 0 || pos - candidate > kMaxOffset || Load32(input + candidate) != v)
+			{
+				// Skip faster through input that does not match.
+				pos += 1 + ((pos - anchor) >> 6);
+				continue;
+			}
+
+			size_t match_size = kMinMatch + MatchLength(input, size, pos + kMinMatch, candidate + kMinMatch);
+			AppendSequence(output, input + anchor, pos - anchor, pos - candidate, match_size);
+			pos += match_size;
+			anchor = pos;
+		}
+
+		AppendSequence(output, input + anchor, size - anchor, 0, 0);
+		return true;
+	}
+
+	bool Uncompress(const char* input, size_t size, std::string& output) const override;
+};
+
+class LzHighCompressor : public LzCompressor
+{
+public:
+	CompressionType Type() const override
+	{
+		return LzHighCompression;
+	}
+
+	const char* Name() const override
+	{
+		return "lz-high";
+	}
+
+	bool Compress(const char* input, size_t size, std::string& output) const override
+	{
+		StartOutput(output, size);
+		int hash_bits = HashBits(size);
+		std::vector<int32_t> head(1 << hash_bits, -1);
+		std::vector<int32_t> prev(size, -1);
+		size_t anchor = 0;
+		size_t pos = 0;
+		// Positions before inserted are in the hash chains.
+		size_t inserted = 0;
+		while (pos + kMinMatch <= size)
+		{
+			for (; inserted <= pos; ++inserted)
+			{
+				uint32_t h = HashSequence(Load32(input + inserted), hash_bits);
+				prev[inserted] = head[h];
+				head[h] = inserted;
+			}
+
+			size_t best_size = 0;
+			size_t best_candidate = 0;
+			int32_t candidate = prev[pos];
+			for (int depth = 0; depth < kMaxChainDepth && candidate >= 0 && pos - candidate <= kMaxOffset; ++depth)
+			{
+				size_t match_size = MatchLength(input, size, pos, candidate);
+				if (match_size > best_size)
+				{
+					best_size = match_size;
+					best_candidate = candidate;
+				}
+
+				candidate = prev[candidate];
+			}
+
+			if (best_size < kMinMatch)
+			{
+				pos++;
+				continue;
+			}
+
+			AppendSequence(output, input + anchor, pos - anchor, pos - best_candidate, best_size);
+			pos += best_size;
+			anchor = pos;
+
+			// The positions inside the match still join the chains.
+			while (inserted < pos && inserted + kMinMatch <= size)
+			{
+				uint32_t h = HashSequence(Load32(input + inserted), hash_bits);
+				prev[inserted] = head[h];
+				head[h] = inserted;
+				inserted++;
+			}
+		}
+
+		AppendSequence(output, input + anchor, size - anchor, 0, 0);
+		return true;
+	}
+};
+
+bool ReadLength(const char*& p, const char* limit, size_t& length)
+{
+	uint8_t b;
+	do
+	{
+		if (p >= limit)
+		{
+			return false;
+		}
+
+		b = static_cast<uint8_t>(*p++);
+		length += b;
+	} while (b == 255);
+
+	return true;
+}
+
+bool LzCompressor::Uncompress(const char* input, size_t size, std::string& output) const
+{
+	const char* p = input;
+	const char* limit = input + size;
+	uint32_t uncompressed_size;
+	if ((p = GetVarint32Ptr(p, limit, &uncompressed_size)) == nullptr)
+	{
+		return false;
+	}
+
+	output.resize(uncompressed_size);
+	char* out = &output[0];
+	size_t produced = 0;
+	while (p < limit)
+	{
+		uint8_t token = static_cast<uint8_t>(*p++);
+		size_t literal_size = token >> 4;
+		if (literal_size == 15 && !ReadLength(p, limit, literal_size))
+		{
+			return false;
+		}
+
+		if (literal_size > static_cast<size_t>(limit - p) || literal_size > uncompressed_size - produced)
+		{
+			return false;
+		}
+
+		memcpy(out + produced, p, literal_size);
+		p += literal_size;
+		produced += literal_size;
+		if (p == limit)
+		{
+			break;
+		}
+
+		if (limit - p < 2)
+		{
+			return false;
+		}
+
+		size_t offset = static_cast<uint8_t>(p[0]) | (static_cast<uint8_t>(p[1]) << 8);
+		p += 2;
+		size_t match_size = token & 15;
+		if (match_size == 15 && !ReadLength(p, limit, match_size))
+		{
+			return false;
+		}
+
+		match_size += kMinMatch;
+		if (offset == 0 || offset > produced || match_size > uncompressed_size - produced)
+		{
+			return false;
+		}
+
+		const char* from = out + produced - offset;
+		if (offset >= match_size)
+		{
+			memcpy(out + produced, from, match_size);
+		}
+		else
+		{
+			// The match overlaps the bytes it produces, copy byte by byte.
+			for (size_t i = 0; i < match_size; ++i)
+			{
+				out[produced + i] = from[i];
+			}
+		}
+
+		produced += match_size;
+	}
+
+	return produced == uncompressed_size;
+}
+
+const int kMaxCompressionType = 256;
+
+const Compressor** Compressors()
+{
+	static LzCompressor lz;
+	static LzHighCompressor lz_high;
+	static const Compressor* compressors[kMaxCompressionType] = { nullptr, &lz, &lz_high };
+	return compressors;
+}
+
+}  // namespace
+
+const Compressor* GetCompressor(int type)
+{
+	if (type <= NoCompression || type >= kMaxCompressionType)
+	{
+		return nullptr;
+	}
+
+	return Compressors()[type];
+}
+
+void RegisterCompressor(const Compressor* compressor)
+{
+	int type = compressor->Type();
+	if (type > NoCompression && type < kMaxCompressionType)
+	{
+		Compressors()[type] = compressor;
+	}
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef COMPRESSION_H_
+#define COMPRESSION_H_
+
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compression of table blocks. The type of every block is stored next to it,
+// so a file may mix codecs and a reader only needs the codecs to be
+// registered.
+enum CompressionType
+{
+	NoCompression = 0,
+	// LZ77 with a single hash table probe per position, fast both ways.
+	LzCompression = 1,
+	// Same format as LzCompression, searching a hash chain for the longest
+	// match. Slower to compress, decompresses as fast.
+	LzHighCompression = 2,
+};
+
+// Codec of one CompressionType. Codecs are stateless and shared by threads.
+class Compressor
+{
+public:
+	virtual ~Compressor() { }
+
+	virtual CompressionType Type() const = 0;
+
+	virtual const char* Name() const = 0;
+
+	// Replace output with the compressed input. Return false if the codec
+	// cannot compress it.
+	virtual bool Compress(const char* input, size_t size, std::string& output) const = 0;
+
+	// Replace output with the uncompressed input. Return false if input is
+	// corrupted.
+	virtual bool Uncompress(const char* input, size_t size, std::string& output) const = 0;
+};
+
+// Codec of type, nullptr if none is registered.
+const Compressor* GetCompressor(int type);
+
+// Make compressor the codec of its type, replacing a built-in one if any.
+// Not thread safe, register codecs before opening the database.
+void RegisterCompressor(const Compressor* compressor);
+
+#endif  // COMPRESSION_H_
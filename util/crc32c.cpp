@@ -0,0 +1,143 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+#include "crc32c.h"
+
+namespace
+{
+
+// Reversed Castagnoli polynomial.
+const uint32_t kPolynomial = 0x82f63b78u;
+
+// tables[k][b] is the crc of byte b followed by k zero bytes, so four bytes
+// are folded in with four independent lookups.
+struct Crc32cTables
+{
+	uint32_t tables_[4][256];
+
+	Crc32cTables()
+	{
+		for (uint32_t b = 0; b < 256; ++b)
+		{
+			uint32_t crc = b;
+			for (int i = 0; i < 8; ++i)
+			{
+				crc = (crc >> 1) ^ ((crc & 1) ? kPolynomial : 0);
+			}
+
+			tables_[0][b] = crc;
+		}
+
+		for (uint32_t b = 0; b < 256; ++b)
+		{
+			for (int k = 1; k < 4; ++k)
+			{
+				uint32_t prev = tables_[k - 1][b];
+				tables_[k][b] = (prev >> 8) ^ tables_[0][prev & 0xff];
+			}
+		}
+	}
+};
+
+const Crc32cTables kTables;
+
+bool DetectSse42()
+{
+#if defined(CRC32C_HAVE_SSE42)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+#else
+	return false;
+#endif
+}
+
+const bool kHasSse42 = DetectSse42();
+
+}  // namespace
+
+uint32_t Crc32cExtendPortable(uint32_t crc, const char* data, size_t n)
+{
+	const uint32_t (*t)[256] = kTables.tables_;
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+	const unsigned char* limit = p + n;
+	uint32_t l = crc ^ 0xffffffffu;
+
+	while (limit - p >= 4)
+	{
+		l ^= p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+		l = t[3][l & 0xff] ^ t[2][(l >> 8) & 0xff] ^ t[1][(l >> 16) & 0xff] ^ t[0][l >> 24];
+		p += 4;
+	}
+
+	while (p < limit)
+	{
+		l = t[0][(l ^ *p++) & 0xff] ^ (l >> 8);
+	}
+
+	return l ^ 0xffffffffu;
+}
+
+#if defined(CRC32C_HAVE_SSE42)
+
+__attribute__((target("sse4.2")))
+uint32_t Crc32cExtendSse42(uint32_t crc, const char* data, size_t n)
+{
+	const char* p = data;
+	const char* limit = data + n;
+	uint32_t l = crc ^ 0xffffffffu;
+
+#if defined(__x86_64__)
+	uint64_t l64 = l;
+	while (limit - p >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, p, 8);
+		l64 = _mm_crc32_u64(l64, word);
+		p += 8;
+	}
+
+	l = static_cast<uint32_t>(l64);
+#endif
+
+	while (limit - p >= 4)
+	{
+		uint32_t word;
+		memcpy(&word, p, 4);
+		l = _mm_crc32_u32(l, word);
+		p += 4;
+	}
+
+	while (p < limit)
+	{
+		l = _mm_crc32_u8(l, static_cast<unsigned char>(*p++));
+	}
+
+	return l ^ 0xffffffffu;
+}
+
+#else
+
+uint32_t Crc32cExtendSse42(uint32_t crc, const char* data, size_t n)
+{
+	return Crc32cExtendPortable(crc, data, n);
+}
+
+#endif
+
+uint32_t Crc32cExtend(uint32_t crc, const char* data, size_t n)
+{
+	return kHasSse42 ? Crc32cExtendSse42(crc, data, n) : Crc32cExtendPortable(crc, data, n);
+}
+
+bool Crc32cHasSse42()
+{
+	return kHasSse42;
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli) of the blocks of table files. Computed with the SSE4.2
+// crc32 instruction when the CPU has it, with lookup tables otherwise. Both
+// give the same result.
+
+// Return the crc of data[0, n) appended to the data crc is the crc of.
+uint32_t Crc32cExtend(uint32_t crc, const char* data, size_t n);
+
+uint32_t Crc32cExtendPortable(uint32_t crc, const char* data, size_t n);
+uint32_t Crc32cExtendSse42(uint32_t crc, const char* data, size_t n);
+
+bool Crc32cHasSse42();
+
+inline uint32_t Crc32cValue(const char* data, size_t n)
+{
+	return Crc32cExtend(0, data, n);
+}
+
+// The crc of a string containing its own crc is weak, stored crcs are
+// rotated and offset first.
+const uint32_t kCrc32cMaskDelta = 0xa282ead8ul;
+
+inline uint32_t Crc32cMask(uint32_t crc)
+{
+	return ((crc >> 15) | (crc << 17)) + kCrc32cMaskDelta;
+}
+
+inline uint32_t Crc32cUnmask(uint32_t masked_crc)
+{
+	uint32_t rot = masked_crc - kCrc32cMaskDelta;
+	return ((rot >> 17) | (rot << 15));
+}
+
+#endif  // CRC32C_H_
@@ -0,0 +1,51 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+// The code below was copied from LevelDB. A few changes were applied to make it
+// self-sufficient.
+
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "hash.h"
+#include "coding.h"
+
+uint32_t Hash(const char* data, size_t n, uint32_t seed)
+{
+	// Similar to murmur hash
+	const uint32_t m = 0xc6a4a793;
+	const uint32_t r = 24;
+	const char* limit = data + n;
+	uint32_t h = seed ^ (n * m);
+
+	// Pick up four bytes at a time
+	while (data + 4 <= limit)
+	{
+		uint32_t w;
+		GetFixed32(data, &w);
+		data += 4;
+		h += w;
+		h *= m;
+		h ^= (h >> 16);
+	}
+
+	// Pick up remaining bytes
+	switch (limit - data)
+	{
+		case 3:
+			h += static_cast<unsigned char>(data[2]) << 16;
+			// fall through
+		case 2:
+			h += static_cast<unsigned char>(data[1]) << 8;
+			// fall through
+		case 1:
+			h += static_cast<unsigned char>(data[0]);
+			h *= m;
+			h ^= (h >> r);
+			break;
+	}
+
+	return h;
+}
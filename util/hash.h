@@ -0,0 +1,21 @@
+// Copyright (c) 2018, Bo Li(hopelee1994@gmail.com). All rights reserved.
+// Use of this source code is governed by the BSD 3-Clause License,
+// that can be found in the LICENSE file.
+
+// The code below was copied from LevelDB. A few changes were applied to make it
+// self-sufficient.
+
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Simple hash function similar to murmur hash.
+extern uint32_t Hash(const char* data, size_t n, uint32_t seed);
+
+#endif  // HASH_H_
@@ -8,9 +8,13 @@
 #include <assert.h>
 #include <string>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "coding.h"
 #include "../type/byte_array.h"
+#include "../type/value_type.h"
 
 inline ByteArray ExtractUserKey(const ByteArray& entry)
 {
@@ -30,34 +34,43 @@ inline ByteArray ExtractUserKey(const char* entry)
 	return ByteArray(p, key_size);
 }
 
+// Entries are encoded "key_size | key | uint8 type | value_size | value",
+// the type is a ValueType.
 inline uint32_t EntrySize(const char* entry)
 {
 	uint32_t total_len = 0, size = 0;
 	int length = GetVarint32(entry, 5, &size);
-	total_len += length + size;
-	entry += length + size;
+	total_len += length + size + 1;
+	entry += length + size + 1;
 	length = GetVarint32(entry, 5, &size);
 	return total_len + length + size;
 }
 
+inline ValueType ExtractValueType(const char* entry)
+{
+	uint32_t size;
+	int length = GetVarint32(entry, 5, &size);
+	return static_cast<ValueType>(entry[length + size]);
+}
+
+inline ValueType ExtractValueType(const ByteArray& entry)
+{
+	return ExtractValueType(entry.Data());
+}
+
 inline ByteArray ExtractUserValue(const char* entry)
 {
 	const char* p = entry;
 	uint32_t size;
 	int length = GetVarint32(p, 5, &size);
-	p += length + size;
+	p += length + size + 1;
 	length = GetVarint32(p, 5, &size);
 	return ByteArray(p + length, size);
 }
 
 inline ByteArray ExtractUserValue(const ByteArray& entry)
 {
-	const char* p = entry.Data();
-	uint32_t size;
-	int length = GetVarint32(p, 5, &size);
-	p += length + size;
-	length = GetVarint32(p, 5, &size);
-	return ByteArray(p + length, size);
+	return ExtractUserValue(entry.Data());
 }
 
 inline ByteArray WrapUserKey(const ByteArray& key)
@@ -70,12 +83,35 @@ inline ByteArray WrapUserKey(const ByteArray& key)
 	return ByteArray(buf, encoded_len);
 }
 
+// Append the encoded entry to dst, the same layout StorageBuffer::Add writes
+// into the income buffer.
+inline void AppendEntry(std::string& dst, const ByteArray& key, const ByteArray& value, ValueType type = TypeValue)
+{
+	char buf[5];
+	char* p = EncodeVarint32(buf, key.Size());
+	dst.append(buf, p - buf);
+	dst.append(key.Data(), key.Size());
+	dst.push_back(static_cast<char>(type));
+	p = EncodeVarint32(buf, value.Size());
+	dst.append(buf, p - buf);
+	dst.append(value.Data(), value.Size());
+}
+
+// Bytewise order, the same as std::string's, without copying the keys.
+inline int CompareBytes(const char* a, uint32_t asize, const char* b, uint32_t bsize)
+{
+	int r = memcmp(a, b, asize < bsize ? asize : bsize);
+	if (r == 0)
+	{
+		r = asize < bsize ? -1 : (asize == bsize ? 0 : 1);
+	}
+
+	return r;
+}
+
 inline int Compare(const ByteArray& akey, const ByteArray& bkey)
 {
-	std::string akey_str(akey.Data(), akey.Size());
-	std::string bkey_str(bkey.Data(), bkey.Size());
-	return akey_str < bkey_str ? -1 
-		: (akey_str == bkey_str ? 0 : 1);
+	return CompareBytes(akey.Data(), akey.Size(), bkey.Data(), bkey.Size());
 }
 
 inline std::string FileName(int level_id, int file_id)                                                            
@@ -90,4 +126,26 @@ inline std::string FileName(int level_id, int file_id)
     return file_name;                                                             
 }       
 
+// fsync a folder, so the files created, renamed or removed in it stay that
+// way after a crash. Return 0 on success.
+inline int SyncFolder(const std::string& folder)
+{
+	int fd = open(folder.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	int status = fsync(fd);
+	close(fd);
+	return status == 0 ? 0 : -1;
+}
+
+inline std::string LogFileName(uint64_t number)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%08llu.log", static_cast<unsigned long long>(number));
+	return std::string(buf);
+}
+
 #endif  // UTILS_H_